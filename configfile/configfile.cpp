@@ -190,6 +190,11 @@ bool ConfigFile::read(const std::string& configFile) {
     
     if (line[0] == '[') {
       inSection=trim(line.substr(1,line.find(']')-1));
+      bool known=false;
+      for (unsigned int i=0; i<m_sections.size(); i++)
+        known|=toLower(m_sections[i])==toLower(inSection);
+      if (!known)
+        m_sections.push_back(inSection);
       continue;
     }
     
@@ -2,16 +2,19 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <gmapping/gridfastslam/gfsreader.h>
 
 using namespace std;
+using namespace GMapping;
 
 int main(int argc, char**argv){
 	if (argc<3){
 		cout << "usage gfs2neff <infilename> <nefffilename>" << endl;
 		return -1;
 	}
-	ifstream is(argv[1]);
-	if (!is){
+	//the index accepts both the text and the binary gfs files, only the NEFF records are decoded
+	GFSReader::IndexedRecordList rl;
+	if (!rl.open(argv[1])){
 		cout << "could read file "<< endl;
 		return -1;
 	}
@@ -20,21 +23,13 @@ int main(int argc, char**argv){
 		cout << "could write file "<< endl;
 		return -1;
 	}
-	unsigned int frame=0;
-	double neff=0;
-	while(is){
-			char buf[8192];
-			is.getline(buf, 8192);
-			istringstream lineStream(buf);
-			string recordType;
-			lineStream >> recordType;
-			if (recordType=="FRAME"){
-				lineStream>> frame;
-			}
-			if (recordType=="NEFF"){
-				lineStream>> neff;
-				os << frame << " " << neff << endl;
-			}
+	for (size_t i=0; i<rl.size(); i++){
+		if (rl.type(i)!=GFSReader::IndexedRecordList::Neff)
+			continue;
+		GFSReader::NeffRecord* neff=dynamic_cast<GFSReader::NeffRecord*>(rl.record(i));
+		if (neff)
+			os << neff->frame << " " << neff->neff << endl;
+		delete neff;
 	}
 	os.close();
 }
@@ -0,0 +1,239 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <gmapping/utils/commandline.h>
+#include "gmapping/gridfastslam/gfsparameters.h"
+#include "gmapping/gridfastslam/gridslamprocessor.h"
+
+namespace GMapping {
+
+using namespace std;
+
+GFSParameters::GFSParameters(){
+	filename="";
+	outfilename="";
+	xmin=-100.;
+	ymin=-100.;
+	xmax=100.;
+	ymax=100.;
+	delta=0.05;
+
+	//scan matching parameters
+	sigma=0.05;
+	maxrange=80.;
+	maxUrange=80.;
+	regscore=1e4;
+	lstep=.05;
+	astep=.05;
+	kernelSize=1;
+	iterations=5;
+	critscore=0.;
+	maxMove=1.;
+	lsigma=.075;
+	ogain=3;
+	lskip=0;
+	autosize=false;
+	skipMatching=false;
+
+	//motion model parameters
+	srr=0.1, srt=0.1, str=0.1, stt=0.1;
+	//particle parameters
+	particles=30;
+	randseed=0;
+
+	//gfs parameters
+	angularUpdate=0.5;
+	linearUpdate=1;
+	resampleThreshold=0.5;
+
+	mapUpdateTime=5;
+	readFromStdin=false;
+	onLine=false;
+	generateMap=false;
+	likelihoodField=false;
+	multiResolution=false;
+	coarseLinearRange=0.2;
+	coarseAngularRange=0.1;
+
+	// This  are the dafault settings for a grid map of 5 cm
+	llsamplerange=0.01;
+	llsamplestep=0.01;
+	lasamplerange=0.005;
+	lasamplestep=0.005;
+	linearOdometryReliability=0.;
+	angularOdometryReliability=0.;
+
+	considerOdometryCovariance=false;
+
+	//the defaults of the processor
+	matchingThreads=1;
+	lazyRegistration=false;
+	binaryOutput=false;
+	asyncOutput=false;
+	outputQueueSize=1024;
+	odometryOutputPeriod=1;
+	minimumScore=0.;
+
+	estrategy="not_set";
+}
+
+void GFSParameters::read(ConfigFile& cfg, const std::string& section){
+	filename = (std::string) cfg.value(section,"filename",filename);
+	outfilename = (std::string) cfg.value(section,"outfilename",outfilename);
+	xmin = cfg.value(section,"xmin", xmin);
+	xmax = cfg.value(section,"xmax",xmax);
+	ymin = cfg.value(section,"ymin",ymin);
+	ymax = cfg.value(section,"ymax",ymax);
+	delta =  cfg.value(section,"delta",delta);
+	maxrange = cfg.value(section,"maxrange",maxrange);
+	maxUrange = cfg.value(section,"maxUrange",maxUrange);
+	regscore = cfg.value(section,"regscore",regscore);
+	critscore = cfg.value(section,"critscore",critscore);
+	kernelSize = cfg.value(section,"kernelSize",kernelSize);
+	sigma = cfg.value(section,"sigma",sigma);
+	iterations = cfg.value(section,"iterations",iterations);
+	lstep = cfg.value(section,"lstep",lstep);
+	astep = cfg.value(section,"astep",astep);
+	maxMove = cfg.value(section,"maxMove",maxMove);
+	srr = cfg.value(section,"srr", srr);
+	srt = cfg.value(section,"srt", srt);
+	str = cfg.value(section,"str", str);
+	stt = cfg.value(section,"stt", stt);
+	particles = cfg.value(section,"particles",particles);
+	angularUpdate = cfg.value(section,"angularUpdate", angularUpdate);
+	linearUpdate = cfg.value(section,"linearUpdate", linearUpdate);
+	lsigma = cfg.value(section,"lsigma", lsigma);
+	ogain = cfg.value(section,"lobsGain", ogain);
+	lskip = (int)cfg.value(section,"lskip", lskip);
+	mapUpdateTime = cfg.value(section,"mapUpdate", mapUpdateTime);
+	randseed = cfg.value(section,"randseed", randseed);
+	autosize = cfg.value(section,"autosize", autosize);
+	readFromStdin = cfg.value(section,"stdin", readFromStdin);
+	resampleThreshold = cfg.value(section,"resampleThreshold", resampleThreshold);
+	skipMatching = cfg.value(section,"skipMatching", skipMatching);
+	onLine = cfg.value(section,"onLine", onLine);
+	generateMap = cfg.value(section,"generateMap", generateMap);
+	likelihoodField = cfg.value(section,"likelihoodField", likelihoodField);
+	multiResolution = cfg.value(section,"multiResolution", multiResolution);
+	coarseLinearRange = cfg.value(section,"coarseLinearRange", coarseLinearRange);
+	coarseAngularRange = cfg.value(section,"coarseAngularRange", coarseAngularRange);
+	matchingThreads = cfg.value(section,"matchingThreads", matchingThreads);
+	lazyRegistration = cfg.value(section,"lazyRegistration", lazyRegistration);
+	binaryOutput = cfg.value(section,"binaryOutput", binaryOutput);
+	asyncOutput = cfg.value(section,"asyncOutput", asyncOutput);
+	outputQueueSize = cfg.value(section,"outputQueueSize", outputQueueSize);
+	odometryOutputPeriod = cfg.value(section,"odometryOutputPeriod", odometryOutputPeriod);
+	minimumScore = cfg.value(section,"minimumScore", minimumScore);
+	llsamplerange = cfg.value(section,"llsamplerange", llsamplerange);
+	lasamplerange = cfg.value(section,"lasamplerange",lasamplerange );
+	llsamplestep = cfg.value(section,"llsamplestep", llsamplestep);
+	lasamplestep = cfg.value(section,"lasamplestep", lasamplestep);
+	linearOdometryReliability = cfg.value(section,"linearOdometryReliability",linearOdometryReliability);
+	angularOdometryReliability = cfg.value(section,"angularOdometryReliability",angularOdometryReliability);
+	estrategy = (std::string) cfg.value(section,"estrategy", estrategy);
+	logLevel = (std::string) cfg.value(section,"logLevel", logLevel);
+	considerOdometryCovariance = cfg.value(section,"considerOdometryCovariance",considerOdometryCovariance);
+}
+
+bool GFSParameters::parse(int argc, const char * const * argv){
+	std::string configfilename;
+
+	CMD_PARSE_BEGIN_SILENT(1,argc);
+		parseStringSilent("-cfg",configfilename);
+	CMD_PARSE_END_SILENT;
+
+	if (configfilename.length()>0){
+		ConfigFile cfg(configfilename);
+		read(cfg);
+	}
+
+	CMD_PARSE_BEGIN(1,argc);
+		parseString("-cfg",configfilename);     /* to avoid the warning*/
+		parseString("-filename",filename);
+		parseString("-outfilename",outfilename);
+		parseDouble("-xmin",xmin);
+		parseDouble("-xmax",xmax);
+		parseDouble("-ymin",ymin);
+		parseDouble("-ymax",ymax);
+		parseDouble("-delta",delta);
+		parseDouble("-maxrange",maxrange);
+		parseDouble("-maxUrange",maxUrange);
+		parseDouble("-regscore",regscore);
+		parseDouble("-critscore",critscore);
+		parseInt("-kernelSize",kernelSize);
+		parseDouble("-sigma",sigma);
+		parseInt("-iterations",iterations);
+		parseDouble("-lstep",lstep);
+		parseDouble("-astep",astep);
+		parseDouble("-maxMove",maxMove);
+		parseDouble("-srr", srr);
+		parseDouble("-srt", srt);
+		parseDouble("-str", str);
+		parseDouble("-stt", stt);
+		parseInt("-particles",particles);
+		parseDouble("-angularUpdate", angularUpdate);
+		parseDouble("-linearUpdate", linearUpdate);
+		parseDouble("-lsigma", lsigma);
+		parseDouble("-lobsGain", ogain);
+		parseInt("-lskip", lskip);
+		parseInt("-mapUpdate", mapUpdateTime);
+		parseInt("-randseed", randseed);
+		parseFlag("-autosize", autosize);
+		parseFlag("-stdin", readFromStdin);
+		parseDouble("-resampleThreshold", resampleThreshold);
+		parseFlag("-skipMatching", skipMatching);
+		parseFlag("-onLine", onLine);
+		parseFlag("-generateMap", generateMap);
+		parseFlag("-likelihoodField", likelihoodField);
+		parseFlag("-multiResolution", multiResolution);
+		parseDouble("-coarseLinearRange", coarseLinearRange);
+		parseDouble("-coarseAngularRange", coarseAngularRange);
+		parseInt("-matchingThreads", matchingThreads);
+		parseFlag("-lazyRegistration", lazyRegistration);
+		parseFlag("-binaryOutput", binaryOutput);
+		parseFlag("-asyncOutput", asyncOutput);
+		parseInt("-outputQueueSize", outputQueueSize);
+		parseInt("-odometryOutputPeriod", odometryOutputPeriod);
+		parseDouble("-minimumScore", minimumScore);
+		parseDouble("-llsamplerange", llsamplerange);
+		parseDouble("-lasamplerange", lasamplerange);
+		parseDouble("-llsamplestep", llsamplestep);
+		parseDouble("-lasamplestep", lasamplestep);
+		parseDouble("-linearOdometryReliability",linearOdometryReliability);
+		parseDouble("-angularOdometryReliability",angularOdometryReliability);
+		parseString("-estrategy", estrategy);
+		parseString("-logLevel", logLevel);
+
+		parseFlag("-considerOdometryCovariance",considerOdometryCovariance);
+	CMD_PARSE_END;
+
+	return filename.length()>0;
+}
+
+void GFSParameters::configure(GridSlamProcessor& gsp) const{
+	gsp.setMatchingParameters(maxUrange, maxrange, sigma, kernelSize, lstep, astep, iterations, lsigma, ogain, lskip);
+	gsp.setMotionModelParameters(srr, srt, str, stt);
+	gsp.setUpdateDistances(linearUpdate, angularUpdate, resampleThreshold);
+	gsp.setgenerateMap(generateMap);
+	gsp.setuseLikelihoodField(likelihoodField);
+	gsp.setmultiResolution(multiResolution);
+	gsp.setcoarseLinearRange(coarseLinearRange);
+	gsp.setcoarseAngularRange(coarseAngularRange);
+	gsp.setmatchingThreads(matchingThreads);
+	gsp.setlazyRegistration(lazyRegistration);
+	gsp.setbinaryOutput(binaryOutput);
+	gsp.setasyncOutput(asyncOutput);
+	gsp.setoutputQueueSize(outputQueueSize);
+	gsp.setodometryOutputPeriod(odometryOutputPeriod);
+	gsp.setminimumScore(minimumScore);
+}
+
+void GFSParameters::initialize(GridSlamProcessor& gsp, double xmin, double ymin, double xmax, double ymax, OrientedPoint initialPose) const{
+	gsp.init(particles, xmin, ymin, xmax, ymax, delta, initialPose);
+	gsp.setllsamplerange(llsamplerange);
+	gsp.setllsamplestep(llsamplestep);
+	gsp.setlasamplerange(lasamplerange);
+	gsp.setlasamplestep(lasamplestep);
+}
+
+};
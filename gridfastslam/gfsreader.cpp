@@ -1,7 +1,17 @@
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
 #include "gmapping/gridfastslam/gfsreader.h"
+#include "gmapping/gridfastslam/gfsbinary.h"
 #include <iomanip>
 #include <limits>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace  GMapping { 
 
@@ -195,55 +205,170 @@ void ResampleRecord::read(istream& is){
 	}
 }
 
-istream& RecordList::read(istream& is){
-	while(is){
-		char buf[MAX_LINE_LENGHT];
-		is.getline(buf, MAX_LINE_LENGHT);
-		istringstream lineStream(buf);
-		string recordType;
-		lineStream >> recordType;
-		Record* rec=0;
-		if (recordType=="LASER_READING"){
-			rec=new LaserRecord;
+/**parses a line of the text format, @returns 0 if the line is not a record*/
+static Record* parseLine(const char* line, unsigned int& frame){
+	istringstream lineStream(line);
+	string recordType;
+	lineStream >> recordType;
+	Record* rec=0;
+	if (recordType=="FRAME"){
+		lineStream >> frame;
+	}
+	else if (recordType=="LASER_READING"){
+		rec=new LaserRecord;
 //			cout << "l" << flush;
-		}
-		else if (recordType=="ODO_UPDATE"){
-			rec=new OdometryRecord;
+	}
+	else if (recordType=="ODO_UPDATE"){
+		rec=new OdometryRecord;
 //			cout << "o" << flush;
-		}
-		else if (recordType=="ODOM"){
-			rec=new RawOdometryRecord;
+	}
+	else if (recordType=="ODOM"){
+		rec=new RawOdometryRecord;
 //			cout << "O" << flush;
-		}
-		else if (recordType=="SM_UPDATE"){
-			rec=new ScanMatchRecord;
+	}
+	else if (recordType=="SM_UPDATE"){
+		rec=new ScanMatchRecord;
 //			cout << "m" << flush;
-		}
-		else if (recordType=="SIMULATOR_POS"){
-			rec=new PoseRecord(true);
+	}
+	else if (recordType=="SIMULATOR_POS"){
+		rec=new PoseRecord(true);
 //			cout << "t" << flush;
-		}
-		else if (recordType=="RESAMPLE"){
-			rec=new ResampleRecord;
+	}
+	else if (recordType=="RESAMPLE"){
+		rec=new ResampleRecord;
 //			cout << "r" << flush;
-		}
-		else if (recordType=="NEFF"){
-			rec=new NeffRecord;
+	}
+	else if (recordType=="NEFF"){
+		NeffRecord* neff=new NeffRecord;
+		neff->frame=frame;
+		rec=neff;
 //			cout << "n" << flush;
-		}
-		else if (recordType=="COMMENT" || recordType=="#COMMENT"){
-			rec=new CommentRecord;
+	}
+	else if (recordType=="COMMENT" || recordType=="#COMMENT"){
+		rec=new CommentRecord;
 //			cout << "c" << flush;
-		}
-		else if (recordType=="ENTROPY"){
-			rec=new EntropyRecord;
+	}
+	else if (recordType=="ENTROPY"){
+		rec=new EntropyRecord;
 //			cout << "c" << flush;
-		}
-		
-		if (rec){
-			rec->read(lineStream);
+	}
+	
+	if (rec)
+		rec->read(lineStream);
+	return rec;
+}
+
+istream& RecordList::read(istream& is){
+	if (GFSBinary::readHeader(is))
+		return readBinary(is);
+	unsigned int frame=0;
+	while(is){
+		char buf[MAX_LINE_LENGHT];
+		is.getline(buf, MAX_LINE_LENGHT);
+		Record* rec=parseLine(buf, frame);
+		if (rec)
 			push_back(rec);
+	}
+	return is;
+}
+
+static OrientedPoint getPose(GFSBinary::RecordReader& r){
+	OrientedPoint p;
+	p.x=r.getFloat();
+	p.y=r.getFloat();
+	p.theta=r.getFloat();
+	return p;
+}
+
+/**decodes a binary record, 0 if it is not a record of the RecordList*/
+static Record* decodeBinary(GFSBinary::RecordReader& r, unsigned int& frame){
+	Record* rec=0;
+	switch (r.type()){
+	case GFSBinary::Text:
+		rec=parseLine(r.getText().c_str(), frame);
+		break;
+	case GFSBinary::Odometry:{
+		RawOdometryRecord* odometry=new RawOdometryRecord;
+		odometry->pose=getPose(r);
+		odometry->time=r.getDouble();
+		rec=odometry;
+		break;
+	}
+	case GFSBinary::OdometryUpdate:{
+		OdometryRecord* odometry=new OdometryRecord;
+		odometry->dim=r.getUInt32();
+		for (unsigned int i=0; i<odometry->dim && !r.failed(); i++){
+			odometry->poses.push_back(getPose(r));
+			r.getDouble();
+		}
+		odometry->time=r.getDouble();
+		rec=odometry;
+		break;
+	}
+	case GFSBinary::Frame:
+		frame=r.getUInt32();
+		break;
+	case GFSBinary::Laser:{
+		LaserRecord* laser=new LaserRecord;
+		laser->dim=r.getUInt32();
+		for (unsigned int i=0; i<laser->dim && !r.failed(); i++)
+			laser->readings.push_back(r.getFloat());
+		laser->pose=getPose(r);
+		laser->time=r.getDouble();
+		rec=laser;
+		break;
+	}
+	case GFSBinary::ScanMatchUpdate:{
+		ScanMatchRecord* scanmatch=new ScanMatchRecord;
+		scanmatch->dim=r.getUInt32();
+		for (unsigned int i=0; i<scanmatch->dim && !r.failed(); i++){
+			scanmatch->poses.push_back(getPose(r));
+			scanmatch->weights.push_back(r.getDouble());
+		}
+		rec=scanmatch;
+		break;
+	}
+	case GFSBinary::Neff:{
+		NeffRecord* neff=new NeffRecord;
+		neff->neff=r.getDouble();
+		neff->time=0;
+		neff->frame=frame;
+		rec=neff;
+		break;
+	}
+	case GFSBinary::Resample:{
+		ResampleRecord* resample=new ResampleRecord;
+		resample->dim=r.getUInt32();
+		for (unsigned int i=0; i<resample->dim && !r.failed(); i++)
+			resample->indexes.push_back(r.getUInt32());
+		rec=resample;
+		break;
+	}
+	case GFSBinary::SimulatorPose:{
+		PoseRecord* pose=new PoseRecord(true);
+		pose->pose=getPose(r);
+		pose->time=r.getDouble();
+		rec=pose;
+		break;
+	}
+	default:
+		break;
+	}
+	return rec;
+}
+
+istream& RecordList::readBinary(istream& is){
+	unsigned int frame=0;
+	GFSBinary::RecordReader r;
+	while(r.next(is)){
+		Record* rec=decodeBinary(r, frame);
+		if (rec && r.failed()){
+			cerr << "GFSReader: truncated binary record of type " << r.type() << endl;
+			delete rec;
+			break;
 		}
+		if (rec)
+			push_back(rec);
 	}
 	return is;
 }
@@ -501,6 +626,411 @@ void RecordList::printPath(ostream& os, unsigned int i, bool err, bool rawodom)
 		cout << "average error" << totalError/count << endl;
 }
 
+IndexedRecordList::IndexedRecordList():
+	m_data(0), m_length(0), m_binary(false), m_mapped(false){}
+
+IndexedRecordList::~IndexedRecordList(){
+	close();
+}
+
+void IndexedRecordList::close(){
+#ifndef _WIN32
+	if (m_mapped)
+		munmap((void*)m_data, m_length);
+#endif
+	m_data=0;
+	m_length=0;
+	m_mapped=false;
+	m_binary=false;
+	m_buffer.clear();
+	m_index.clear();
+}
+
+bool IndexedRecordList::open(const char* filename){
+	close();
+#ifndef _WIN32
+	int fd=::open(filename, O_RDONLY);
+	if (fd<0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st)<0){
+		::close(fd);
+		return false;
+	}
+	m_length=st.st_size;
+	if (m_length){
+		void* data=mmap(0, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data==MAP_FAILED){
+			::close(fd);
+			m_length=0;
+			return false;
+		}
+		m_data=(const char*)data;
+		m_mapped=true;
+	}
+	::close(fd);
+#else
+	ifstream is(filename, ios::binary);
+	if (!is)
+		return false;
+	m_buffer.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+	m_length=m_buffer.size();
+	m_data=m_length?&m_buffer[0]:0;
+#endif
+	return index();
+}
+
+static inline uint32_t getUInt32(const char* data){
+	const unsigned char* b=(const unsigned char*)data;
+	return b[0]|(b[1]<<8)|(b[2]<<16)|((uint32_t)b[3]<<24);
+}
+
+static inline float getFloat(const char* data){
+	uint32_t v=getUInt32(data);
+	float f;
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+static inline double getDouble(const char* data){
+	uint64_t v=getUInt32(data);
+	v|=(uint64_t)getUInt32(data+4)<<32;
+	double d;
+	memcpy(&d, &v, 8);
+	return d;
+}
+
+static inline bool isSpace(char c){
+	return c==' ' || c=='\t' || c=='\r';
+}
+
+/**moves p at the start of the next token in [p, end), @returns the end of the token*/
+static inline const char* nextToken(const char*& p, const char* end){
+	while (p<end && isSpace(*p))
+		p++;
+	const char* e=p;
+	while (e<end && !isSpace(*e))
+		e++;
+	return e;
+}
+
+static double parseDouble(const char*& p, const char* end){
+	const char* e=nextToken(p, end);
+	char buf[64];
+	size_t n=e-p<63?e-p:63;
+	memcpy(buf, p, n);
+	buf[n]=0;
+	p=e;
+	return strtod(buf, 0);
+}
+
+static unsigned long parseUInt(const char*& p, const char* end){
+	const char* e=nextToken(p, end);
+	char buf[32];
+	size_t n=e-p<31?e-p:31;
+	memcpy(buf, p, n);
+	buf[n]=0;
+	p=e;
+	return strtoul(buf, 0, 10);
+}
+
+/**@returns the type of the record on a text line, -1 if the line is not a record. FRAME lines update frame*/
+static int textRecordType(const char* p, const char* end, uint32_t& frame){
+	const char* e=nextToken(p, end);
+	string type(p, e);
+	if (type=="FRAME"){
+		frame=parseUInt(e, end);
+		return -1;
+	}
+	if (type=="LASER_READING")
+		return IndexedRecordList::Laser;
+	if (type=="ODO_UPDATE")
+		return IndexedRecordList::Odometry;
+	if (type=="ODOM")
+		return IndexedRecordList::RawOdometry;
+	if (type=="SM_UPDATE")
+		return IndexedRecordList::ScanMatch;
+	if (type=="SIMULATOR_POS")
+		return IndexedRecordList::Pose;
+	if (type=="RESAMPLE")
+		return IndexedRecordList::Resample;
+	if (type=="NEFF")
+		return IndexedRecordList::Neff;
+	if (type=="COMMENT" || type=="#COMMENT")
+		return IndexedRecordList::Comment;
+	if (type=="ENTROPY")
+		return IndexedRecordList::Entropy;
+	return -1;
+}
+
+bool IndexedRecordList::index(){
+	m_binary=m_length>=8 && !memcmp(m_data, "GFSB", 4);
+	return m_binary?indexBinary():indexText();
+}
+
+bool IndexedRecordList::indexText(){
+	uint32_t frame=0;
+	const char* end=m_data+m_length;
+	for (const char* line=m_data; line<end;){
+		const char* lineEnd=(const char*)memchr(line, '\n', end-line);
+		if (!lineEnd)
+			lineEnd=end;
+		int type=lineEnd-line<MAX_LINE_LENGHT?textRecordType(line, lineEnd, frame):-1;
+		if (type>=0){
+			Entry e;
+			e.offset=line-m_data;
+			e.size=lineEnd-line;
+			e.frame=frame;
+			e.type=type;
+			e.binaryType=0;
+			m_index.push_back(e);
+		}
+		line=lineEnd+1;
+	}
+	return true;
+}
+
+bool IndexedRecordList::indexBinary(){
+	uint32_t frame=0;
+	for (size_t position=8; position+5<=m_length;){
+		uint32_t size=getUInt32(m_data+position);
+		unsigned char binaryType=m_data[position+4];
+		position+=5;
+		if (size>GFSBinary::MaxRecordSize || size>m_length-position){
+			cerr << "GFSReader: truncated binary record of type " << (int)binaryType << endl;
+			break;
+		}
+		const char* payload=m_data+position;
+		int type=-1;
+		switch (binaryType){
+		case GFSBinary::Text: type=textRecordType(payload, payload+size, frame); break;
+		case GFSBinary::Odometry: type=RawOdometry; break;
+		case GFSBinary::OdometryUpdate: type=Odometry; break;
+		case GFSBinary::Frame: if (size>=4) frame=getUInt32(payload); break;
+		case GFSBinary::Laser: type=Laser; break;
+		case GFSBinary::ScanMatchUpdate: type=ScanMatch; break;
+		case GFSBinary::Neff: type=Neff; break;
+		case GFSBinary::Resample: type=Resample; break;
+		case GFSBinary::SimulatorPose: type=Pose; break;
+		default: break;
+		}
+		if (type>=0){
+			Entry e;
+			e.offset=position;
+			e.size=size;
+			e.frame=frame;
+			e.type=type;
+			e.binaryType=binaryType;
+			m_index.push_back(e);
+		}
+		position+=size;
+	}
+	return true;
+}
+
+Record* IndexedRecordList::record(size_t i) const{
+	const Entry& e=m_index[i];
+	unsigned int frame=e.frame;
+	if (!e.binaryType){
+		string line(m_data+e.offset, e.size);
+		return parseLine(line.c_str(), frame);
+	}
+	GFSBinary::RecordReader r;
+	r.assign(e.binaryType, m_data+e.offset, e.size);
+	Record* rec=decodeBinary(r, frame);
+	if (rec && r.failed()){
+		delete rec;
+		return 0;
+	}
+	return rec;
+}
+
+const char* IndexedRecordList::skipTokens(size_t i, unsigned int skip, const char*& end) const{
+	const Entry& e=m_index[i];
+	const char* p=m_data+e.offset;
+	end=p+e.size;
+	for (unsigned int k=0; k<skip && p<end; k++)
+		p=nextToken(p, end);
+	return p;
+}
+
+unsigned int IndexedRecordList::particles(size_t i) const{
+	const Entry& e=m_index[i];
+	if (e.type!=ScanMatch && e.type!=Odometry && e.type!=Resample)
+		return 0;
+	if (e.binaryType)
+		return e.size>=4?getUInt32(m_data+e.offset):0;
+	const char* end;
+	const char* p=skipTokens(i, 1, end);
+	return parseUInt(p, end);
+}
+
+bool IndexedRecordList::particle(size_t i, unsigned int particle, OrientedPoint& pose, double& weight) const{
+	const Entry& e=m_index[i];
+	if ((e.type!=ScanMatch && e.type!=Odometry) || particle>=particles(i))
+		return false;
+	if (e.binaryType){
+		size_t offset=4+20*(size_t)particle;
+		if (offset+20>e.size)
+			return false;
+		const char* p=m_data+e.offset+offset;
+		pose.x=getFloat(p);
+		pose.y=getFloat(p+4);
+		pose.theta=getFloat(p+8);
+		weight=getDouble(p+12);
+		return true;
+	}
+	const char* end;
+	const char* p=skipTokens(i, 2+4*particle, end);
+	pose.x=parseDouble(p, end);
+	pose.y=parseDouble(p, end);
+	pose.theta=parseDouble(p, end);
+	weight=parseDouble(p, end);
+	return true;
+}
+
+unsigned int IndexedRecordList::resampleIndex(size_t i, unsigned int particle) const{
+	const Entry& e=m_index[i];
+	if (e.binaryType){
+		size_t offset=4+4*(size_t)particle;
+		return offset+4<=e.size?getUInt32(m_data+e.offset+offset):0;
+	}
+	const char* end;
+	const char* p=skipTokens(i, 2+particle, end);
+	return parseUInt(p, end);
+}
+
+void IndexedRecordList::weights(size_t i, std::vector<double>& w) const{
+	const Entry& e=m_index[i];
+	unsigned int n=particles(i);
+	w.resize(n);
+	if (e.binaryType){
+		n=std::min<size_t>(n, e.size>=4?(e.size-4)/20:0);
+		for (unsigned int k=0; k<n; k++)
+			w[k]=getDouble(m_data+e.offset+4+20*(size_t)k+12);
+		return;
+	}
+	const char* end;
+	const char* p=skipTokens(i, 2, end);
+	for (unsigned int k=0; k<n; k++){
+		for (unsigned int j=0; j<3; j++)
+			p=nextToken(p, end);
+		w[k]=parseDouble(p, end);
+	}
+}
+
+void IndexedRecordList::resampleIndexes(size_t i, std::vector<unsigned int>& indexes) const{
+	const Entry& e=m_index[i];
+	unsigned int n=particles(i);
+	indexes.resize(n);
+	if (e.binaryType){
+		n=std::min<size_t>(n, e.size>=4?(e.size-4)/4:0);
+		for (unsigned int k=0; k<n; k++)
+			indexes[k]=getUInt32(m_data+e.offset+4+4*(size_t)k);
+		return;
+	}
+	const char* end;
+	const char* p=skipTokens(i, 2, end);
+	for (unsigned int k=0; k<n; k++)
+		indexes[k]=parseUInt(p, end);
+}
+
+double IndexedRecordList::getLogWeight(unsigned int particle, size_t end) const{
+	double weight=0;
+	unsigned int currentIndex=particle;
+	for (size_t i=end; i>0; i--){
+		unsigned char type=m_index[i-1].type;
+		if (type==ScanMatch){
+			OrientedPoint pose;
+			double w;
+			if (this->particle(i-1, currentIndex, pose, w))
+				weight+=w;
+		}
+		if (type==Resample)
+			currentIndex=resampleIndex(i-1, currentIndex);
+	}
+	return weight;
+}
+
+std::vector<double> IndexedRecordList::getLogWeights(size_t end) const{
+	std::vector<double> weight;
+	std::vector<unsigned int> currentIndex;
+	std::vector<double> w;
+	std::vector<unsigned int> indexes;
+	//the particles are those of the last scan match or resample, as in getLogWeight the
+	//resamples after the last scan match are applied to them too
+	size_t last=end;
+	while (last>0 && m_index[last-1].type!=ScanMatch && m_index[last-1].type!=Resample)
+		last--;
+	if (!last)
+		return weight;
+	weight.assign(particles(last-1), 0.);
+	currentIndex.resize(weight.size());
+	for (unsigned int p=0; p<currentIndex.size(); p++)
+		currentIndex[p]=p;
+	for (size_t i=last; i>0; i--){
+		unsigned char type=m_index[i-1].type;
+		if (type==ScanMatch){
+			this->weights(i-1, w);
+			for (unsigned int p=0; p<currentIndex.size(); p++)
+				if (currentIndex[p]<w.size())
+					weight[p]+=w[currentIndex[p]];
+		}
+		if (type==Resample){
+			resampleIndexes(i-1, indexes);
+			for (unsigned int p=0; p<currentIndex.size(); p++)
+				currentIndex[p]=currentIndex[p]<indexes.size()?indexes[currentIndex[p]]:0;
+		}
+	}
+	return weight;
+}
+
+unsigned int IndexedRecordList::getBestIdx() const{
+	std::vector<double> weight=getLogWeights(size());
+	unsigned int best=0;
+	for (unsigned int p=1; p<weight.size(); p++)
+		if (weight[p]>weight[best])
+			best=p;
+	return best;
+}
+
+RecordList IndexedRecordList::computePath(unsigned int particle, size_t end) const{
+	std::vector<PathStep> path;
+	computePath(particle, end, path);
+	RecordList rl;
+	for (std::vector<PathStep>::const_iterator it=path.begin(); it!=path.end(); it++){
+		LaserRecord* laser=dynamic_cast<LaserRecord*>(record(it->laser));
+		if (laser){
+			laser->pose=it->pose;
+			rl.push_back(laser);
+		}
+	}
+	return rl;
+}
+
+void IndexedRecordList::computePath(unsigned int particle, size_t end, std::vector<PathStep>& path) const{
+	unsigned int currentIndex=particle;
+	PathStep step;
+	step.pose=OrientedPoint(0,0,0);
+	path.clear();
+	bool first=true;
+	for (size_t i=end; i>0; i--){
+		unsigned char type=m_index[i-1].type;
+		if (type==ScanMatch){
+			double w;
+			this->particle(i-1, currentIndex, step.pose, w);
+			first=false;
+		}
+		if (type==Laser && !first){
+			step.laser=i-1;
+			path.push_back(step);
+		}
+		if (type==Resample)
+			currentIndex=resampleIndex(i-1, currentIndex);
+	}
+	std::reverse(path.begin(), path.end());
+}
+
 }; //gfsreader
 
 }; //GMapping;
@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <gmapping/gridfastslam/gfsreader.h>
+
+/*Checks that IndexedRecordList computes the same weights, best particle and
+trajectories as RecordList, also at each scan match as gfs2img selects the path of
+its frames, on the gfs files given on the command line or, without arguments, on
+small logs exercising the resamples. @returns 0 if they agree.*/
+
+using namespace std;
+using namespace GMapping;
+using namespace GMapping::GFSReader;
+
+static const char* logs[]={
+	//ends with a resample: the particles of the weights are those after it
+	"FRAME 0\n"
+	"LASER_READING 3 1 1 1 0 0 0 0\n"
+	"SM_UPDATE 2 0 0 0 1 1 1 0 5\n"
+	"NEFF 1.5\n"
+	"RESAMPLE 2 0 0\n",
+	//resamples between the scan matches and at the end
+	"FRAME 0\n"
+	"LASER_READING 3 1 1 1 0 0 0 0\n"
+	"SM_UPDATE 3 0 0 0 1 1 1 0 5 2 2 0 3\n"
+	"RESAMPLE 3 1 1 2\n"
+	"FRAME 1\n"
+	"LASER_READING 3 1 1 1 0 0 0 1\n"
+	"SM_UPDATE 3 0 0 0 4 1 1 0 -2 2 2 0 1\n"
+	"RESAMPLE 3 2 0 0\n"
+	"FRAME 2\n"
+	"LASER_READING 3 1 1 1 0 0 0 2\n"
+	"SM_UPDATE 3 0 0 0 -1 1 1 0 0 2 2 0 2\n"
+	"RESAMPLE 3 1 2 2\n",
+	//ends with a scan match
+	"FRAME 0\n"
+	"LASER_READING 3 1 1 1 0 0 0 0\n"
+	"SM_UPDATE 2 0 0 0 1 1 1 0 5\n"
+	"RESAMPLE 2 1 1\n"
+	"FRAME 1\n"
+	"LASER_READING 3 1 1 1 0 0 0 1\n"
+	"SM_UPDATE 2 0 0 0 2 1 1 0 1\n"
+};
+
+/**@returns the number of differences between the two readers on the file*/
+int check(const char* filename){
+	ifstream is(filename);
+	RecordList rl;
+	rl.read(is);
+	IndexedRecordList irl;
+	if (!irl.open(filename)){
+		cerr << "could not read " << filename << endl;
+		return 1;
+	}
+	int errors=0;
+	unsigned int best=rl.getBestIdx();
+	if (best!=irl.getBestIdx()){
+		cerr << filename << ": best particle " << irl.getBestIdx() << " instead of " << best << endl;
+		errors++;
+	}
+	std::vector<double> weights=irl.getLogWeights(irl.size());
+	if (weights.size()!=(unsigned int)rl.sampleSize){
+		cerr << filename << ": " << weights.size() << " weights instead of " << rl.sampleSize << endl;
+		errors++;
+	}
+	for (unsigned int i=0; i<weights.size() && i<(unsigned int)rl.sampleSize; i++){
+		double w=rl.getLogWeight(i);
+		if (fabs(weights[i]-w)>1e-9*(1+fabs(w)) || fabs(irl.getLogWeight(i)-w)>1e-9*(1+fabs(w))){
+			cerr << filename << ": particle " << i << " weight " << weights[i] << " (" << irl.getLogWeight(i) << ") instead of " << w << endl;
+			errors++;
+		}
+	}
+
+	//the frames of gfs2img: at each scan match, the best particle over the records before it and its path
+	std::vector<IndexedRecordList::PathStep> path;
+	RecordList::const_iterator it=rl.begin();
+	for (size_t i=0; i<irl.size() && it!=rl.end(); i++, it++){
+		const ScanMatchRecord* scanmatch=dynamic_cast<const ScanMatchRecord*>(*it);
+		if (irl.type(i)!=IndexedRecordList::ScanMatch || !scanmatch)
+			continue;
+		std::vector<double> w=irl.getLogWeights(i);
+		if (w.empty())
+			continue;
+		unsigned int indexedBest=0, best=0;
+		for (unsigned int p=1; p<w.size(); p++)
+			if (w[p]>w[indexedBest])
+				indexedBest=p;
+		for (unsigned int p=1; p<scanmatch->dim; p++)
+			if (rl.getLogWeight(p, it)>rl.getLogWeight(best, it))
+				best=p;
+		if (best!=indexedBest){
+			cerr << filename << ": record " << i << " best particle " << indexedBest << " instead of " << best << endl;
+			errors++;
+			continue;
+		}
+		irl.computePath(best, i, path);
+		RecordList expected=rl.computePath(best, it);
+		bool same=expected.size()==path.size();
+		unsigned int k=0;
+		for (RecordList::const_iterator e=expected.begin(); same && e!=expected.end(); e++, k++){
+			const LaserRecord* laser=dynamic_cast<const LaserRecord*>(*e);
+			same=laser && laser->pose.x==path[k].pose.x && laser->pose.y==path[k].pose.y && laser->pose.theta==path[k].pose.theta;
+		}
+		if (!same){
+			cerr << filename << ": record " << i << " path of particle " << best << " differs" << endl;
+			errors++;
+		}
+		expected.destroyReferences();
+	}
+	rl.destroyReferences();
+	return errors;
+}
+
+int main(int argc, char** argv){
+	int errors=0;
+	if (argc>1){
+		for (int i=1; i<argc; i++)
+			errors+=check(argv[i]);
+	} else {
+		const char* filename="gfsreader_test.gfs";
+		for (unsigned int i=0; i<sizeof(logs)/sizeof(logs[0]); i++){
+			{
+				ofstream os(filename);
+				os << logs[i];
+			}
+			errors+=check(filename);
+		}
+		remove(filename);
+	}
+	cerr << (errors?"FAILED":"OK") << endl;
+	return errors?1:0;
+}
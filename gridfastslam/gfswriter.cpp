@@ -0,0 +1,288 @@
+#include <iomanip>
+#include "gmapping/gridfastslam/gfswriter.h"
+
+namespace GMapping {
+
+using namespace std;
+
+GFSWriter::GFSWriter():
+	m_asynchronous(false), m_queueSize(1024), m_lastStream(0),
+	m_writing(false), m_stop(false), m_maxQueueDepth(0),
+	m_written(0), m_sampled(0), m_dropped(0){
+	for (unsigned int i=0; i<=GFSBinary::SimulatorPose; i++){
+		m_period[i]=1;
+		m_count[i]=0;
+	}
+}
+
+GFSWriter::~GFSWriter(){
+	stop();
+}
+
+void GFSWriter::setAsynchronous(bool asynchronous){
+	if (!asynchronous)
+		stop();
+	m_asynchronous=asynchronous;
+}
+
+void GFSWriter::setQueueSize(unsigned int size){
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_queueSize=size?size:1;
+	m_notFull.notify_all();
+}
+
+void GFSWriter::setPeriod(GFSBinary::RecordType type, unsigned int period){
+	if (type>=GFSBinary::Text && type<=GFSBinary::SimulatorPose){
+		m_period[type]=period;
+		m_count[type]=0;
+	}
+}
+
+unsigned int GFSWriter::getPeriod(GFSBinary::RecordType type) const{
+	if (type>=GFSBinary::Text && type<=GFSBinary::SimulatorPose)
+		return m_period[type];
+	return 1;
+}
+
+bool GFSWriter::accept(GFSBinary::RecordType type){
+	unsigned int period=m_period[type];
+	if (period==1)
+		return true;
+	if (period && !(m_count[type]++%period))
+		return true;
+	m_sampled++;
+	return false;
+}
+
+bool GFSWriter::droppable(GFSBinary::RecordType type){
+	return type==GFSBinary::Odometry || type==GFSBinary::OdometryUpdate || type==GFSBinary::SimulatorPose;
+}
+
+void GFSWriter::write(std::ostream& os, bool binary, GFSOutputRecord& record){
+	if (!m_asynchronous){
+		encode(os, binary, record, m_recordWriter);
+		m_lastStream=&os;
+		m_written++;
+		return;
+	}
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_thread.joinable()){
+		m_stop=false;
+		m_thread=std::thread(&GFSWriter::run, this);
+	}
+	if (m_queue.size()>=m_queueSize){
+		if (droppable(record.type)){
+			m_dropped++;
+			return;
+		}
+		m_notFull.wait(lock, [this]{return m_queue.size()<m_queueSize;});
+	}
+	m_queue.push_back(Entry());
+	Entry& entry=m_queue.back();
+	entry.stream=&os;
+	entry.binary=binary;
+	std::swap(entry.record, record);
+	if (m_queue.size()>m_maxQueueDepth)
+		m_maxQueueDepth=m_queue.size();
+	m_notEmpty.notify_one();
+}
+
+void GFSWriter::run(){
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true){
+		m_notEmpty.wait(lock, [this]{return m_stop || !m_queue.empty();});
+		if (m_queue.empty())
+			return;
+		Entry entry;
+		std::swap(entry, m_queue.front());
+		m_queue.pop_front();
+		m_writing=true;
+		m_notFull.notify_all();
+		lock.unlock();
+		encode(*entry.stream, entry.binary, entry.record, m_recordWriter);
+		m_written++;
+		//the stream is flushed each time the writer catches up with the filter
+		if (m_lastStream && m_lastStream!=entry.stream)
+			m_lastStream->flush();
+		m_lastStream=entry.stream;
+		lock.lock();
+		if (m_queue.empty()){
+			lock.unlock();
+			m_lastStream->flush();
+			lock.lock();
+			if (m_queue.empty()){
+				m_writing=false;
+				m_notFull.notify_all();
+			}
+		}
+	}
+}
+
+void GFSWriter::stop(){
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_thread.joinable())
+			return;
+		m_stop=true;
+		m_notEmpty.notify_one();
+	}
+	m_thread.join();
+	m_thread=std::thread();
+}
+
+void GFSWriter::flush(){
+	if (m_asynchronous){
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]{return m_queue.empty() && !m_writing;});
+	}
+	if (m_lastStream)
+		m_lastStream->flush();
+}
+
+void GFSWriter::reset(bool append){
+	flush();
+	m_recordWriter.reset(append);
+	m_lastStream=0;
+}
+
+unsigned int GFSWriter::queueDepth() const{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queue.size();
+}
+
+GFSWriter::Statistics GFSWriter::getStatistics() const{
+	Statistics s;
+	s.written=m_written;
+	s.sampled=m_sampled;
+	s.dropped=m_dropped;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	s.queueDepth=m_queue.size();
+	s.maxQueueDepth=m_maxQueueDepth;
+	return s;
+}
+
+static void putPose(GFSBinary::RecordWriter& writer, const OrientedPoint& pose){
+	writer.putFloat(pose.x);
+	writer.putFloat(pose.y);
+	writer.putFloat(pose.theta);
+}
+
+static void putParticles(GFSBinary::RecordWriter& writer, const GFSOutputRecord& record){
+	writer.putUInt32(record.poses.size());
+	for (unsigned int i=0; i<record.poses.size(); i++){
+		putPose(writer, record.poses[i]);
+		writer.putDouble(record.weights[i]);
+	}
+}
+
+static void encodeBinary(std::ostream& os, const GFSOutputRecord& record, GFSBinary::RecordWriter& writer){
+	writer.begin(record.type);
+	switch (record.type){
+	case GFSBinary::Text:
+		writer.putBytes(record.text.data(), record.text.size());
+		break;
+	case GFSBinary::Odometry:
+	case GFSBinary::SimulatorPose:
+		putPose(writer, record.pose);
+		writer.putDouble(record.time);
+		break;
+	case GFSBinary::OdometryUpdate:
+		putParticles(writer, record);
+		writer.putDouble(record.time);
+		break;
+	case GFSBinary::Frame:
+		writer.putUInt32(record.frame);
+		writer.putDouble(record.linearDistance);
+		writer.putDouble(record.angularDistance);
+		break;
+	case GFSBinary::Laser:
+		writer.putUInt32(record.ranges.size());
+		for (std::vector<double>::const_iterator b=record.ranges.begin(); b!=record.ranges.end(); b++)
+			writer.putFloat(*b);
+		putPose(writer, record.pose);
+		writer.putDouble(record.time);
+		break;
+	case GFSBinary::ScanMatchUpdate:
+		putParticles(writer, record);
+		break;
+	case GFSBinary::Neff:
+		writer.putDouble(record.neff);
+		break;
+	case GFSBinary::Resample:
+		writer.putUInt32(record.indexes.size());
+		for (std::vector<unsigned int>::const_iterator it=record.indexes.begin(); it!=record.indexes.end(); it++)
+			writer.putUInt32(*it);
+		break;
+	}
+	writer.write(os);
+}
+
+static void encodeParticles(std::ostream& os, const GFSOutputRecord& record){
+	for (unsigned int i=0; i<record.poses.size(); i++){
+		const OrientedPoint& pose=record.poses[i];
+		os << setiosflags(ios::fixed) << setprecision(3) << pose.x << " " << pose.y << " ";
+		os << setiosflags(ios::fixed) << setprecision(6) << pose.theta << " " << record.weights[i] << " ";
+	}
+}
+
+void GFSWriter::encode(std::ostream& os, bool binary, const GFSOutputRecord& record, GFSBinary::RecordWriter& writer){
+	if (binary){
+		encodeBinary(os, record, writer);
+		return;
+	}
+	//the lines are not flushed one by one, the stream is flushed once per scan
+	switch (record.type){
+	case GFSBinary::Text:
+		os << record.text << '\n';
+		break;
+	case GFSBinary::Odometry:
+		os << setiosflags(ios::fixed) << setprecision(6);
+		os << "ODOM ";
+		os << setiosflags(ios::fixed) << setprecision(3) << record.pose.x << " " << record.pose.y << " ";
+		os << setiosflags(ios::fixed) << setprecision(6) << record.pose.theta << " ";
+		os << record.time << '\n';
+		break;
+	case GFSBinary::OdometryUpdate:
+		os << setiosflags(ios::fixed) << setprecision(6);
+		os << "ODO_UPDATE "<< record.poses.size() << " ";
+		encodeParticles(os, record);
+		os << record.time << '\n';
+		break;
+	case GFSBinary::Frame:
+		os << setiosflags(ios::fixed) << setprecision(6);
+		os << "FRAME " << record.frame;
+		os << " " << record.linearDistance;
+		os << " " << record.angularDistance << '\n';
+		break;
+	case GFSBinary::Laser:
+		os << "LASER_READING "<< record.ranges.size() << " ";
+		os << setiosflags(ios::fixed) << setprecision(2);
+		for (std::vector<double>::const_iterator b=record.ranges.begin(); b!=record.ranges.end(); b++)
+			os << *b << " ";
+		os << setiosflags(ios::fixed) << setprecision(6);
+		os << record.pose.x << " " << record.pose.y << " " << record.pose.theta << " " << record.time << '\n';
+		break;
+	case GFSBinary::ScanMatchUpdate:
+		os << "SM_UPDATE "<< record.poses.size() << " ";
+		encodeParticles(os, record);
+		os << '\n';
+		break;
+	case GFSBinary::Neff:
+		os << setiosflags(ios::fixed) << setprecision(6);
+		os << "NEFF " << record.neff << '\n';
+		break;
+	case GFSBinary::Resample:
+		os << "RESAMPLE "<< record.indexes.size() << " ";
+		for (std::vector<unsigned int>::const_iterator it=record.indexes.begin(); it!=record.indexes.end(); it++)
+			os << *it << " ";
+		os << '\n';
+		break;
+	case GFSBinary::SimulatorPose:
+		os << setiosflags(ios::fixed) << setprecision(3);
+		os << "SIMULATOR_POS " << record.pose.x << " " << record.pose.y << " ";
+		os << setiosflags(ios::fixed) << setprecision(6) << record.pose.theta << " " << record.time << '\n';
+		break;
+	}
+}
+
+};
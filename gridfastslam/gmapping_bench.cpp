@@ -0,0 +1,256 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <gmapping/utils/commandline.h>
+#include <gmapping/log/simulator.h>
+#include <gmapping/scanmatcher/scanmatcher.h>
+#include <gmapping/scanmatcher/gridlinetraversal.h>
+#include <gmapping/gridfastslam/gridslamprocessor.h>
+
+/*Microbenchmarks of the kernels of the filter, on a synthetic map built
+from the room of SimulatedWorld, so that they run without any log and give the same
+workload from one release to the other.*/
+
+using namespace std;
+using namespace GMapping;
+
+//bytes allocated through operator new, to report the allocations of the kernels
+static std::atomic<unsigned long> allocatedBytes(0);
+
+//the replacements are not inlined in the callers, where GCC would see a free() of the
+//result of operator new and warn about the mismatch
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t size){
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	void* p=malloc(size?size:1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept{
+	free(p);
+}
+
+BENCH_NOINLINE void* operator new[](size_t size){
+	return operator new(size);
+}
+
+BENCH_NOINLINE void operator delete[](void* p) noexcept{
+	free(p);
+}
+
+/**time and allocations of the runs of a kernel*/
+struct KernelStats{
+	std::vector<double> times;
+	unsigned long bytes;
+	unsigned long runs;
+};
+
+/**runs setup (not timed) and kernel (timed) samples times*/
+KernelStats measure(unsigned int samples, const std::function<void(unsigned int)>& setup, const std::function<void(unsigned int)>& kernel){
+	KernelStats stats;
+	stats.bytes=0;
+	stats.runs=samples;
+	for (unsigned int i=0; i<samples; i++){
+		setup(i);
+		unsigned long bytes=allocatedBytes.load(std::memory_order_relaxed);
+		std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+		kernel(i);
+		std::chrono::steady_clock::time_point end=std::chrono::steady_clock::now();
+		stats.bytes+=allocatedBytes.load(std::memory_order_relaxed)-bytes;
+		stats.times.push_back(std::chrono::duration<double, std::nano>(end-start).count());
+	}
+	return stats;
+}
+
+void report(const char* name, KernelStats stats, unsigned int beams){
+	std::sort(stats.times.begin(), stats.times.end());
+	double median=stats.times[stats.times.size()/2];
+	double p95=stats.times[(stats.times.size()*95)/100<stats.times.size()?(stats.times.size()*95)/100:stats.times.size()-1];
+	cout << setw(20) << left << name << right
+		<< setw(8) << stats.runs
+		<< setw(14) << fixed << setprecision(2) << median/1000.
+		<< setw(14) << p95/1000.;
+	if (beams)
+		cout << setw(12) << setprecision(1) << median/beams;
+	else
+		cout << setw(12) << "-";
+	cout << setw(14) << stats.bytes/stats.runs << endl;
+}
+
+void noSetup(unsigned int){}
+
+/**measures and reports the kernel, unless another one was selected*/
+void bench(const string& only, unsigned int samples, const char* name, unsigned int beams,
+	const std::function<void(unsigned int)>& setup, const std::function<void(unsigned int)>& kernel){
+	if (only.empty() || only==name)
+		report(name, measure(samples, setup, kernel), beams);
+}
+
+int main(int argc, const char * const * argv){
+	int samples=200;
+	int beams=361;
+	int scans=50;
+	int particles=30;
+	double delta=0.05;
+	double maxrange=30;
+	double maxUrange=25;
+	bool likelihoodField=false;
+	string only;
+
+	CMD_PARSE_BEGIN(1,argc);
+		parseInt("-samples", samples);
+		parseInt("-beams", beams);
+		parseInt("-scans", scans);
+		parseInt("-particles", particles);
+		parseDouble("-delta", delta);
+		parseDouble("-maxrange", maxrange);
+		parseDouble("-maxUrange", maxUrange);
+		parseFlag("-likelihoodField", likelihoodField);
+		parseString("-kernel", only);
+	CMD_PARSE_END;
+	if (samples<1 || beams<2 || beams>=LASER_MAXBEAMS || scans<1 || particles<1){
+		cerr << "usage: gmapping_bench [-samples n] [-beams n] [-scans n] [-particles n] [-delta res]" << endl;
+		cerr << "                      [-maxrange m] [-maxUrange m] [-likelihoodField] [-kernel name]" << endl;
+		return -1;
+	}
+
+	//the sensor and the trajectory, a loop around the room
+	SimulatedWorld world=SimulatedWorld::room();
+	std::vector<double> angles(beams);
+	for (int i=0; i<beams; i++)
+		angles[i]=-M_PI/2+M_PI*i/(beams-1);
+	std::vector<OrientedPoint> poses;
+	std::vector< std::vector<double> > readings;
+	for (int i=0; i<scans; i++){
+		double a=2*M_PI*i/scans;
+		OrientedPoint pose(10+6.5*cos(a), 6+4*sin(a), a+M_PI/2);
+		std::vector<double> reading(beams);
+		for (int j=0; j<beams; j++)
+			reading[j]=world.cast(pose, pose.theta+angles[j], maxrange);
+		poses.push_back(pose);
+		readings.push_back(reading);
+	}
+
+	ScanMatcher matcher;
+	matcher.setLaserParameters(beams, &angles[0], OrientedPoint(0,0,0));
+	matcher.setMatchingParameters(maxUrange, maxrange, 0.05, 1, 0.05, 0.05, 5, 0.075, 0);
+	matcher.setgenerateMap(true);
+	matcher.setuseLikelihoodField(likelihoodField);
+
+	ScanMatcherMap map(Point(10,6), -2., -2., 22., 14., delta);
+	for (int i=0; i<scans; i++){
+		matcher.invalidateActiveArea();
+		matcher.computeActiveArea(map, poses[i], &readings[i][0]);
+		matcher.registerScan(map, poses[i], &readings[i][0]);
+	}
+
+	//the poses evaluated by the matcher are slightly off the true ones
+	std::vector<OrientedPoint> guesses;
+	for (int i=0; i<samples; i++){
+		OrientedPoint g=poses[i%scans];
+		g.x+=0.03*sin(1.7*i);
+		g.y+=0.03*cos(2.3*i);
+		g.theta+=0.02*sin(0.7*i);
+		guesses.push_back(g);
+	}
+
+	cout << setw(20) << left << "kernel" << right << setw(8) << "runs" << setw(14) << "median[us]"
+		<< setw(14) << "p95[us]" << setw(12) << "ns/beam" << setw(14) << "bytes/run" << endl;
+
+	double sink=0;
+	bench(only, samples, "score", beams, noSetup, [&](unsigned int i){
+		sink+=matcher.score(map, guesses[i], &readings[i%scans][0]);
+	});
+	bench(only, samples, "likelihoodAndScore", beams, noSetup, [&](unsigned int i){
+		double s, l;
+		matcher.likelihoodAndScore(s, l, map, guesses[i], &readings[i%scans][0]);
+		sink+=s+l;
+	});
+	bench(only, samples, "optimize", beams, noSetup, [&](unsigned int i){
+		OrientedPoint pnew;
+		sink+=matcher.optimize(pnew, map, guesses[i], &readings[i%scans][0]);
+	});
+	bench(only, samples, "optimizeCovariance", beams, noSetup, [&](unsigned int i){
+		OrientedPoint mean;
+		ScanMatcher::CovarianceMatrix cov;
+		sink+=matcher.optimize(mean, cov, map, guesses[i], &readings[i%scans][0]);
+	});
+	bench(only, samples, "computeActiveArea", beams, [&](unsigned int){
+		matcher.invalidateActiveArea();
+	}, [&](unsigned int i){
+		matcher.computeActiveArea(map, poses[i%scans], &readings[i%scans][0]);
+	});
+
+	//the registration works on a copy of the map, sharing the patches as the particles do
+	ScanMatcherMap copy(map);
+	bench(only, samples, "registerScan", beams, [&](unsigned int i){
+		copy=map;
+		matcher.invalidateActiveArea();
+		matcher.computeActiveArea(copy, poses[i%scans], &readings[i%scans][0]);
+	}, [&](unsigned int i){
+		sink+=matcher.registerScan(copy, poses[i%scans], &readings[i%scans][0]);
+	});
+	bench(only, samples, "allocActiveArea", 0, [&](unsigned int i){
+		copy=map;
+		matcher.invalidateActiveArea();
+		matcher.computeActiveArea(copy, poses[i%scans], &readings[i%scans][0]);
+	}, [&](unsigned int){
+		copy.storage().allocActiveArea();
+	});
+
+	IntPoint* linePoints=new IntPoint[20000];
+	bench(only, samples, "gridLine", beams, noSetup, [&](unsigned int i){
+		OrientedPoint p=poses[i%scans];
+		IntPoint p0=map.world2map(p);
+		GridLineTraversalLine line;
+		line.points=linePoints;
+		for (int j=0; j<beams; j++){
+			double r=readings[i%scans][j];
+			IntPoint p1=map.world2map(p+Point(r*cos(p.theta+angles[j]), r*sin(p.theta+angles[j])));
+			GridLineTraversal::gridLine(p0, p1, &line);
+			sink+=line.num_points;
+		}
+	});
+	delete [] linePoints;
+
+	//the copies made by the resampling: half of the particles survive twice
+	GridSlamProcessor::ParticleVector population(particles, GridSlamProcessor::Particle(map));
+	GridSlamProcessor::ParticleVector source;
+	std::vector<unsigned int> indexes;
+	for (int i=0; i<particles; i++)
+		indexes.push_back((i/2)*2);
+	GridSlamProcessor::ParticleVector temp;
+	bench(only, samples, "resample", 0, [&](unsigned int){
+		source=population;
+		GridSlamProcessor::ParticleVector().swap(temp);
+	}, [&](unsigned int){
+		temp.reserve(indexes.size());
+		for (unsigned int i=0; i<indexes.size(); i++){
+			if (i+1<indexes.size() && indexes[i+1]==indexes[i])
+				temp.push_back(source[indexes[i]]);
+			else
+				temp.push_back(std::move(source[indexes[i]]));
+		}
+		source.swap(temp);
+	});
+
+	//keeps the optimizer from dropping the kernels
+	if (sink==12345.)
+		cout << sink << endl;
+	return 0;
+}
@@ -0,0 +1,201 @@
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <gmapping/utils/commandline.h>
+#include <gmapping/utils/stat.h>
+#include <gmapping/log/simulator.h>
+#include <gmapping/gridfastslam/gridslamprocessor.h>
+
+/*End to end benchmark of the filter: a simulated robot travels through a
+synthetic world, and the filter is run on its readings for every combination
+of particles and map resolution given on the command line. It reports the
+throughput, the time spent in the scan matching (summed over the matching
+threads), the peak memory and the error
+of the best particle against the ground truth. When the library is built with
+GMAPPING_PROFILE the time of each stage of the update is reported as well.*/
+
+using namespace std;
+using namespace GMapping;
+
+/**parses a comma separated list of numbers*/
+template <class T>
+std::vector<T> parseList(const string& s){
+	std::vector<T> v;
+	istringstream is(s);
+	string item;
+	while (getline(is, item, ','))
+		if (!item.empty())
+			v.push_back((T)atof(item.c_str()));
+	return v;
+}
+
+/**@returns the peak resident set size of the process in KB, 0 if unknown.
+   It is the peak of the whole process, so it never decreases from one run to the next.*/
+long peakRSS(){
+#ifndef _WIN32
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, &usage))
+		return usage.ru_maxrss;
+#endif
+	return 0;
+}
+
+int main(int argc, const char * const * argv){
+	string worldName="loop";
+	string particleList="30";
+	string deltaList="0.05";
+	string logFile;
+	int scans=1500;
+	int beams=181;
+	int threads=1;
+	int seed=1;
+	double maxrange=30;
+	double maxUrange=25;
+	double rangeSigma=-1, linearDrift=-1, angularDrift=-1, angularBias=-1;
+	bool lazy=false;
+	bool multiResolution=false;
+
+	CMD_PARSE_BEGIN(1,argc);
+		parseString("-world", worldName);
+		parseString("-particles", particleList);
+		parseString("-delta", deltaList);
+		parseString("-log", logFile);
+		parseInt("-scans", scans);
+		parseInt("-beams", beams);
+		parseInt("-threads", threads);
+		parseInt("-seed", seed);
+		parseDouble("-maxrange", maxrange);
+		parseDouble("-maxUrange", maxUrange);
+		parseDouble("-rangeSigma", rangeSigma);
+		parseDouble("-linearDrift", linearDrift);
+		parseDouble("-angularDrift", angularDrift);
+		parseDouble("-angularBias", angularBias);
+		parseFlag("-lazyRegistration", lazy);
+		parseFlag("-multiResolution", multiResolution);
+	CMD_PARSE_END;
+
+	SimulatedWorld world;
+	std::vector<int> particles=parseList<int>(particleList);
+	std::vector<double> deltas=parseList<double>(deltaList);
+	if (!SimulatedWorld::byName(world, worldName) || particles.empty() || deltas.empty()
+		|| scans<1 || beams<2 || beams>=LASER_MAXBEAMS){
+		cerr << "usage: gmapping_slambench [-world room|loop|corridors|hall] [-particles n,n,...] [-delta res,res,...]" << endl;
+		cerr << "                          [-scans n] [-beams n] [-threads n] [-seed n] [-maxrange m] [-maxUrange m]" << endl;
+		cerr << "                          [-rangeSigma s] [-linearDrift s] [-angularDrift s] [-angularBias b]" << endl;
+		cerr << "                          [-lazyRegistration] [-multiResolution] [-log carmenfile]" << endl;
+		return -1;
+	}
+
+	Simulator::Parameters parameters;
+	parameters.beams=beams;
+	parameters.resolution=M_PI/(beams-1);
+	parameters.maxRange=maxrange;
+	parameters.seed=seed;
+	if (rangeSigma>=0) parameters.rangeSigma=rangeSigma;
+	if (linearDrift>=0) parameters.linearDrift=linearDrift;
+	if (angularDrift>=0) parameters.angularDrift=angularDrift;
+	if (angularBias>=0) parameters.angularBias=angularBias;
+
+	//only writes the log of the simulation
+	if (!logFile.empty()){
+		ofstream os(logFile.c_str());
+		if (!os){
+			cerr << "unable to open " << logFile << endl;
+			return -1;
+		}
+		Simulator simulator(world, parameters);
+		simulator.writeCarmen(os, scans);
+		cerr << "wrote " << scans << " scans of the " << worldName << " world in " << logFile << endl;
+		return 0;
+	}
+
+	double xmin, ymin, xmax, ymax;
+	world.boundingBox(xmin, ymin, xmax, ymax);
+
+	cout << "world " << worldName << ", " << scans << " scans of " << beams << " beams" << endl;
+	cout << setw(10) << "particles" << setw(8) << "delta" << setw(10) << "updates"
+		<< setw(10) << "scans/s" << setw(12) << "update[ms]" << setw(14) << "matchCpu[ms]" << setw(12) << "evals/match"
+		<< setw(12) << "rss[KB]" << setw(12) << "rmsErr[m]" << setw(12) << "endErr[m]" << setw(12) << "endErr[rad]" << endl;
+	for (unsigned int d=0; d<deltas.size(); d++)
+	for (unsigned int n=0; n<particles.size(); n++){
+		//the same simulation and the same random numbers for each run
+		Simulator simulator(world, parameters);
+		seedSampling(seed);
+
+		ofstream silent;
+		GridSlamProcessor processor(silent);
+		processor.setSensorMap(simulator.getSensorMap());
+		processor.setMatchingParameters(maxUrange, maxrange, 0.05, 1, 0.05, 0.05, 5, 0.075, 3, 0);
+		processor.setMotionModelParameters(0.1, 0.2, 0.1, 0.2);
+		processor.setUpdateDistances(0.5, 0.5, 0.5);
+		processor.setgenerateMap(false);
+		processor.setllsamplerange(0.01);
+		processor.setllsamplestep(0.01);
+		processor.setlasamplerange(0.005);
+		processor.setlasamplestep(0.005);
+		processor.setmatchingThreads(threads);
+		processor.setlazyRegistration(lazy);
+		processor.setmultiResolution(multiResolution);
+		processor.init(particles[n], xmin-5, ymin-5, xmax+5, ymax+5, deltas[d], simulator.getTruePose());
+
+		unsigned int updates=0;
+		double total=0, squaredError=0;
+		OrientedPoint endError(0,0,0);
+		ScanProfile stages;
+		for (int i=0; i<scans; i++){
+			RangeReading* reading=simulator.next();
+			std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+			bool processed=processor.processScan(*reading);
+			total+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+			delete reading;
+			if (!processed)
+				continue;
+			updates++;
+			const ScanProfile& profile=processor.getScanProfile();
+			stages.motion+=profile.motion;
+			stages.scanMatch+=profile.scanMatch;
+			stages.weights+=profile.weights;
+			stages.resample+=profile.resample;
+			stages.registration+=profile.registration;
+			stages.output+=profile.output;
+			const OrientedPoint& best=processor.getParticles()[processor.getBestParticleIndex()].pose;
+			const OrientedPoint& truth=simulator.getTruePose();
+			double dx=best.x-truth.x, dy=best.y-truth.y;
+			squaredError+=dx*dx+dy*dy;
+			endError=OrientedPoint(sqrt(dx*dx+dy*dy), 0, fabs(atan2(sin(best.theta-truth.theta), cos(best.theta-truth.theta))));
+		}
+		const ScanMatcher::MatchStatistics& matching=processor.getMatchStatistics();
+		cout << setw(10) << particles[n] << setw(8) << deltas[d] << setw(10) << updates
+			<< fixed << setprecision(1)
+			<< setw(10) << scans/total
+			<< setprecision(2)
+			<< setw(12) << (updates?1000.*total/updates:0.)
+			<< setw(14) << (updates?1000.*matching.time/updates:0.)
+			<< setw(12) << (matching.matches?(double)matching.evaluations/matching.matches:0.)
+			<< setw(12) << peakRSS()
+			<< setprecision(3)
+			<< setw(12) << (updates?sqrt(squaredError/updates):0.)
+			<< setw(12) << endError.x
+			<< setw(12) << endError.theta << endl;
+#ifdef GMAPPING_PROFILE
+		if (updates)
+			cout << setprecision(3) << "    stages[ms/update]: motion " << 1000.*stages.motion/updates
+				<< " match " << 1000.*stages.scanMatch/updates
+				<< " weights " << 1000.*stages.weights/updates
+				<< " resample " << 1000.*stages.resample/updates
+				<< " registration " << 1000.*stages.registration/updates
+				<< " output " << 1000.*stages.output/updates << endl;
+#endif
+		cout.unsetf(ios::fixed);
+		cout << setprecision(6);
+	}
+	return 0;
+}
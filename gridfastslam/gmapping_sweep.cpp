@@ -0,0 +1,278 @@
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <gmapping/utils/commandline.h>
+#include <gmapping/utils/stat.h>
+#include <gmapping/configfile/configfile.h>
+#include <gmapping/log/carmenconfiguration.h>
+#include <gmapping/log/sensorlog.h>
+#include <gmapping/gridfastslam/gfsparameters.h>
+#include <gmapping/gridfastslam/gridslamprocessor.h>
+
+/*Parameter sweep: runs the filter on one log with several parameter sets,
+concurrently. The sweep is a config file: the section [gfs] holds the parameters
+shared by all the runs, as for gfs_nogui, and each other section is a configuration
+that overrides some of them, e.g.
+
+[gfs]
+filename  loop.log
+particles 30
+
+[odometry_low]
+srr 0.05
+srt 0.05
+
+[fine]
+delta 0.025
+lstep 0.025
+
+The log is read once and its readings are shared, read only, by all the runs. Each
+run has its own processor and its own random numbers, seeded with its randseed, so
+the results do not depend on the number of threads. For each configuration it
+reports the run time, the peak size of the maps of the particles (the cells shared
+among the particles counted once), the neff at the end of the run and, when the log
+holds the ground truth (TRUEPOS), the error of the best particle.*/
+
+using namespace std;
+using namespace GMapping;
+
+/**a laser reading of the log and the ground truth at its time*/
+struct Step{
+	const RangeReading* reading;
+	bool hasTruth;
+	OrientedPoint truth;
+};
+
+struct Result{
+	unsigned int updates;
+	double time;
+	size_t mapBytes;
+	double neff;
+	unsigned int truthUpdates;
+	double squaredError;
+	OrientedPoint endError;
+};
+
+/**@returns the peak resident set size of the process in KB, 0 if unknown*/
+long peakRSS(){
+#ifndef _WIN32
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, &usage))
+		return usage.ru_maxrss;
+#endif
+	return 0;
+}
+
+/**@returns the bytes of the map patches held by the particles, a patch shared by several particles counted once*/
+size_t mapBytes(const GridSlamProcessor& processor){
+	std::vector<const void*> patches;
+	size_t blockSize=0;
+	const GridSlamProcessor::ParticleVector& particles=processor.getParticles();
+	for (GridSlamProcessor::ParticleVector::const_iterator it=particles.begin(); it!=particles.end(); it++){
+		const ScanMatcherStorage& storage=it->map.storage();
+		blockSize=storage.getPatchPoolStats().blockSize;
+		const autoptr< Array2D<ScanMatcherCell> >* cells=storage.cells();
+		int size=storage.getXSize()*storage.getYSize();
+		for (int i=0; i<size; i++)
+			if (cells[i].m_reference)
+				patches.push_back(cells[i].m_reference);
+	}
+	sort(patches.begin(), patches.end());
+	return (unique(patches.begin(), patches.end())-patches.begin())*blockSize;
+}
+
+/**the area covered by the log and the pose of its first scan, used by the runs with autosize*/
+struct LogBox{
+	double xmin, ymin, xmax, ymax;
+	OrientedPoint start;
+};
+
+void run(const GFSParameters& p, const SensorMap& sensorMap, const std::vector<Step>& steps, const LogBox& box,
+	unsigned int memoryPeriod, Result& result){
+	//0 leaves the generator unseeded, as in gfs_nogui
+	if (p.randseed)
+		seedSampling(p.randseed);
+	else
+		resetSampling();
+	ofstream silent;
+	GridSlamProcessor processor(silent);
+	processor.setSensorMap(sensorMap);
+	p.configure(processor);
+	OrientedPoint initialPose(0,0,0);
+	if (p.autosize){
+		initialPose=box.start;
+		p.initialize(processor, box.xmin-3*p.maxrange, box.ymin-3*p.maxrange, box.xmax+3*p.maxrange, box.ymax+3*p.maxrange, initialPose);
+	} else
+		p.initialize(processor, p.xmin, p.ymin, p.xmax, p.ymax, initialPose);
+
+	result=Result();
+	//the filter starts at initialPose on the first scan, the ground truth is compared relative to its value there
+	bool aligned=!steps.empty() && steps.front().hasTruth;
+	OrientedPoint truthStart=aligned?steps.front().truth:OrientedPoint(0,0,0);
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	for (std::vector<Step>::const_iterator it=steps.begin(); it!=steps.end(); it++){
+		if (!processor.processScan(*it->reading))
+			continue;
+		//the maps are measured every memoryPeriod updates and at the end
+		if (result.updates++%memoryPeriod==0){
+			size_t bytes=mapBytes(processor);
+			if (bytes>result.mapBytes)
+				result.mapBytes=bytes;
+		}
+		if (!aligned || !it->hasTruth)
+			continue;
+		const OrientedPoint& best=processor.getParticles()[processor.getBestParticleIndex()].pose;
+		OrientedPoint estimate=absoluteDifference(best, initialPose);
+		OrientedPoint truth=absoluteDifference(it->truth, truthStart);
+		double dx=estimate.x-truth.x, dy=estimate.y-truth.y;
+		result.truthUpdates++;
+		result.squaredError+=dx*dx+dy*dy;
+		result.endError=OrientedPoint(sqrt(dx*dx+dy*dy), 0, fabs(atan2(sin(estimate.theta-truth.theta), cos(estimate.theta-truth.theta))));
+	}
+	result.time=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	result.neff=processor.getneff();
+	size_t bytes=mapBytes(processor);
+	if (bytes>result.mapBytes)
+		result.mapBytes=bytes;
+}
+
+int main(int argc, const char * const * argv){
+	string configfilename;
+	string filename;
+	int threads=std::thread::hardware_concurrency();
+	int memoryPeriod=10;
+
+	CMD_PARSE_BEGIN(1,argc);
+		parseString("-cfg", configfilename);
+		parseString("-filename", filename);
+		parseInt("-threads", threads);
+		parseInt("-memoryPeriod", memoryPeriod);
+	CMD_PARSE_END;
+
+	ConfigFile cfg;
+	if (configfilename.empty() || !cfg.read(configfilename)){
+		cerr << "usage: gmapping_sweep -cfg <sweep file> [-filename <log>] [-threads n] [-memoryPeriod n]" << endl;
+		cerr << " the section [gfs] holds the shared parameters, each other section a configuration" << endl;
+		cerr << " the maps are measured every memoryPeriod updates of the filter" << endl;
+		return -1;
+	}
+	GFSParameters base;
+	base.read(cfg);
+	if (!filename.empty())
+		base.filename=filename;
+	if (!base.logLevel.empty())
+		Log::setLevel(Log::parseLevel(base.logLevel.c_str(), Log::level()));
+
+	//the configurations are read before the runs start, ConfigFile is not thread safe
+	std::vector<string> names;
+	std::vector<GFSParameters> configurations;
+	for (unsigned int i=0; i<cfg.sections().size(); i++){
+		const string& name=cfg.sections()[i];
+		string lower=name;
+		for (unsigned int c=0; c<lower.size(); c++)
+			lower[c]=tolower(lower[c]);
+		if (lower=="gfs")
+			continue;
+		GFSParameters p=base;
+		p.read(cfg, name);
+		names.push_back(name);
+		configurations.push_back(p);
+	}
+	if (configurations.empty()){
+		names.push_back("gfs");
+		configurations.push_back(base);
+	}
+
+	ifstream is(base.filename.c_str());
+	if (!is){
+		cerr << "no file " << base.filename << " found" << endl;
+		return -1;
+	}
+	CarmenConfiguration conf;
+	conf.load(is);
+	is.close();
+	SensorMap sensorMap=conf.computeSensorMap();
+	SensorLog log(sensorMap);
+	std::chrono::steady_clock::time_point loadStart=std::chrono::steady_clock::now();
+	log.load(base.filename.c_str());
+	double loadTime=std::chrono::duration<double>(std::chrono::steady_clock::now()-loadStart).count();
+
+	std::vector<Step> steps;
+	Step step;
+	step.hasTruth=false;
+	for (SensorLog::const_iterator it=log.begin(); it!=log.end(); it++){
+		const OdometryReading* odometry=dynamic_cast<const OdometryReading*>(*it);
+		if (odometry && odometry->getSensor()->getName()=="TRUEPOS"){
+			step.truth=odometry->getPose();
+			step.hasTruth=true;
+		}
+		const RangeReading* reading=dynamic_cast<const RangeReading*>(*it);
+		if (reading){
+			step.reading=reading;
+			steps.push_back(step);
+		}
+	}
+	LogBox box;
+	box.start=log.boundingBox(box.xmin, box.ymin, box.xmax, box.ymax);
+	cerr << "log " << base.filename << ", " << steps.size() << " scans read in " << loadTime << "s" << endl;
+
+	if (memoryPeriod<1)
+		memoryPeriod=1;
+	if (threads<1)
+		threads=1;
+	if (threads>(int)configurations.size())
+		threads=configurations.size();
+	std::vector<Result> results(configurations.size());
+	std::atomic<unsigned int> next(0);
+	std::mutex outputMutex;
+	std::vector<std::thread> workers;
+	for (int t=0; t<threads; t++)
+		workers.push_back(std::thread([&](){
+			unsigned int i;
+			while ((i=next++)<configurations.size()){
+				run(configurations[i], sensorMap, steps, box, memoryPeriod, results[i]);
+				lock_guard<mutex> lock(outputMutex);
+				cerr << "done " << names[i] << " in " << results[i].time << "s" << endl;
+			}
+		}));
+	for (unsigned int t=0; t<workers.size(); t++)
+		workers[t].join();
+
+	cout << setw(20) << "configuration" << setw(10) << "particles" << setw(8) << "delta"
+		<< setw(8) << "srr" << setw(8) << "srt" << setw(8) << "str" << setw(8) << "stt"
+		<< setw(8) << "lstep" << setw(8) << "astep" << setw(9) << "updates"
+		<< setw(10) << "time[s]" << setw(11) << "map[KB]" << setw(9) << "neff"
+		<< setw(11) << "rmsErr[m]" << setw(11) << "endErr[m]" << setw(13) << "endErr[rad]" << endl;
+	for (unsigned int i=0; i<configurations.size(); i++){
+		const GFSParameters& p=configurations[i];
+		const Result& r=results[i];
+		cout << setw(20) << names[i] << setw(10) << p.particles << setw(8) << p.delta
+			<< setw(8) << p.srr << setw(8) << p.srt << setw(8) << p.str << setw(8) << p.stt
+			<< setw(8) << p.lstep << setw(8) << p.astep << setw(9) << r.updates
+			<< fixed << setprecision(2)
+			<< setw(10) << r.time << setw(11) << r.mapBytes/1024.
+			<< setw(9) << r.neff;
+		if (r.truthUpdates)
+			cout << setprecision(3) << setw(11) << sqrt(r.squaredError/r.truthUpdates)
+				<< setw(11) << r.endError.x << setw(13) << r.endError.theta;
+		else
+			cout << setw(11) << "-" << setw(11) << "-" << setw(13) << "-";
+		cout << endl;
+		cout.unsetf(ios::fixed);
+		cout << setprecision(6);
+	}
+	cout << "peak memory of the process " << peakRSS() << " KB" << endl;
+	return 0;
+}
@@ -5,6 +5,7 @@
 #include <set>
 #include <fstream>
 #include <iomanip>
+#include <thread>
 #include <gmapping/utils/stat.h>
 #include "gmapping/gridfastslam/gridslamprocessor.h"
 
@@ -23,6 +24,13 @@ using namespace std;
     m_obsSigmaGain=1;
     m_resampleThreshold=0.5;
     m_minimumScore=0.;
+    m_matchingThreads=1;
+    m_lazyRegistration=false;
+    m_profileParticles=false;
+    m_binaryOutput=false;
+    m_asyncOutput=false;
+    m_outputQueueSize=1024;
+    m_odometryOutputPeriod=1;
   }
   
   GridSlamProcessor::GridSlamProcessor(const GridSlamProcessor& gsp) 
@@ -33,12 +41,22 @@ using namespace std;
     m_obsSigmaGain=gsp.m_obsSigmaGain;
     m_resampleThreshold=gsp.m_resampleThreshold;
     m_minimumScore=gsp.m_minimumScore;
+    m_matchingThreads=gsp.m_matchingThreads;
+    m_lazyRegistration=gsp.m_lazyRegistration;
+    m_profileParticles=gsp.m_profileParticles;
+    m_binaryOutput=gsp.m_binaryOutput;
+    m_asyncOutput=gsp.m_asyncOutput;
+    m_outputQueueSize=gsp.m_outputQueueSize;
+    m_odometryOutputPeriod=gsp.m_odometryOutputPeriod;
     
     m_beams=gsp.m_beams;
     m_indexes=gsp.m_indexes;
     m_motionModel=gsp.m_motionModel;
     m_resampleThreshold=gsp.m_resampleThreshold;
     m_matcher=gsp.m_matcher;
+    m_matchStatistics=gsp.m_matchStatistics;
+    m_scanProfile=gsp.m_scanProfile;
+    m_lastScanProfile=gsp.m_lastScanProfile;
     
     m_count=gsp.m_count;
     m_readingCount=gsp.m_readingCount;
@@ -49,11 +67,11 @@ using namespace std;
     m_angularDistance=gsp.m_angularDistance;
     m_neff=gsp.m_neff;
 	
-    cerr << "FILTER COPY CONSTRUCTOR" << endl;
-    cerr << "m_odoPose=" << m_odoPose.x << " " <<m_odoPose.y << " " << m_odoPose.theta << endl;
-    cerr << "m_lastPartPose=" << m_lastPartPose.x << " " <<m_lastPartPose.y << " " << m_lastPartPose.theta << endl;
-    cerr << "m_linearDistance=" << m_linearDistance << endl;
-    cerr << "m_angularDistance=" << m_linearDistance << endl;
+    GMAPPING_DEBUG("FILTER COPY CONSTRUCTOR" << endl
+		   << "m_odoPose=" << m_odoPose.x << " " <<m_odoPose.y << " " << m_odoPose.theta << endl
+		   << "m_lastPartPose=" << m_lastPartPose.x << " " <<m_lastPartPose.y << " " << m_lastPartPose.theta << endl
+		   << "m_linearDistance=" << m_linearDistance << endl
+		   << "m_angularDistance=" << m_angularDistance << endl);
     
 		
     m_xmin=gsp.m_xmin;
@@ -82,9 +100,9 @@ using namespace std;
 #endif
 
 
-    cerr  << "Tree: normalizing, resetting and propagating weights within copy construction/cloneing ..." ;
+    GMAPPING_DEBUG("Tree: normalizing, resetting and propagating weights within copy construction/cloneing ...");
     updateTreeWeights(false);
-    cerr  << ".done!" <<endl;
+    GMAPPING_DEBUG(".done!" <<endl);
   }
   
   GridSlamProcessor::GridSlamProcessor(std::ostream& infoS): m_infoStream(infoS){
@@ -92,20 +110,26 @@ using namespace std;
     m_obsSigmaGain=1;
     m_resampleThreshold=0.5;
     m_minimumScore=0.;
-	
+    m_matchingThreads=1;
+    m_lazyRegistration=false;
+    m_profileParticles=false;
+    m_binaryOutput=false;
+    m_asyncOutput=false;
+    m_outputQueueSize=1024;
+    m_odometryOutputPeriod=1;
   }
 
   GridSlamProcessor* GridSlamProcessor::clone() const {
 # ifdef MAP_CONSISTENCY_CHECK
     cerr << __func__ << ": performing preclone_fit_test" << endl;
-    typedef std::map<autoptr< Array2D<PointAccumulator> >::reference* const, int> PointerMap;
+    typedef std::map<autoptr< Array2D<ScanMatcherCell> >::reference* const, int> PointerMap;
     PointerMap pmap;
 	for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
 	  const ScanMatcherMap& m1(it->map);
-	  const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
  	  for (int x=0; x<h1.getXSize(); x++){
 	    for (int y=0; y<h1.getYSize(); y++){
-	      const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
+	      const autoptr< Array2D<ScanMatcherCell> >& a1(h1.m_cells[x*h1.getYSize()+y]);
 	      if (a1.m_reference){
 		PointerMap::iterator f=pmap.find(a1.m_reference);
 		if (f==pmap.end())
@@ -131,13 +155,13 @@ using namespace std;
 	for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
 	  const ScanMatcherMap& m1(it->map);
 	  const ScanMatcherMap& m2(jt->map);
-	  const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
-	  const HierarchicalArray2D<PointAccumulator>& h2(m2.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h2(m2.storage());
 	  jt++;
  	  for (int x=0; x<h1.getXSize(); x++){
 	    for (int y=0; y<h1.getYSize(); y++){
-	      const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
-	      const autoptr< Array2D<PointAccumulator> >& a2(h2.m_cells[x][y]);
+	      const autoptr< Array2D<ScanMatcherCell> >& a1(h1.m_cells[x*h1.getYSize()+y]);
+	      const autoptr< Array2D<ScanMatcherCell> >& a2(h2.m_cells[x*h2.getYSize()+y]);
 	      assert(a1.m_reference==a2.m_reference);
 	      assert((!a1.m_reference) || !(a1.m_reference->shares%2));
 	    }
@@ -149,8 +173,8 @@ using namespace std;
 }
   
   GridSlamProcessor::~GridSlamProcessor(){
-    cerr << __func__ << ": Start" << endl;
-    cerr << __func__ << ": Deleting tree" << endl;
+    GMAPPING_DEBUG(__func__ << ": Start" << endl
+		   << __func__ << ": Deleting tree" << endl);
     for (std::vector<Particle>::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
 #ifdef TREE_CONSISTENCY_CHECK		
       TNode* node=it->node;
@@ -165,14 +189,14 @@ using namespace std;
     
 # ifdef MAP_CONSISTENCY_CHECK
     cerr << __func__ << ": performing predestruction_fit_test" << endl;
-    typedef std::map<autoptr< Array2D<PointAccumulator> >::reference* const, int> PointerMap;
+    typedef std::map<autoptr< Array2D<ScanMatcherCell> >::reference* const, int> PointerMap;
     PointerMap pmap;
     for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       const ScanMatcherMap& m1(it->map);
-      const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
+      const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
       for (int x=0; x<h1.getXSize(); x++){
 	for (int y=0; y<h1.getYSize(); y++){
-	  const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
+	  const autoptr< Array2D<ScanMatcherCell> >& a1(h1.m_cells[x*h1.getYSize()+y]);
 	  if (a1.m_reference){
 	    PointerMap::iterator f=pmap.find(a1.m_reference);
 	    if (f==pmap.end())
@@ -197,13 +221,13 @@ using namespace std;
     m_obsSigmaGain=likelihoodGain;
     m_matcher.setMatchingParameters(urange, range, sigma, kernsize, lopt, aopt, iterations, likelihoodSigma, likelihoodSkip);
     if (m_infoStream)
-      m_infoStream << " -maxUrange "<< urange
+      GMAPPING_LOG_TO(Log::Info, m_infoStream, " -maxUrange "<< urange
 		   << " -maxUrange "<< range
 		   << " -sigma     "<< sigma
 		   << " -kernelSize "<< kernsize
 		   << " -lstep "    << lopt
 		   << " -lobsGain " << m_obsSigmaGain
-		   << " -astep "    << aopt << endl;
+		   << " -astep "    << aopt << endl);
     
     
   }
@@ -216,8 +240,8 @@ void GridSlamProcessor::setMotionModelParameters
   m_motionModel.stt=stt;	
   
   if (m_infoStream)
-    m_infoStream << " -srr "<< srr 	<< " -srt "<< srt  
-		 << " -str "<< str 	<< " -stt "<< stt << endl;
+    GMAPPING_LOG_TO(Log::Info, m_infoStream, " -srr "<< srr 	<< " -srt "<< srt  
+		 << " -str "<< str 	<< " -stt "<< stt << endl);
   
 }
   
@@ -226,9 +250,9 @@ void GridSlamProcessor::setMotionModelParameters
     m_angularThresholdDistance=angular;
     m_resampleThreshold=resampleThreshold;	
     if (m_infoStream)
-      m_infoStream << " -linearUpdate " << linear
+      GMAPPING_LOG_TO(Log::Info, m_infoStream, " -linearUpdate " << linear
 		   << " -angularUpdate "<< angular
-		   << " -resampleThreshold " << m_resampleThreshold << endl;
+		   << " -resampleThreshold " << m_resampleThreshold << endl);
   }
   
   //HERE STARTS THE BEEF
@@ -249,7 +273,7 @@ void GridSlamProcessor::setMotionModelParameters
     
     SensorMap::const_iterator laser_it=smap.find(std::string("FLASER"));
     if (laser_it==smap.end()){
-      cerr << "Attempting to load the new carmen log format" << endl;
+      GMAPPING_INFO("Attempting to load the new carmen log format" << endl);
       laser_it=smap.find(std::string("ROBOTLASER1"));
       assert(laser_it!=smap.end());
     }
@@ -272,13 +296,13 @@ void GridSlamProcessor::setMotionModelParameters
     m_ymax=ymax;
     m_delta=delta;
     if (m_infoStream)
-      m_infoStream 
-	<< " -xmin "<< m_xmin
+      GMAPPING_LOG_TO(Log::Info, m_infoStream, 
+	   " -xmin "<< m_xmin
 	<< " -xmax "<< m_xmax
 	<< " -ymin "<< m_ymin
 	<< " -ymax "<< m_ymax
 	<< " -delta "<< m_delta
-	<< " -particles "<< size << endl;
+	<< " -particles "<< size << endl);
     
 
     m_particles.clear();
@@ -301,19 +325,100 @@ void GridSlamProcessor::setMotionModelParameters
     m_count=0;
     m_readingCount=0;
     m_linearDistance=m_angularDistance=0;
+    m_scanProfile.clear();
+    m_lastScanProfile.clear();
+    m_outputWriter.setAsynchronous(m_asyncOutput);
+    m_outputWriter.setQueueSize(m_outputQueueSize);
+    m_outputWriter.setPeriod(GFSBinary::Odometry, m_odometryOutputPeriod);
+    m_outputWriter.setPeriod(GFSBinary::OdometryUpdate, m_odometryOutputPeriod);
   }
 
   void GridSlamProcessor::processTruePos(const OdometryReading& o){
     const OdometrySensor* os=dynamic_cast<const OdometrySensor*>(o.getSensor());
-    if (os && os->isIdeal() && m_outputStream){
-      m_outputStream << setiosflags(ios::fixed) << setprecision(3);
-      m_outputStream <<  "SIMULATOR_POS " <<  o.getPose().x << " " << o.getPose().y << " " ;
-      m_outputStream << setiosflags(ios::fixed) << setprecision(6) << o.getPose().theta << " " <<  o.getTime() << endl;
+    if (os && os->isIdeal() && m_outputStream.is_open() && m_outputWriter.accept(GFSBinary::SimulatorPose)){
+      GFSOutputRecord record(GFSBinary::SimulatorPose);
+      record.pose=o.getPose();
+      record.time=o.getTime();
+      m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+    }
+  }
+
+  void GridSlamProcessor::writeOutputLine(const std::string& line){
+    if (!m_outputStream.is_open() || !m_outputWriter.accept(GFSBinary::Text))
+      return;
+    GFSOutputRecord record(GFSBinary::Text);
+    record.text=line;
+    m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+  }
+
+  void GridSlamProcessor::particlesRecord(GFSOutputRecord& record) const{
+    record.poses.reserve(m_particles.size());
+    record.weights.reserve(m_particles.size());
+    for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
+      record.poses.push_back(it->pose);
+      record.weights.push_back(it->weight);
+    }
+  }
+
+  void GridSlamProcessor::writeOdometryRecords(const RangeReading& reading){
+    if (m_outputWriter.accept(GFSBinary::Odometry)){
+      GFSOutputRecord record(GFSBinary::Odometry);
+      record.pose=m_odoPose;
+      record.time=reading.getTime();
+      m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+    }
+    if (m_outputWriter.accept(GFSBinary::OdometryUpdate)){
+      GFSOutputRecord record(GFSBinary::OdometryUpdate);
+      particlesRecord(record);
+      record.time=reading.getTime();
+      m_outputWriter.write(m_outputStream, m_binaryOutput, record);
     }
   }
+
+  void GridSlamProcessor::writeFrameRecord(){
+    if (!m_outputWriter.accept(GFSBinary::Frame))
+      return;
+    GFSOutputRecord record(GFSBinary::Frame);
+    record.frame=m_readingCount;
+    record.linearDistance=m_linearDistance;
+    record.angularDistance=m_angularDistance;
+    m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+  }
+
+  void GridSlamProcessor::writeScanMatchRecords(const RangeReading& reading){
+    if (m_outputWriter.accept(GFSBinary::Laser)){
+      GFSOutputRecord record(GFSBinary::Laser);
+      record.ranges.assign(reading.begin(), reading.end());
+      record.pose=reading.getPose();
+      record.time=reading.getTime();
+      m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+    }
+    if (m_outputWriter.accept(GFSBinary::ScanMatchUpdate)){
+      GFSOutputRecord record(GFSBinary::ScanMatchUpdate);
+      particlesRecord(record);
+      m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+    }
+  }
+
+  void GridSlamProcessor::writeNeffRecord(){
+    if (!m_outputWriter.accept(GFSBinary::Neff))
+      return;
+    GFSOutputRecord record(GFSBinary::Neff);
+    record.neff=m_neff;
+    m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+  }
+
+  void GridSlamProcessor::writeResampleRecord(){
+    if (!m_outputWriter.accept(GFSBinary::Resample))
+      return;
+    GFSOutputRecord record(GFSBinary::Resample);
+    record.indexes=m_indexes;
+    m_outputWriter.write(m_outputStream, m_binaryOutput, record);
+  }
   
   
   bool GridSlamProcessor::processScan(const RangeReading & reading, int adaptParticles){
+    GSP_PROFILE_TIC(scanStart);
     
     /**retireve the position from the reading, and compute the odometry*/
     OrientedPoint relPose=reading.getPose();
@@ -322,31 +427,18 @@ void GridSlamProcessor::setMotionModelParameters
     }
     
     //write the state of the reading and update all the particles using the motion model
+    GSP_PROFILE_TIC(motionStart);
     for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       OrientedPoint& pose(it->pose);
       pose=m_motionModel.drawFromMotion(it->pose, relPose, m_odoPose);
     }
+    GSP_PROFILE_TOC(motionStart, m_scanProfile.motion);
 
     // update the output file
-    if (m_outputStream.is_open()){
-      m_outputStream << setiosflags(ios::fixed) << setprecision(6);
-      m_outputStream << "ODOM ";
-      m_outputStream << setiosflags(ios::fixed) << setprecision(3) << m_odoPose.x << " " << m_odoPose.y << " ";
-      m_outputStream << setiosflags(ios::fixed) << setprecision(6) << m_odoPose.theta << " ";
-      m_outputStream << reading.getTime();
-      m_outputStream << endl;
-    }
-    if (m_outputStream.is_open()){
-      m_outputStream << setiosflags(ios::fixed) << setprecision(6);
-      m_outputStream << "ODO_UPDATE "<< m_particles.size() << " ";
-      for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
-	OrientedPoint& pose(it->pose);
-	m_outputStream << setiosflags(ios::fixed) << setprecision(3) << pose.x << " " << pose.y << " ";
-	m_outputStream << setiosflags(ios::fixed) << setprecision(6) << pose.theta << " " << it-> weight << " ";
-      }
-      m_outputStream << reading.getTime();
-      m_outputStream << endl;
-    }
+    GSP_PROFILE_TIC(odometryOutputStart);
+    if (m_outputStream.is_open())
+      writeOdometryRecords(reading);
+    GSP_PROFILE_TOC(odometryOutputStart, m_scanProfile.output);
     
     //invoke the callback
     onOdometryUpdate();
@@ -360,18 +452,18 @@ void GridSlamProcessor::setMotionModelParameters
     
     // if the robot jumps throw a warning
     if (m_linearDistance>m_distanceThresholdCheck){
-      cerr << "***********************************************************************" << endl;
-      cerr << "********** Error: m_distanceThresholdCheck overridden!!!! *************" << endl;
-      cerr << "m_distanceThresholdCheck=" << m_distanceThresholdCheck << endl;
-      cerr << "Old Odometry Pose= " << m_odoPose.x << " " << m_odoPose.y 
-	   << " " <<m_odoPose.theta << endl;
-      cerr << "New Odometry Pose (reported from observation)= " << relPose.x << " " << relPose.y 
-	   << " " <<relPose.theta << endl;
-      cerr << "***********************************************************************" << endl;
-      cerr << "** The Odometry has a big jump here. This is probably a bug in the   **" << endl;
-      cerr << "** odometry/laser input. We continue now, but the result is probably **" << endl;
-      cerr << "** crap or can lead to a core dump since the map doesn't fit.... C&G **" << endl;
-      cerr << "***********************************************************************" << endl;
+      GMAPPING_WARN("***********************************************************************" << endl
+	   << "********** Error: m_distanceThresholdCheck overridden!!!! *************" << endl
+	   << "m_distanceThresholdCheck=" << m_distanceThresholdCheck << endl
+	   << "Old Odometry Pose= " << m_odoPose.x << " " << m_odoPose.y 
+	   << " " <<m_odoPose.theta << endl
+	   << "New Odometry Pose (reported from observation)= " << relPose.x << " " << relPose.y 
+	   << " " <<relPose.theta << endl
+	   << "***********************************************************************" << endl
+	   << "** The Odometry has a big jump here. This is probably a bug in the   **" << endl
+	   << "** odometry/laser input. We continue now, but the result is probably **" << endl
+	   << "** crap or can lead to a core dump since the map doesn't fit.... C&G **" << endl
+	   << "***********************************************************************" << endl);
     }
     
     m_odoPose=relPose;
@@ -385,20 +477,18 @@ void GridSlamProcessor::setMotionModelParameters
     || (period_ >= 0.0 && (reading.getTime() - last_update_time_) > period_)){
       last_update_time_ = reading.getTime();      
 
-      if (m_outputStream.is_open()){
-	m_outputStream << setiosflags(ios::fixed) << setprecision(6);
-	m_outputStream << "FRAME " <<  m_readingCount;
-	m_outputStream << " " << m_linearDistance;
-	m_outputStream << " " << m_angularDistance << endl;
-      }
+      GSP_PROFILE_TIC(frameOutputStart);
+      if (m_outputStream.is_open())
+	writeFrameRecord();
+      GSP_PROFILE_TOC(frameOutputStart, m_scanProfile.output);
       
       if (m_infoStream)
-	m_infoStream << "update frame " <<  m_readingCount << endl
-		     << "update ld=" << m_linearDistance << " ad=" << m_angularDistance << endl;
+	GMAPPING_LOG_TO(Log::Info, m_infoStream, "update frame " <<  m_readingCount << endl
+		     << "update ld=" << m_linearDistance << " ad=" << m_angularDistance << endl);
       
       
-      cerr << "Laser Pose= " << reading.getPose().x << " " << reading.getPose().y 
-	   << " " << reading.getPose().theta << endl;
+      GMAPPING_DEBUG("Laser Pose= " << reading.getPose().x << " " << reading.getPose().y 
+	   << " " << reading.getPose().theta << endl);
       
       
       //this is for converting the reading in a scan-matcher feedable form
@@ -407,7 +497,7 @@ void GridSlamProcessor::setMotionModelParameters
       for(unsigned int i=0; i<m_beams; i++){
 	plainReading[i]=reading[i];
       }
-      m_infoStream << "m_count " << m_count << endl;
+      GMAPPING_LOG_TO(Log::Debug, m_infoStream, "m_count " << m_count << endl);
 
       RangeReading* reading_copy = 
               new RangeReading(reading.size(),
@@ -416,39 +506,30 @@ void GridSlamProcessor::setMotionModelParameters
                                reading.getTime());
 
       if (m_count>0){
+	GSP_PROFILE_TIC(matchStart);
 	scanMatch(plainReading);
-	if (m_outputStream.is_open()){
-	  m_outputStream << "LASER_READING "<< reading.size() << " ";
-	  m_outputStream << setiosflags(ios::fixed) << setprecision(2);
-	  for (RangeReading::const_iterator b=reading.begin(); b!=reading.end(); b++){
-	    m_outputStream << *b << " ";
-	  }
-	  OrientedPoint p=reading.getPose();
-	  m_outputStream << setiosflags(ios::fixed) << setprecision(6);
-	  m_outputStream << p.x << " " << p.y << " " << p.theta << " " << reading.getTime()<< endl;
-	  m_outputStream << "SM_UPDATE "<< m_particles.size() << " ";
-	  for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
-	    const OrientedPoint& pose=it->pose;
-	    m_outputStream << setiosflags(ios::fixed) << setprecision(3) <<  pose.x << " " << pose.y << " ";
-	    m_outputStream << setiosflags(ios::fixed) << setprecision(6) <<  pose.theta << " " << it-> weight << " ";
-	  }
-	  m_outputStream << endl;
-	}
+	GSP_PROFILE_TOC(matchStart, m_scanProfile.scanMatch);
+	GSP_PROFILE_TIC(outputStart);
+	if (m_outputStream.is_open())
+	  writeScanMatchRecords(reading);
+	GSP_PROFILE_TOC(outputStart, m_scanProfile.output);
 	onScanmatchUpdate();
 	
+	GSP_PROFILE_TIC(weightsStart);
 	updateTreeWeights(false);
+	GSP_PROFILE_TOC(weightsStart, m_scanProfile.weights);
 				
 	if (m_infoStream){
-	  m_infoStream << "neff= " << m_neff  << endl;
-	}
-	if (m_outputStream.is_open()){
-	  m_outputStream << setiosflags(ios::fixed) << setprecision(6);
-	  m_outputStream << "NEFF " << m_neff << endl;
+	  GMAPPING_LOG_TO(Log::Info, m_infoStream, "neff= " << m_neff  << endl);
 	}
+	if (m_outputStream.is_open())
+	  writeNeffRecord();
+	GSP_PROFILE(m_scanProfile.neff=m_neff);
  	resample(plainReading, adaptParticles, reading_copy);
 	
       } else {
-	m_infoStream << "Registering First Scan"<< endl;
+	GMAPPING_LOG_TO(Log::Info, m_infoStream, "Registering First Scan"<< endl);
+	GSP_PROFILE_TIC(registrationStart);
 	for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){	
 	  m_matcher.invalidateActiveArea();
 	  m_matcher.computeActiveArea(it->map, it->pose, plainReading);
@@ -461,9 +542,12 @@ void GridSlamProcessor::setMotionModelParameters
 	  it->node=node;
 	  
 	}
+	GSP_PROFILE_TOC(registrationStart, m_scanProfile.registration);
       }
       //		cerr  << "Tree: normalizing, resetting and propagating weights at the end..." ;
+      GSP_PROFILE_TIC(weightsStart);
       updateTreeWeights(false);
+      GSP_PROFILE_TOC(weightsStart, m_scanProfile.weights);
       //		cerr  << ".done!" <<endl;
       
       delete [] plainReading;
@@ -479,13 +563,55 @@ void GridSlamProcessor::setMotionModelParameters
       }
       
     }
-    if (m_outputStream.is_open())
+    //the asynchronous writer flushes the stream by itself
+    if (m_outputStream.is_open() && !m_outputWriter.isAsynchronous())
       m_outputStream << flush;
     m_readingCount++;
+#ifdef GMAPPING_PROFILE
+    m_scanProfile.readings++;
+    GSP_PROFILE_TOC(scanStart, m_scanProfile.total);
+    if (processed){
+      m_scanProfile.scan=m_count-1;
+      m_scanProfile.particles=m_particles.size();
+      std::swap(m_lastScanProfile, m_scanProfile);
+      m_scanProfile.clear();
+      onProfileUpdate(m_lastScanProfile);
+    }
+#endif
     return processed;
   }
   
   
+  void GridSlamProcessor::registerPendingScans(){
+    for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++)
+      registerPendingScans(m_matcher, *it);
+  }
+
+  void GridSlamProcessor::scanMatchParallel(const double* plainReading, std::vector<double>& scores, std::vector<double>& likelihoods){
+    unsigned int threads=m_matchingThreads<m_particles.size()?m_matchingThreads:m_particles.size();
+    //refresh the per thread matchers, the parameters may have changed since the last scan
+    m_threadMatchers.resize(threads);
+    for (unsigned int t=0; t<threads; t++)
+      m_threadMatchers[t]=m_matcher;
+    std::atomic<unsigned int> nextParticle(0);
+    std::vector<std::thread> workers;
+    for (unsigned int t=1; t<threads; t++)
+      workers.push_back(std::thread(&GridSlamProcessor::scanMatchWorker, this, t, plainReading, &scores, &likelihoods, &nextParticle));
+    scanMatchWorker(0, plainReading, &scores, &likelihoods, &nextParticle);
+    for (unsigned int t=0; t<workers.size(); t++)
+      workers[t].join();
+  }
+
+  void GridSlamProcessor::scanMatchWorker(unsigned int thread, const double* plainReading, std::vector<double>* scores, std::vector<double>* likelihoods, std::atomic<unsigned int>* nextParticle){
+    ScanMatcher& matcher=m_threadMatchers[thread];
+    unsigned int n=m_particles.size();
+    for (unsigned int i=(*nextParticle)++; i<n; i=(*nextParticle)++){
+      GSP_PROFILE_TIC(particleStart);
+      (*scores)[i]=scanMatchParticle(matcher, m_particles[i], plainReading, (*likelihoods)[i]);
+      GSP_PROFILE(if (m_profileParticles) m_scanProfile.particleMatch[i]=GSP_PROFILE_ELAPSED(particleStart));
+    }
+  }
+
   std::ofstream& GridSlamProcessor::outputStream(){
     return m_outputStream;
   }
@@ -509,6 +635,7 @@ void GridSlamProcessor::setMotionModelParameters
   void GridSlamProcessor::onScanmatchUpdate(){}
   void GridSlamProcessor::onResampleUpdate(){}
   void GridSlamProcessor::onOdometryUpdate(){}
+  void GridSlamProcessor::onProfileUpdate(const ScanProfile&){}
 
   
 };// end namespace
@@ -251,8 +251,8 @@ double GridSlamProcessor::propagateWeights(){
 	}
 	
 	if (fabs(aw-1.0) > 0.0001 || fabs(lastNodeWeight-1.0) > 0.0001) {
-	  cerr << "ERROR: ";
-	  cerr << "root->accWeight=" << lastNodeWeight << "    sum_leaf_weights=" << aw << endl;
+	  GMAPPING_ERROR("ERROR: "
+	  << "root->accWeight=" << lastNodeWeight << "    sum_leaf_weights=" << aw << endl);
 	  assert(0);         
 	}
 	return lastNodeWeight;
@@ -37,24 +37,50 @@ void computeBoundingBox(double& xmin, double& ymin, double& xmax, double& ymax,
 	}
 }
 
-void computeBoundingBox(double& xmin, double& ymin, double& xmax, double& ymax, const RecordList& rl, double maxrange){
+void computeBoundingBox(double& xmin, double& ymin, double& xmax, double& ymax, const IndexedRecordList& rl, double maxrange){
 	xmin = ymin = MAXDOUBLE;
 	xmax = ymax =-MAXDOUBLE;
-	const LaserRecord* lastLaser=0;
-	for (RecordList::const_iterator it=rl.begin(); it!=rl.end(); it++){
-		const LaserRecord* lr= dynamic_cast<const LaserRecord*>(*it);
-		if (lr){
-			lastLaser=lr;
+	LaserRecord* lastLaser=0;
+	for (size_t i=0; i<rl.size(); i++){
+		if (rl.type(i)==IndexedRecordList::Laser){
+			delete lastLaser;
+			lastLaser=dynamic_cast<LaserRecord*>(rl.record(i));
 			continue;
 		}
-		const ScanMatchRecord* smr= dynamic_cast<const ScanMatchRecord*>(*it);
-		if (smr && lastLaser){
-			for (std::vector<OrientedPoint>::const_iterator pit=smr->poses.begin(); pit!=smr->poses.end(); pit++){
-				computeBoundingBox(xmin, ymin, xmax, ymax, *lastLaser, *pit, maxrange);
+		if (rl.type(i)==IndexedRecordList::ScanMatch && lastLaser){
+			unsigned int particles=rl.particles(i);
+			for (unsigned int p=0; p<particles; p++){
+				OrientedPoint pose;
+				double weight;
+				if (rl.particle(i, p, pose, weight))
+					computeBoundingBox(xmin, ymin, xmax, ymax, *lastLaser, pose, maxrange);
 			}
 		}
 	}
+	delete lastLaser;
 }
+void registerScan(ScanMatcher& matcher, ScanMatcherMap& smap, const IndexedRecordList& rl, const IndexedRecordList::PathStep& step){
+	LaserRecord* s=dynamic_cast<LaserRecord*>(rl.record(step.laser));
+	if (!s)
+		return;
+	double rawreadings[MAX_LASER_BEAMS];
+	for (uint i=0; i<s->readings.size(); i++)
+		rawreadings[i]=s->readings[i];
+	matcher.invalidateActiveArea();
+	matcher.computeActiveArea(smap, step.pose, rawreadings);
+//	matcher.allocActiveArea(smap, step.pose, rawreadings);
+	matcher.registerScan(smap, step.pose, rawreadings);
+	delete s;
+}
+
+/**a copy of the map after the first steps of the rendered path. The copies share the
+patches that were not changed since, the registration duplicates them (copy on write)*/
+struct MapCheckpoint{
+	MapCheckpoint(unsigned int s, const ScanMatcherMap& m): steps(s), map(m) {}
+	unsigned int steps;
+	ScanMatcherMap map;
+};
+
 int main(int argc, char** argv){
 	QApplication app(argc, argv);
 	double maxrange=50;
@@ -62,12 +88,18 @@ int main(int argc, char** argv){
 	int scanSkip=5;
 	const char* filename=0;
 	const char* format="PNG";
+	bool rebuild=false;
+	int checkpointSteps=50;
+	int maxCheckpoints=64;
 	CMD_PARSE_BEGIN(1, argc)
 		parseDouble("-maxrange", maxrange);
 		parseDouble("-delta", delta);
 		parseInt("-skip", scanSkip);
 		parseString("-filename",filename);
 		parseString("-format",format);
+		parseFlag("-rebuild", rebuild);
+		parseInt("-checkpoint", checkpointSteps);
+		parseInt("-maxcheckpoints", maxCheckpoints);
 	CMD_PARSE_END
 	
 	double maxUrange=maxrange;
@@ -79,26 +111,29 @@ int main(int argc, char** argv){
 		cout << " -delta    <map cell size>" << endl;
 		cout << " -skip     <frames to skip among images>" << endl;
 		cout << " -format   <image format in capital letters>" << endl;
+		cout << " -rebuild  (registers the whole path in a new map for each frame)" << endl;
+		cout << " -checkpoint <scans between the copies of the map kept to restart from>" << endl;
+		cout << " -maxcheckpoints <copies of the map kept>" << endl;
 		return -1;
 	}
-	ifstream is(filename);
-	if (!is){
+	//the file is mapped and indexed, the records are decoded only when needed
+	IndexedRecordList rl;
+	if (!rl.open(filename)){
 		cout << " supply an EXISTING gfs file, please" << endl;
 		return -1;
 	}
-	RecordList rl;
-	rl.read(is);
 	
 	int particles=0;
 	int beams=0;
-	for (RecordList::const_iterator it=rl.begin(); it!=rl.end(); it++){
-		const OdometryRecord* odometry=dynamic_cast<const OdometryRecord*>(*it);
-		if (odometry){
-			particles=odometry->dim;
+	for (size_t i=0; i<rl.size(); i++){
+		if (rl.type(i)==IndexedRecordList::Odometry){
+			particles=rl.particles(i);
 		}
-		const LaserRecord* s=dynamic_cast<const LaserRecord*>(*it);
-		if (s){
-			beams=s->readings.size();
+		if (rl.type(i)==IndexedRecordList::Laser){
+			LaserRecord* s=dynamic_cast<LaserRecord*>(rl.record(i));
+			if (s)
+				beams=s->readings.size();
+			delete s;
 		}
 		if (particles && beams)
 			break;
@@ -152,51 +187,80 @@ int main(int argc, char** argv){
 	unsigned int frame=0;
 	int scanCount=0;
 	
-	for (RecordList::const_iterator it=rl.begin(); it!=rl.end(); it++){
-		const ScanMatchRecord* s=dynamic_cast<const ScanMatchRecord*>(*it);
-		if (!s) 
+	//the map of the path rendered last. When the best path of a frame shares a prefix with it,
+	//only the following scans are registered, starting from the last checkpoint in the prefix
+	ScanMatcherMap smap(center, xmin, ymin, xmax, ymax, delta);
+	std::vector<IndexedRecordList::PathStep> rendered, path;
+	std::vector<MapCheckpoint> checkpoints;
+	unsigned int checkpointInterval=checkpointSteps>0?checkpointSteps:1;
+	
+	for (size_t it=0; it<rl.size(); it++){
+		if (rl.type(it)!=IndexedRecordList::ScanMatch) 
 			continue;
 		scanCount++;
 		if (scanCount%scanSkip)
 			continue;
 		cout << "Frame " << frame << " ";
-		std::vector<RecordList> paths(particles);
+		//the weights of all the particles in one pass, only the path of the best one is built.
+		//Both index the particles after the last resample before the frame, as RecordList does
+		std::vector<double> weights=rl.getLogWeights(it);
 		int bestIdx=0;
-		double bestWeight=-MAXDOUBLE;
-		for (int p=0; p<particles; p++){
-			paths[p]=rl.computePath(p,it);
-			double w=rl.getLogWeight(p,it);
-			if (w>bestWeight){
-				bestWeight=w;
+		double bestWeight=weights.empty()?0:-MAXDOUBLE;
+		for (unsigned int p=0; p<weights.size(); p++){
+			if (weights[p]>bestWeight){
+				bestWeight=weights[p];
 				bestIdx=p;
 			}
 		}
+		rl.computePath(bestIdx, it, path);
 		cout << "bestIdx=" << bestIdx << " bestWeight=" << bestWeight << endl;
 		
 		cout << "computing best map" << endl;
-		ScanMatcherMap smap(center, xmin, ymin, xmax, ymax, delta);
+		unsigned int common=0;
+		if (!rebuild)
+			while (common<rendered.size() && common<path.size() && rendered[common]==path[common])
+				common++;
+		unsigned int start=common;
+		if (common<rendered.size()){
+			//the best path diverged, the map is restored from the last checkpoint before the divergence
+			while (!checkpoints.empty() && checkpoints.back().steps>common)
+				checkpoints.pop_back();
+			if (checkpoints.empty()){
+				smap=ScanMatcherMap(center, xmin, ymin, xmax, ymax, delta);
+				start=0;
+			} else {
+				smap=checkpoints.back().map;
+				start=checkpoints.back().steps;
+			}
+		}
 		int count=0;
-		for (RecordList::const_iterator mt=paths[bestIdx].begin(); mt!=paths[bestIdx].end(); mt++){
-			const LaserRecord* s=dynamic_cast<const LaserRecord*>(*mt);
-			if (s){
-				double rawreadings[MAX_LASER_BEAMS];
-				for (uint i=0; i<s->readings.size(); i++)
-					rawreadings[i]=s->readings[i];
-				matcher.invalidateActiveArea();
-				matcher.computeActiveArea(smap, s->pose, rawreadings);
-//				matcher.allocActiveArea(smap, s->pose, rawreadings);
-				matcher.registerScan(smap, s->pose, rawreadings);
-				count++;
+		for (unsigned int i=start; i<path.size(); i++){
+			registerScan(matcher, smap, rl, path[i]);
+			count++;
+			if (!rebuild && (i+1)%checkpointInterval==0 && (checkpoints.empty() || checkpoints.back().steps<i+1)){
+				checkpoints.push_back(MapCheckpoint(i+1, smap));
+				//too many copies, every other one is dropped and the interval doubled
+				if (maxCheckpoints>0 && checkpoints.size()>(size_t)maxCheckpoints){
+					std::vector<MapCheckpoint> kept;
+					checkpointInterval*=2;
+					for (std::vector<MapCheckpoint>::const_iterator c=checkpoints.begin(); c!=checkpoints.end(); c++)
+						if (c->steps%checkpointInterval==0)
+							kept.push_back(*c);
+					checkpoints.swap(kept);
+				}
 			}
 		}
-		cout << "DONE " << count <<endl;
+		rendered.swap(path);
+		cout << "DONE " << count << " registered, " << start << " reused" <<endl;
 
+		//read only, the cells that were never visited are not allocated
+		const ScanMatcherMap& cmap=smap;
 		QPixmap pixmap(smap.getMapSizeX(), smap.getMapSizeY());
 		pixmap.fill(QColor(200, 200, 255));
 		QPainter painter(&pixmap);
 		for (int x=0; x<smap.getMapSizeX(); x++)
 			for (int y=0; y<smap.getMapSizeY(); y++){
-				double v=smap.cell(x,y);
+				double v=cmap.cell(x,y);
 				if (v>=0){
 					int grayValue=255-(int)(255.*v);
 					painter.setPen(QColor(grayValue, grayValue, grayValue));
@@ -241,7 +305,6 @@ int main(int argc, char** argv){
 				first=false;
 			}
 		}	
-		paths[bestIdx].destroyReferences();;
 		*/
 		cout << " DONE" << endl;
 		cout << "writing image" << endl;
@@ -20,10 +20,9 @@
  *****************************************************************/
 
 
+#include <sstream>
 #include "gmapping/gui/gsp_thread.h"
-#include <gmapping/utils/commandline.h>
 #include <gmapping/utils/stat.h>
-#include <gmapping/configfile/configfile.h>
 
 #ifdef CARMEN_SUPPORT
 	#include <gmapping/carmenwrapper/carmenwrapper.h>
@@ -36,114 +35,13 @@ using namespace std;
 int GridSlamProcessorThread::init(int argc, const char * const * argv){
 	m_argc=argc;
 	m_argv=argv;
-	std::string configfilename;
-	std::string ebuf="not_set";
-
-	CMD_PARSE_BEGIN_SILENT(1,argc);
-		parseStringSilent("-cfg",configfilename);
-	CMD_PARSE_END_SILENT;
-
-	if (configfilename.length()>0){
-	  ConfigFile cfg(configfilename);
-
-	  filename = (std::string) cfg.value("gfs","filename",filename);
-	  outfilename = (std::string) cfg.value("gfs","outfilename",outfilename);
-	  xmin = cfg.value("gfs","xmin", xmin);
-	  xmax = cfg.value("gfs","xmax",xmax);
-	  ymin = cfg.value("gfs","ymin",ymin);
-	  ymax = cfg.value("gfs","ymax",ymax);
-	  delta =  cfg.value("gfs","delta",delta);
-	  maxrange = cfg.value("gfs","maxrange",maxrange);
-	  maxUrange = cfg.value("gfs","maxUrange",maxUrange);
-	  regscore = cfg.value("gfs","regscore",regscore);
-	  critscore = cfg.value("gfs","critscore",critscore);
-	  kernelSize = cfg.value("gfs","kernelSize",kernelSize);
-	  sigma = cfg.value("gfs","sigma",sigma);
-	  iterations = cfg.value("gfs","iterations",iterations);
-	  lstep = cfg.value("gfs","lstep",lstep);
-	  astep = cfg.value("gfs","astep",astep);
-	  maxMove = cfg.value("gfs","maxMove",maxMove);
-	  srr = cfg.value("gfs","srr", srr);
-	  srt = cfg.value("gfs","srt", srt);
-	  str = cfg.value("gfs","str", str);
-	  stt = cfg.value("gfs","stt", stt);
-	  particles = cfg.value("gfs","particles",particles);
-	  angularUpdate = cfg.value("gfs","angularUpdate", angularUpdate);
-	  linearUpdate = cfg.value("gfs","linearUpdate", linearUpdate);
-	  lsigma = cfg.value("gfs","lsigma", lsigma);
-	  ogain = cfg.value("gfs","lobsGain", ogain);
-	  lskip = (int)cfg.value("gfs","lskip", lskip);
-	  mapUpdateTime = cfg.value("gfs","mapUpdate", mapUpdateTime);
-	  randseed = cfg.value("gfs","randseed", randseed);
-	  autosize = cfg.value("gfs","autosize", autosize);
-	  readFromStdin = cfg.value("gfs","stdin", readFromStdin);
-	  resampleThreshold = cfg.value("gfs","resampleThreshold", resampleThreshold);
-	  skipMatching = cfg.value("gfs","skipMatching", skipMatching);
-	  onLine = cfg.value("gfs","onLine", onLine);
-	  generateMap = cfg.value("gfs","generateMap", generateMap);
-	  m_minimumScore = cfg.value("gfs","minimumScore", m_minimumScore);
-	  llsamplerange = cfg.value("gfs","llsamplerange", llsamplerange);
-	  lasamplerange = cfg.value("gfs","lasamplerange",lasamplerange );
-	  llsamplestep = cfg.value("gfs","llsamplestep", llsamplestep);
-	  lasamplestep = cfg.value("gfs","lasamplestep", lasamplestep);
-	  linearOdometryReliability = cfg.value("gfs","linearOdometryReliability",linearOdometryReliability);
-	  angularOdometryReliability = cfg.value("gfs","angularOdometryReliability",angularOdometryReliability);
-	  ebuf = (std::string) cfg.value("gfs","estrategy", ebuf);
-	  considerOdometryCovariance = cfg.value("gfs","considerOdometryCovariance",considerOdometryCovariance);
-	  
-	}
-
-
-	CMD_PARSE_BEGIN(1,argc);
-          	parseString("-cfg",configfilename);     /* to avoid the warning*/
-		parseString("-filename",filename);
-		parseString("-outfilename",outfilename);
-		parseDouble("-xmin",xmin);
-		parseDouble("-xmax",xmax);
-		parseDouble("-ymin",ymin);
-		parseDouble("-ymax",ymax);
-		parseDouble("-delta",delta);
-		parseDouble("-maxrange",maxrange);
-		parseDouble("-maxUrange",maxUrange);
-		parseDouble("-regscore",regscore);
-		parseDouble("-critscore",critscore);
-		parseInt("-kernelSize",kernelSize);
-		parseDouble("-sigma",sigma);
-		parseInt("-iterations",iterations);
-		parseDouble("-lstep",lstep);
-		parseDouble("-astep",astep);
-		parseDouble("-maxMove",maxMove);
-		parseDouble("-srr", srr);
-		parseDouble("-srt", srt);
-		parseDouble("-str", str);
-		parseDouble("-stt", stt);
-		parseInt("-particles",particles);
-		parseDouble("-angularUpdate", angularUpdate);
-		parseDouble("-linearUpdate", linearUpdate);
-		parseDouble("-lsigma", lsigma);
-		parseDouble("-lobsGain", ogain);
-		parseInt("-lskip", lskip);
-		parseInt("-mapUpdate", mapUpdateTime);
-		parseInt("-randseed", randseed);
-		parseFlag("-autosize", autosize);
-		parseFlag("-stdin", readFromStdin);
-		parseDouble("-resampleThreshold", resampleThreshold);
-		parseFlag("-skipMatching", skipMatching);
-		parseFlag("-onLine", onLine);
-		parseFlag("-generateMap", generateMap);
-		parseDouble("-minimumScore", m_minimumScore);
-		parseDouble("-llsamplerange", llsamplerange);
-		parseDouble("-lasamplerange", lasamplerange);
-		parseDouble("-llsamplestep", llsamplestep);
-		parseDouble("-lasamplestep", lasamplestep);
-		parseDouble("-linearOdometryReliability",linearOdometryReliability);
-		parseDouble("-angularOdometryReliability",angularOdometryReliability);
-		parseString("-estrategy", ebuf);
-		
-		parseFlag("-considerOdometryCovariance",considerOdometryCovariance);
-	CMD_PARSE_END;
+	bool haveLog=parse(argc, argv);
 	
-	if (filename.length() <=0){
+	//quiet, error, warning, info or debug
+	if (logLevel.length()>0)
+		Log::setLevel(Log::parseLevel(logLevel.c_str(), Log::level()));
+	
+	if (! haveLog){
 		cout << "no filename specified" << endl;
 		return -1;
 	}
@@ -175,6 +73,14 @@ int GridSlamProcessorThread::loadFiles(const char * fn){
 		delete input;
 	
 	if (! readFromStdin){
+		//the binary logs are mapped, the text ones parsed line by line
+		BinarySensorStream* binary=new BinarySensorStream(sensorMap, filename.c_str());
+		if (binary->isOpen()){
+			input=binary;
+			cout << "Binary Stream opened, readings=" << binary->size() << endl;
+			return 0;
+		}
+		delete binary;
 		plainStream.open(filename.c_str());
 		input=new InputSensorStream(sensorMap, plainStream);
 		cout << "Plain Stream opened="<< (bool) plainStream << endl;
@@ -186,43 +92,7 @@ int GridSlamProcessorThread::loadFiles(const char * fn){
 }	
 
 GridSlamProcessorThread::GridSlamProcessorThread(): GridSlamProcessor(cerr){
-	//This are the processor parameters
-	filename="";
-	outfilename="";
-	xmin=-100.;
-	ymin=-100.;
-	xmax=100.;
-	ymax=100.;
-	delta=0.05;
-	
-	//scan matching parameters
-	sigma=0.05;
-	maxrange=80.;
-	maxUrange=80.;
-	regscore=1e4;
-	lstep=.05;
-	astep=.05;
-	kernelSize=1;
-	iterations=5;
-	critscore=0.;
-	maxMove=1.;
-	lsigma=.075;
-	ogain=3;
-	lskip=0;
-	autosize=false;
-	skipMatching=false;
-
-	//motion model parameters
-	srr=0.1, srt=0.1, str=0.1, stt=0.1;
-	//particle parameters
-	particles=30;
-	randseed=0;
-	
-	//gfs parameters
-	angularUpdate=0.5;
-	linearUpdate=1;
-	resampleThreshold=0.5;
-	
+	//the processor parameters are the defaults of GFSParameters
 	input=0;
 	
 	pthread_mutex_init(&hp_mutex,0);
@@ -230,38 +100,7 @@ GridSlamProcessorThread::GridSlamProcessorThread(): GridSlamProcessor(cerr){
 	pthread_mutex_init(&hist_mutex,0);
 	running=false;
 	eventBufferLength=0;
-	mapUpdateTime=5;
 	mapTimer=0;
-	readFromStdin=false;
-	onLine=false;
-	generateMap=false;
-
-	// This  are the dafault settings for a grid map of 5 cm
-	llsamplerange=0.01;
-	llsamplestep=0.01;
-	lasamplerange=0.005;
-	lasamplestep=0.005;
-	linearOdometryReliability=0.;
-	angularOdometryReliability=0.;
-	
-	considerOdometryCovariance=false;
-/*	
-	// This  are the dafault settings for a grid map of 10 cm
-	m_llsamplerange=0.1;
-	m_llsamplestep=0.1;
-	m_lasamplerange=0.02;
-	m_lasamplestep=0.01;
-*/	
-	// This  are the dafault settings for a grid map of 20/25 cm
-/*
-	m_llsamplerange=0.2;
-	m_llsamplestep=0.1;
-	m_lasamplerange=0.02;
-	m_lasamplestep=0.01;
-	m_generateMap=false;
-*/
-
-			
 }
 
 GridSlamProcessorThread::~GridSlamProcessorThread(){
@@ -303,7 +142,7 @@ void * GridSlamProcessorThread::fastslamthread(GridSlamProcessorThread* gpt){
 #endif
 	
 	gpt->setSensorMap(gpt->sensorMap);
-	gpt->setMatchingParameters(gpt->maxUrange, gpt->maxrange, gpt->sigma, gpt->kernelSize, gpt->lstep, gpt->astep, gpt->iterations, gpt->lsigma, gpt->ogain, gpt->lskip);
+	gpt->configure(*gpt);
 	
 	double xmin=gpt->xmin, 
 	       ymin=gpt->ymin, 
@@ -316,9 +155,7 @@ void * GridSlamProcessorThread::fastslamthread(GridSlamProcessorThread* gpt){
 		if (gpt->readFromStdin || gpt->onLine)
 		cout << "Error, cant autosize form stdin" << endl;
 		SensorLog * log=new SensorLog(gpt->sensorMap);
-		ifstream is(gpt->filename.c_str());
-		log->load(is);
-		is.close();
+		log->load(gpt->filename.c_str());
 		initialPose=gpt->boundingBox(log, xmin, ymin, xmax, ymax);
 		delete log;
 	}
@@ -327,23 +164,23 @@ void * GridSlamProcessorThread::fastslamthread(GridSlamProcessorThread* gpt){
 		gpt->infoStream() << " initialPose=" << initialPose.x << " " << initialPose.y << " " << initialPose.theta
 				<< cout << " xmin=" << xmin <<" ymin=" << ymin <<" xmax=" << xmax <<" ymax=" << ymax << endl;
 	}
-	gpt->setMotionModelParameters(gpt->srr, gpt->srt, gpt->str, gpt->stt);
-	gpt->setUpdateDistances(gpt->linearUpdate, gpt->angularUpdate, gpt->resampleThreshold);
-	gpt->setgenerateMap(gpt->generateMap);
-	gpt->GridSlamProcessor::init(gpt->particles, xmin, ymin, xmax, ymax, gpt->delta, initialPose);
-	gpt->setllsamplerange(gpt->llsamplerange);
-	gpt->setllsamplestep(gpt->llsamplestep);
-	gpt->setlasamplerange(gpt->llsamplerange);
-	gpt->setlasamplestep(gpt->llsamplestep);
+	gpt->initialize(*gpt, xmin, ymin, xmax, ymax, initialPose);
 	
 #define printParam(n)\
-	 gpt->outputStream() \
-	 << "PARAM " << \
+	{ \
+	 ostringstream line; \
+	 line << "PARAM " << \
 	 #n \
-	 << " " << gpt->n << endl
+	 << " " << gpt->n; \
+	 gpt->writeOutputLine(line.str()); \
+	}
 	
 	if (gpt->outfilename.length()>0 ){
-		gpt->outputStream().open(gpt->outfilename.c_str());
+		if (gpt->m_binaryOutput)
+			gpt->outputStream().open(gpt->outfilename.c_str(), ios::out|ios::binary);
+		else
+			gpt->outputStream().open(gpt->outfilename.c_str());
+		gpt->outputWriter().reset();
 		printParam(filename);
 		printParam(outfilename);
 		printParam(xmin);
@@ -377,6 +214,11 @@ void * GridSlamProcessorThread::fastslamthread(GridSlamProcessorThread* gpt){
 		//particle parameters
 		printParam(particles);
 		printParam(randseed);
+		printParam(m_matchingThreads);
+		printParam(m_lazyRegistration);
+		printParam(m_binaryOutput);
+		printParam(m_asyncOutput);
+		printParam(m_odometryOutputPeriod);
 		
 		//gfs parameters
 		printParam(angularUpdate);
@@ -26,6 +26,7 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
 #include <gmapping/configfile/configfile_export.h>
 
 namespace GMapping{
@@ -65,6 +66,7 @@ private:
 
 class CONFIGFILE_EXPORT ConfigFile {
   std::map<std::string,AutoVal> m_content;
+  std::vector<std::string> m_sections;
   
 public:
   ConfigFile();
@@ -104,6 +106,9 @@ public:
   
   void dumpValues(std::ostream& out);
 
+  /** the names of the sections read, in the order of the file */
+  const std::vector<std::string>& sections() const {return m_sections;}
+
 
  protected:
   std::string trim(const std::string& source, char const* delims = " \t\r\n") const;
@@ -2,19 +2,41 @@
 #define ARRAY2D_H
 
 #include <assert.h>
+#include <string.h>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
 #include <gmapping/utils/point.h>
 #include "gmapping/grid/accessstate.h"
+#include "gmapping/grid/patchpool.h"
 
 #include <iostream>
 
 namespace GMapping {
 
+/**Alignment of the cell buffer of Array2D, a cache line.*/
+#define ARRAY2D_ALIGNMENT 64
+
+/**A rectangular grid of cells.
+The cells are stored in a single contiguous, aligned buffer, column after
+column, so that cell (x,y) is at m_cells[x*m_ysize+y]. Trivially copyable
+cells are copied in bulk.
+If a pool is given the buffer is taken from it whenever it fits in a block
+of the pool; the copies of the array share the pool of the original.*/
 template<class Cell, const bool debug=false> class Array2D{
 	public:
-		Array2D(int xsize=0, int ysize=0);
+		Array2D(int xsize=0, int ysize=0, PatchPool* pool=0);
 		Array2D& operator=(const Array2D &);
 		Array2D(const Array2D<Cell,debug> &);
+		/**moves take over the cell buffer, leaving the source empty*/
+		Array2D(Array2D<Cell,debug> &&);
+		Array2D& operator=(Array2D &&);
 		~Array2D();
+		/**the arrays created on the heap, the patches of HierarchicalArray2D, take their
+		header from a pool; the derived classes go through the heap*/
+		static void* operator new(std::size_t size);
+		static void operator delete(void* p, std::size_t size);
 		void clear();
 		void resize(int xmin, int ymin, int xmax, int ymax);
 		
@@ -33,23 +55,122 @@ template<class Cell, const bool debug=false> class Array2D{
 		inline int getPatchMagnitude() const{return 0;}
 		inline int getXSize() const {return m_xsize;}
 		inline int getYSize() const {return m_ysize;}
-		inline Cell** cells() {return m_cells;}
-		Cell ** m_cells;
+		inline Cell* cells() {return m_cells;}
+		inline const Cell* cells() const {return m_cells;}
+		Cell * m_cells;
 	protected:
 		int m_xsize, m_ysize;
+		PatchPool* m_pool;
+		inline bool usesPool(int size) const { return m_pool && sizeof(Cell)*size<=m_pool->getBlockSize(); }
+		Cell* allocCells(int size) const;
+		Cell* createCells(int size) const;
+		Cell* copyCells(const Cell* src, int size) const;
+		void destroyCells(Cell* cells, int size) const;
+		static void assignCells(Cell* dest, const Cell* src, int size);
+		static void moveCells(Cell* dest, Cell* src, int size);
 };
 
+/**Allocates uninitialized storage for size cells, aligned to ARRAY2D_ALIGNMENT.
+Outside of the pool, the pointer returned by operator new is kept right
+before the aligned block.*/
+template <class Cell, const bool debug>
+Cell* Array2D<Cell,debug>::allocCells(int size) const{
+	if (size<=0)
+		return 0;
+	if (usesPool(size))
+		return static_cast<Cell*>(m_pool->allocate());
+	char* raw=static_cast<char*>(::operator new(sizeof(Cell)*size+ARRAY2D_ALIGNMENT+sizeof(void*)));
+	std::size_t address=reinterpret_cast<std::size_t>(raw+sizeof(void*));
+	char* aligned=raw+sizeof(void*)+((ARRAY2D_ALIGNMENT-address%ARRAY2D_ALIGNMENT)%ARRAY2D_ALIGNMENT);
+	reinterpret_cast<void**>(aligned)[-1]=raw;
+	return reinterpret_cast<Cell*>(aligned);
+}
+
+template <class Cell, const bool debug>
+void* Array2D<Cell,debug>::operator new(std::size_t size){
+	if (size!=sizeof(Array2D))
+		return ::operator new(size);
+	static PatchPool* pool=PatchPool::instance(sizeof(Array2D));
+	return pool->allocate();
+}
+
+template <class Cell, const bool debug>
+void Array2D<Cell,debug>::operator delete(void* p, std::size_t size){
+	if (!p)
+		return;
+	if (size!=sizeof(Array2D)){
+		::operator delete(p);
+		return;
+	}
+	static PatchPool* pool=PatchPool::instance(sizeof(Array2D));
+	pool->release(p);
+}
+
+template <class Cell, const bool debug>
+Cell* Array2D<Cell,debug>::createCells(int size) const{
+	Cell* cells=allocCells(size);
+	for (int i=0; i<size; i++)
+		new (cells+i) Cell();
+	return cells;
+}
+
+template <class Cell, const bool debug>
+Cell* Array2D<Cell,debug>::copyCells(const Cell* src, int size) const{
+	Cell* cells=allocCells(size);
+	if (std::is_trivially_copyable<Cell>::value){
+		if (size>0)
+			memcpy(static_cast<void*>(cells), src, sizeof(Cell)*size);
+	} else {
+		for (int i=0; i<size; i++)
+			new (cells+i) Cell(src[i]);
+	}
+	return cells;
+}
+
+template <class Cell, const bool debug>
+void Array2D<Cell,debug>::destroyCells(Cell* cells, int size) const{
+	if (!cells)
+		return;
+	if (!std::is_trivially_destructible<Cell>::value)
+		for (int i=0; i<size; i++)
+			cells[i].~Cell();
+	if (usesPool(size))
+		m_pool->release(cells);
+	else
+		::operator delete(reinterpret_cast<void**>(cells)[-1]);
+}
+
+template <class Cell, const bool debug>
+void Array2D<Cell,debug>::assignCells(Cell* dest, const Cell* src, int size){
+	if (std::is_trivially_copyable<Cell>::value){
+		if (size>0)
+			memcpy(static_cast<void*>(dest), src, sizeof(Cell)*size);
+	} else {
+		for (int i=0; i<size; i++)
+			dest[i]=src[i];
+	}
+}
+
+template <class Cell, const bool debug>
+void Array2D<Cell,debug>::moveCells(Cell* dest, Cell* src, int size){
+	if (std::is_trivially_copyable<Cell>::value){
+		if (size>0)
+			memcpy(static_cast<void*>(dest), src, sizeof(Cell)*size);
+	} else {
+		for (int i=0; i<size; i++)
+			dest[i]=std::move(src[i]);
+	}
+}
 
 template <class Cell, const bool debug>
-Array2D<Cell,debug>::Array2D(int xsize, int ysize){
+Array2D<Cell,debug>::Array2D(int xsize, int ysize, PatchPool* pool){
 //	assert(xsize>0);
 //	assert(ysize>0);
+	m_pool=pool;
 	m_xsize=xsize;
 	m_ysize=ysize;
 	if (m_xsize>0 && m_ysize>0){
-		m_cells=new Cell*[m_xsize];
-		for (int i=0; i<m_xsize; i++)
-			m_cells[i]=new Cell[m_ysize];
+		m_cells=createCells(m_xsize*m_ysize);
 	}
 	else{
 		m_xsize=m_ysize=0;
@@ -64,19 +185,16 @@ Array2D<Cell,debug>::Array2D(int xsize, int ysize){
 
 template <class Cell, const bool debug>
 Array2D<Cell,debug> & Array2D<Cell,debug>::operator=(const Array2D<Cell,debug> & g){
+	if (this==&g)
+		return *this;
 	if (debug || m_xsize!=g.m_xsize || m_ysize!=g.m_ysize){
-		for (int i=0; i<m_xsize; i++)
-			delete [] m_cells[i];
-		delete [] m_cells;
+		destroyCells(m_cells, m_xsize*m_ysize);
 		m_xsize=g.m_xsize;
 		m_ysize=g.m_ysize;
-		m_cells=new Cell*[m_xsize];
-		for (int i=0; i<m_xsize; i++)
-			m_cells[i]=new Cell[m_ysize];
+		m_cells=copyCells(g.m_cells, m_xsize*m_ysize);
+	} else {
+		assignCells(m_cells, g.m_cells, m_xsize*m_ysize);
 	}
-	for (int x=0; x<m_xsize; x++)
-		for (int y=0; y<m_ysize; y++)
-			m_cells[x][y]=g.m_cells[x][y];
 	
 	if (debug){
 		std::cerr << __func__ << std::endl;
@@ -88,14 +206,10 @@ Array2D<Cell,debug> & Array2D<Cell,debug>::operator=(const Array2D<Cell,debug> &
 
 template <class Cell, const bool debug>
 Array2D<Cell,debug>::Array2D(const Array2D<Cell,debug> & g){
+	m_pool=g.m_pool;
 	m_xsize=g.m_xsize;
 	m_ysize=g.m_ysize;
-	m_cells=new Cell*[m_xsize];
-	for (int x=0; x<m_xsize; x++){
-		m_cells[x]=new Cell[m_ysize];
-		for (int y=0; y<m_ysize; y++)
-			m_cells[x][y]=g.m_cells[x][y];
-	}
+	m_cells=copyCells(g.m_cells, m_xsize*m_ysize);
 	if (debug){
 		std::cerr << __func__ << std::endl;
 		std::cerr << "m_xsize= " << m_xsize<< std::endl;
@@ -103,6 +217,30 @@ Array2D<Cell,debug>::Array2D(const Array2D<Cell,debug> & g){
 	}
 }
 
+template <class Cell, const bool debug>
+Array2D<Cell,debug>::Array2D(Array2D<Cell,debug> && g){
+	m_pool=g.m_pool;
+	m_xsize=g.m_xsize;
+	m_ysize=g.m_ysize;
+	m_cells=g.m_cells;
+	g.m_cells=0;
+	g.m_xsize=g.m_ysize=0;
+}
+
+template <class Cell, const bool debug>
+Array2D<Cell,debug> & Array2D<Cell,debug>::operator=(Array2D<Cell,debug> && g){
+	if (this==&g)
+		return *this;
+	destroyCells(m_cells, m_xsize*m_ysize);
+	m_pool=g.m_pool;
+	m_xsize=g.m_xsize;
+	m_ysize=g.m_ysize;
+	m_cells=g.m_cells;
+	g.m_cells=0;
+	g.m_xsize=g.m_ysize=0;
+	return *this;
+}
+
 template <class Cell, const bool debug>
 Array2D<Cell,debug>::~Array2D(){
   if (debug){
@@ -110,11 +248,7 @@ Array2D<Cell,debug>::~Array2D(){
 	std::cerr << "m_xsize= " << m_xsize<< std::endl;
 	std::cerr << "m_ysize= " << m_ysize<< std::endl;
   }
-  for (int i=0; i<m_xsize; i++){
-    delete [] m_cells[i];
-    m_cells[i]=0;
-  }
-  delete [] m_cells;
+  destroyCells(m_cells, m_xsize*m_ysize);
   m_cells=0;
 }
 
@@ -125,11 +259,7 @@ void Array2D<Cell,debug>::clear(){
 	std::cerr << "m_xsize= " << m_xsize<< std::endl;
 	std::cerr << "m_ysize= " << m_ysize<< std::endl;
   }
-  for (int i=0; i<m_xsize; i++){
-    delete [] m_cells[i];
-    m_cells[i]=0;
-  }
-  delete [] m_cells;
+  destroyCells(m_cells, m_xsize*m_ysize);
   m_cells=0;
   m_xsize=0;
   m_ysize=0;
@@ -140,21 +270,15 @@ template <class Cell, const bool debug>
 void Array2D<Cell,debug>::resize(int xmin, int ymin, int xmax, int ymax){
 	int xsize=xmax-xmin;
 	int ysize=ymax-ymin;
-	Cell ** newcells=new Cell *[xsize];
-	for (int x=0; x<xsize; x++){
-		newcells[x]=new Cell[ysize];
-	}
+	Cell * newcells=createCells(xsize*ysize);
 	int dx= xmin < 0 ? 0 : xmin;
 	int dy= ymin < 0 ? 0 : ymin;
 	int Dx=xmax<this->m_xsize?xmax:this->m_xsize;
 	int Dy=ymax<this->m_ysize?ymax:this->m_ysize;
 	for (int x=dx; x<Dx; x++){
-		for (int y=dy; y<Dy; y++){
-			newcells[x-xmin][y-ymin]=this->m_cells[x][y];
-		}
-		delete [] this->m_cells[x];
+		moveCells(newcells+(x-xmin)*ysize+(dy-ymin), this->m_cells+x*this->m_ysize+dy, Dy-dy);
 	}
-	delete [] this->m_cells;
+	destroyCells(this->m_cells, this->m_xsize*this->m_ysize);
 	this->m_cells=newcells;
 	this->m_xsize=xsize;
 	this->m_ysize=ysize; 
@@ -168,17 +292,16 @@ inline bool Array2D<Cell,debug>::isInside(int x, int y) const{
 template <class Cell, const bool debug>
 inline const Cell& Array2D<Cell,debug>::cell(int x, int y) const{
 	assert(isInside(x,y));
-	return m_cells[x][y];
+	return m_cells[x*m_ysize+y];
 }
 
 
 template <class Cell, const bool debug>
 inline Cell& Array2D<Cell,debug>::cell(int x, int y){
 	assert(isInside(x,y));
-	return m_cells[x][y];
+	return m_cells[x*m_ysize+y];
 }
 
 };
 
 #endif
-
@@ -0,0 +1,203 @@
+#ifndef PATCHPOOL_H
+#define PATCHPOOL_H
+#include <assert.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace GMapping {
+
+/**Fixed size block allocator for the cell buffers of the map patches.
+The blocks are carved out of large slabs and recycled through a free list,
+so that cloning and releasing patches does not go through malloc once the
+filter reached its working set, and the heap does not get fragmented by
+the patches.
+Every thread keeps a small cache of free blocks for each pool; the shared
+free list is locked only to refill or to drain the cache.
+There is one pool for each block size in the process. The pools are never
+destroyed: the patches are shared among the maps of different particles and
+may outlive the map which created them.*/
+class PatchPool{
+	public:
+		/**occupancy of a pool, in blocks*/
+		struct Stats{
+			std::size_t blockSize;
+			std::size_t capacity;
+			std::size_t inUse;
+			std::size_t highWater;
+			std::size_t slabs;
+		};
+		enum {Alignment=64, SlabBlocks=64, CacheBlocks=32, MaxPools=16};
+
+		static inline PatchPool* instance(std::size_t blockSize);
+		inline std::size_t getBlockSize() const {return m_blockSize;}
+		inline void* allocate();
+		inline void release(void* block);
+		inline Stats stats() const;
+	protected:
+		struct FreeBlock{
+			FreeBlock* next;
+		};
+		struct ThreadCache{
+			inline ThreadCache();
+			inline ~ThreadCache();
+			void* blocks[MaxPools][CacheBlocks];
+			unsigned int count[MaxPools];
+		};
+		inline PatchPool(std::size_t blockSize, unsigned int id);
+		static inline std::vector<PatchPool*>& pools();
+		static inline std::mutex& registryMutex();
+		static inline ThreadCache& threadCache();
+		inline void refill(ThreadCache& cache);
+		inline void drain(ThreadCache& cache, unsigned int n);
+		inline void addSlab();
+		inline void updateHighWater(std::size_t inUse);
+
+		std::size_t m_blockSize;
+		unsigned int m_id;
+		mutable std::mutex m_mutex;
+		FreeBlock* m_free;
+		std::size_t m_capacity;
+		std::vector<char*> m_slabs;
+		std::atomic<std::size_t> m_inUse;
+		std::atomic<std::size_t> m_highWater;
+};
+
+PatchPool::PatchPool(std::size_t blockSize, unsigned int id){
+	m_blockSize=(blockSize+Alignment-1)/Alignment*Alignment;
+	m_id=id;
+	m_free=0;
+	m_capacity=0;
+	m_inUse=0;
+	m_highWater=0;
+}
+
+std::vector<PatchPool*>& PatchPool::pools(){
+	static std::vector<PatchPool*> p;
+	return p;
+}
+
+std::mutex& PatchPool::registryMutex(){
+	static std::mutex m;
+	return m;
+}
+
+PatchPool* PatchPool::instance(std::size_t blockSize){
+	std::lock_guard<std::mutex> lock(registryMutex());
+	std::vector<PatchPool*>& p=pools();
+	std::size_t size=(blockSize+Alignment-1)/Alignment*Alignment;
+	for (unsigned int i=0; i<p.size(); i++)
+		if (p[i]->m_blockSize==size)
+			return p[i];
+	p.push_back(new PatchPool(size, p.size()));
+	return p.back();
+}
+
+PatchPool::ThreadCache::ThreadCache(){
+	for (unsigned int i=0; i<MaxPools; i++)
+		count[i]=0;
+}
+
+/**gives the cached blocks back to the pools when the thread exits*/
+PatchPool::ThreadCache::~ThreadCache(){
+	std::lock_guard<std::mutex> lock(registryMutex());
+	std::vector<PatchPool*>& p=pools();
+	for (unsigned int i=0; i<MaxPools && i<p.size(); i++)
+		if (count[i])
+			p[i]->drain(*this, count[i]);
+}
+
+PatchPool::ThreadCache& PatchPool::threadCache(){
+	static thread_local ThreadCache cache;
+	return cache;
+}
+
+void PatchPool::addSlab(){
+	char* raw=static_cast<char*>(::operator new(m_blockSize*SlabBlocks+Alignment));
+	m_slabs.push_back(raw);
+	std::size_t address=reinterpret_cast<std::size_t>(raw);
+	char* block=raw+(Alignment-address%Alignment)%Alignment;
+	for (unsigned int i=0; i<SlabBlocks; i++, block+=m_blockSize){
+		FreeBlock* f=reinterpret_cast<FreeBlock*>(block);
+		f->next=m_free;
+		m_free=f;
+	}
+	m_capacity+=SlabBlocks;
+}
+
+/**moves half a cache worth of blocks from the free list to the cache of the thread*/
+void PatchPool::refill(ThreadCache& cache){
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned int& count=cache.count[m_id];
+	while (count<CacheBlocks/2){
+		if (!m_free)
+			addSlab();
+		cache.blocks[m_id][count++]=m_free;
+		m_free=m_free->next;
+	}
+}
+
+/**moves the last n blocks of the cache of the thread back to the free list*/
+void PatchPool::drain(ThreadCache& cache, unsigned int n){
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned int& count=cache.count[m_id];
+	for (unsigned int i=0; i<n; i++){
+		FreeBlock* f=static_cast<FreeBlock*>(cache.blocks[m_id][--count]);
+		f->next=m_free;
+		m_free=f;
+	}
+}
+
+void PatchPool::updateHighWater(std::size_t inUse){
+	std::size_t highWater=m_highWater.load(std::memory_order_relaxed);
+	while (inUse>highWater && !m_highWater.compare_exchange_weak(highWater, inUse, std::memory_order_relaxed));
+}
+
+void* PatchPool::allocate(){
+	updateHighWater(m_inUse.fetch_add(1, std::memory_order_relaxed)+1);
+	if (m_id>=MaxPools){
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_free)
+			addSlab();
+		FreeBlock* f=m_free;
+		m_free=f->next;
+		return f;
+	}
+	ThreadCache& cache=threadCache();
+	if (!cache.count[m_id])
+		refill(cache);
+	return cache.blocks[m_id][--cache.count[m_id]];
+}
+
+void PatchPool::release(void* block){
+	assert(block);
+	m_inUse.fetch_sub(1, std::memory_order_relaxed);
+	if (m_id>=MaxPools){
+		std::lock_guard<std::mutex> lock(m_mutex);
+		FreeBlock* f=static_cast<FreeBlock*>(block);
+		f->next=m_free;
+		m_free=f;
+		return;
+	}
+	ThreadCache& cache=threadCache();
+	if (cache.count[m_id]==CacheBlocks)
+		drain(cache, CacheBlocks/2);
+	cache.blocks[m_id][cache.count[m_id]++]=block;
+}
+
+PatchPool::Stats PatchPool::stats() const{
+	Stats s;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	s.blockSize=m_blockSize;
+	s.capacity=m_capacity;
+	s.inUse=m_inUse.load(std::memory_order_relaxed);
+	s.highWater=m_highWater.load(std::memory_order_relaxed);
+	s.slabs=m_slabs.size();
+	return s;
+}
+
+};
+
+#endif
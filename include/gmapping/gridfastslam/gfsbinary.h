@@ -0,0 +1,169 @@
+#ifndef GFSBINARY_H
+#define GFSBINARY_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+
+namespace GMapping {
+
+/**The binary encoding of the gfs files. A file starts with the magic "GFSB" and
+a 32 bit version, followed by the records. A record is a 32 bit length of the
+payload, a byte with the type of the record and the payload. All the numbers are
+little endian, poses are stored as floats and weights as doubles.
+The payloads of version 1 are:
+<pre>
+Text            the bytes of a line of the text format (PARAM, COMMENT, ...)
+Odometry        x y theta (float) time (double)                    ODOM
+OdometryUpdate  n (uint32), n times x y theta (float) weight (double), time (double)  ODO_UPDATE
+Frame           reading (uint32) linearDistance angularDistance (double)           FRAME
+Laser           n (uint32), n ranges (float), x y theta (float) time (double)     LASER_READING
+ScanMatchUpdate n (uint32), n times x y theta (float) weight (double)             SM_UPDATE
+Neff            neff (double)                                                      NEFF
+Resample        n (uint32), n indexes (uint32)                                     RESAMPLE
+SimulatorPose   x y theta (float) time (double)                                    SIMULATOR_POS
+</pre>
+Readers skip the records whose type they do not know.*/
+namespace GFSBinary {
+
+enum RecordType {Text=1, Odometry, OdometryUpdate, Frame, Laser, ScanMatchUpdate, Neff, Resample, SimulatorPose};
+
+const uint32_t Version=1;
+/**larger records are taken as a corrupted file*/
+const uint32_t MaxRecordSize=1<<28;
+
+/**writes the magic and the version*/
+inline void writeHeader(std::ostream& os){
+	unsigned char header[8]={'G','F','S','B', Version&0xff, (Version>>8)&0xff, (Version>>16)&0xff, (Version>>24)&0xff};
+	os.write((const char*)header, 8);
+}
+
+/**consumes the header if the stream starts with one.
+   @returns the version of the file, 0 if the stream is not a binary gfs file (nothing is consumed then)*/
+inline uint32_t readHeader(std::istream& is){
+	std::streampos start=is.tellg();
+	unsigned char header[8];
+	if (is.read((char*)header, 8) && !memcmp(header, "GFSB", 4))
+		return header[4]|(header[5]<<8)|(header[6]<<16)|((uint32_t)header[7]<<24);
+	is.clear();
+	is.seekg(start);
+	return 0;
+}
+
+/**Builds a record in memory and writes it at once. The first record is preceded by
+the header of the file; reset() when the output is opened again*/
+class RecordWriter{
+	public:
+		RecordWriter(): m_type(Text), m_headerWritten(false) {}
+		inline void begin(RecordType type) {m_buffer.clear(); m_type=type;}
+		inline void putUInt32(uint32_t v){
+			unsigned char b[4]={(unsigned char)v, (unsigned char)(v>>8), (unsigned char)(v>>16), (unsigned char)(v>>24)};
+			m_buffer.insert(m_buffer.end(), b, b+4);
+		}
+		inline void putFloat(float f){
+			uint32_t v;
+			memcpy(&v, &f, 4);
+			putUInt32(v);
+		}
+		inline void putDouble(double d){
+			uint64_t v;
+			memcpy(&v, &d, 8);
+			putUInt32((uint32_t)v);
+			putUInt32((uint32_t)(v>>32));
+		}
+		inline void putBytes(const char* data, size_t size) {m_buffer.insert(m_buffer.end(), data, data+size);}
+		/**writes the record, preceded by the header of the file if it is the first record since
+		   the construction or the last reset(). The position of os is not used, so that pipes
+		   are written as files*/
+		inline void write(std::ostream& os){
+			if (!m_headerWritten){
+				writeHeader(os);
+				m_headerWritten=true;
+			}
+			uint32_t size=m_buffer.size();
+			unsigned char prefix[5]={(unsigned char)size, (unsigned char)(size>>8), (unsigned char)(size>>16), (unsigned char)(size>>24), (unsigned char)m_type};
+			os.write((const char*)prefix, 5);
+			if (size)
+				os.write(&m_buffer[0], size);
+		}
+		/**the next record starts a new file. With append the records continue a binary file
+		   that already has its header*/
+		inline void reset(bool append=false) {m_headerWritten=append;}
+	protected:
+		RecordType m_type;
+		std::vector<char> m_buffer;
+		bool m_headerWritten;
+};
+
+/**Reads the records one at a time. Reading past the end of a record gives zeros
+and sets the failure flag, so that truncated records are detected*/
+class RecordReader{
+	public:
+		RecordReader(): m_type(0), m_position(0), m_failed(false) {}
+		/**takes a record from memory, e.g. a file mapped in memory*/
+		inline void assign(int type, const char* data, size_t size){
+			m_type=type;
+			m_buffer.assign(data, data+size);
+			m_position=0;
+			m_failed=false;
+		}
+		/**reads the next record, @returns false at the end of the stream or on a truncated record*/
+		inline bool next(std::istream& is){
+			unsigned char prefix[5];
+			if (!is.read((char*)prefix, 5))
+				return false;
+			uint32_t size=prefix[0]|(prefix[1]<<8)|(prefix[2]<<16)|((uint32_t)prefix[3]<<24);
+			m_type=prefix[4];
+			if (size>MaxRecordSize)
+				return false;
+			m_buffer.resize(size);
+			m_position=0;
+			m_failed=false;
+			return !size || is.read(&m_buffer[0], size);
+		}
+		inline int type() const {return m_type;}
+		inline bool failed() const {return m_failed;}
+		inline size_t size() const {return m_buffer.size();}
+		inline uint32_t getUInt32(){
+			if (m_position+4>m_buffer.size()){
+				m_failed=true;
+				return 0;
+			}
+			const unsigned char* b=(const unsigned char*)&m_buffer[m_position];
+			m_position+=4;
+			return b[0]|(b[1]<<8)|(b[2]<<16)|((uint32_t)b[3]<<24);
+		}
+		inline float getFloat(){
+			uint32_t v=getUInt32();
+			float f;
+			memcpy(&f, &v, 4);
+			return f;
+		}
+		inline double getDouble(){
+			uint64_t v=getUInt32();
+			v|=(uint64_t)getUInt32()<<32;
+			double d;
+			memcpy(&d, &v, 8);
+			return d;
+		}
+		/**@returns the rest of the payload as a string*/
+		inline std::string getText(){
+			std::string s(m_buffer.begin()+m_position, m_buffer.end());
+			m_position=m_buffer.size();
+			return s;
+		}
+	protected:
+		int m_type;
+		std::vector<char> m_buffer;
+		size_t m_position;
+		bool m_failed;
+};
+
+}; //end namespace GFSBinary
+
+}; //end namespace GMapping
+
+#endif
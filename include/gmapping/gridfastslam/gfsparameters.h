@@ -0,0 +1,98 @@
+#ifndef GFSPARAMETERS_H
+#define GFSPARAMETERS_H
+
+#include <string>
+#include <gmapping/utils/point.h>
+#include <gmapping/configfile/configfile.h>
+#include <gmapping/gridfastslam/gridfastslam_export.h>
+
+namespace GMapping {
+
+class GridSlamProcessor;
+
+/**The parameters of a run of the filter, as given to gfs_nogui and gfs_simplegui.
+They are read from a section of a config file, [gfs] by default, and from the command
+line, with the same names (e.g. "srr 0.1" in the file and "-srr 0.1" on the command line).
+A section only overrides the entries it contains, so that a configuration can be
+described by its differences from another one.*/
+struct GRIDFASTSLAM_EXPORT GFSParameters{
+	GFSParameters();
+	/**reads the entries of the section of the config file*/
+	void read(ConfigFile& cfg, const std::string& section="gfs");
+	/**reads the section [gfs] of the file given by -cfg, then the rest of the command line.
+	   @returns false if no log file was given*/
+	bool parse(int argc, const char * const * argv);
+	/**sets the matching, motion model and update parameters of the processor, before it is initialized*/
+	void configure(GridSlamProcessor& gsp) const;
+	/**initializes the processor on the given area and sets the parameters that need the initialized matcher*/
+	void initialize(GridSlamProcessor& gsp, double xmin, double ymin, double xmax, double ymax, OrientedPoint initialPose=OrientedPoint(0,0,0)) const;
+
+	std::string filename;
+	std::string outfilename;
+
+	double xmin;
+	double ymin;
+	double xmax;
+	double ymax;
+	bool autosize;
+	double delta;
+	double resampleThreshold;
+
+	//scan matching parameters
+	double sigma;
+	double maxrange;
+	double maxUrange;
+	double regscore;
+	double lstep;
+	double astep;
+	int kernelSize;
+	int iterations;
+	double critscore;
+	double maxMove;
+	unsigned int lskip;
+
+	//likelihood
+	double lsigma;
+	double ogain;
+	double llsamplerange, lasamplerange;
+	double llsamplestep, lasamplestep;
+	double linearOdometryReliability;
+	double angularOdometryReliability;
+
+	//motion model parameters
+	double srr, srt, str, stt;
+	//particle parameters
+	int particles;
+	bool skipMatching;
+
+	//gfs parameters
+	double angularUpdate;
+	double linearUpdate;
+
+	bool readFromStdin;
+	bool onLine;
+	bool generateMap;
+	bool likelihoodField;
+	bool multiResolution;
+	double coarseLinearRange;
+	double coarseAngularRange;
+	bool considerOdometryCovariance;
+	unsigned int randseed;
+	unsigned int mapUpdateTime;
+
+	//processing and output
+	int matchingThreads;
+	bool lazyRegistration;
+	bool binaryOutput;
+	bool asyncOutput;
+	int outputQueueSize;
+	int odometryOutputPeriod;
+	double minimumScore;
+
+	std::string estrategy;
+	std::string logLevel;
+};
+
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <vector>
 #include <list>
+#include <stdint.h>
 #include <gmapping/utils/point.h>
 #include <gmapping/gridfastslam/gridfastslam_export.h>
 
@@ -40,9 +41,11 @@ struct GRIDFASTSLAM_EXPORT PoseRecord: public Record{
 };
 
 struct GRIDFASTSLAM_EXPORT NeffRecord: public Record{
+	NeffRecord(): frame(0) {}
 	void read(istream& is);
 	virtual void write(ostream& os);
 	double neff;
+	unsigned int frame; ///< the reading of the last FRAME before the record
 };
 
 struct GRIDFASTSLAM_EXPORT EntropyRecord: public Record{
@@ -83,9 +86,11 @@ struct GRIDFASTSLAM_EXPORT ResampleRecord: public Record{
 	vector<unsigned int> indexes;
 };
 
+/**The records of a gfs file. read() accepts both the text and the binary (gfsbinary.h) format*/
 struct GRIDFASTSLAM_EXPORT RecordList: public list<Record*>{
 	mutable int sampleSize;
 	istream& read(istream& is);
+	istream& readBinary(istream& is);
 	double getLogWeight(unsigned int i) const;
 	double getLogWeight(unsigned int i, RecordList::const_iterator frame) const;
 	unsigned int getBestIdx() const ;
@@ -95,6 +100,86 @@ struct GRIDFASTSLAM_EXPORT RecordList: public list<Record*>{
 	void destroyReferences();
 };
 
+/**A gfs file, text or binary, mapped in memory. Opening it only builds an index with the
+position, the type and the frame of each record, the records are decoded when they are
+accessed. The index holds the same records as a RecordList read from the same file, so the
+positions can be used in the same way: getLogWeight() and computePath() consider the records
+before the given position, as the versions of RecordList taking an iterator do.*/
+class GRIDFASTSLAM_EXPORT IndexedRecordList{
+	public:
+		enum RecordType {Comment, Pose, Neff, Entropy, Odometry, RawOdometry, ScanMatch, Laser, Resample};
+		struct Entry{
+			uint64_t offset;     ///< the start of the line, or of the payload of the binary record
+			uint32_t size;
+			uint32_t frame;      ///< the reading of the last FRAME before the record
+			unsigned char type;
+			unsigned char binaryType; ///< the type of the binary record, 0 for a text line
+		};
+		/**a scan of a trajectory: the Laser record and the pose of the particle*/
+		struct PathStep{
+			size_t laser;
+			OrientedPoint pose;
+			inline bool operator==(const PathStep& s) const {
+				return laser==s.laser && pose.x==s.pose.x && pose.y==s.pose.y && pose.theta==s.pose.theta;
+			}
+			inline bool operator!=(const PathStep& s) const {return !(*this==s);}
+		};
+
+		IndexedRecordList();
+		~IndexedRecordList();
+		/**maps the file and indexes its records, @returns false if the file can not be read*/
+		bool open(const char* filename);
+		void close();
+		inline bool isBinary() const {return m_binary;}
+
+		inline size_t size() const {return m_index.size();}
+		inline const Entry& entry(size_t i) const {return m_index[i];}
+		inline RecordType type(size_t i) const {return (RecordType)m_index[i].type;}
+		/**decodes the record i, the caller owns it*/
+		Record* record(size_t i) const;
+
+		/**@returns the number of particles of the ScanMatch, Odometry or Resample record i*/
+		unsigned int particles(size_t i) const;
+		/**reads the pose and the weight of a particle of the ScanMatch or Odometry record i*/
+		bool particle(size_t i, unsigned int particle, OrientedPoint& pose, double& weight) const;
+		/**@returns the index of the particle that generated the particle of the Resample record i*/
+		unsigned int resampleIndex(size_t i, unsigned int particle) const;
+
+		double getLogWeight(unsigned int particle, size_t end) const;
+		inline double getLogWeight(unsigned int particle) const {return getLogWeight(particle, size());}
+		/**the log weights of all the particles of the last ScanMatch or Resample record before end,
+		   as getLogWeight computes them, in a single pass*/
+		std::vector<double> getLogWeights(size_t end) const;
+		unsigned int getBestIdx() const;
+		/**the laser records before end, at the poses of the trajectory of the particle. The caller owns the records*/
+		RecordList computePath(unsigned int particle, size_t end) const;
+		/**the same trajectory as a sequence of steps, without decoding the laser records*/
+		void computePath(unsigned int particle, size_t end, std::vector<PathStep>& path) const;
+
+	protected:
+		bool index();
+		bool indexText();
+		bool indexBinary();
+		/**the tokens of the text line i after the first skip ones*/
+		const char* skipTokens(size_t i, unsigned int skip, const char*& end) const;
+		/**the weights of all the particles of the ScanMatch record i*/
+		void weights(size_t i, std::vector<double>& w) const;
+		/**the indexes of the Resample record i*/
+		void resampleIndexes(size_t i, std::vector<unsigned int>& indexes) const;
+
+		const char* m_data;
+		size_t m_length;
+		bool m_binary;
+		bool m_mapped;
+		//the content of the file where it can not be mapped
+		std::vector<char> m_buffer;
+		std::vector<Entry> m_index;
+
+	private:
+		IndexedRecordList(const IndexedRecordList&);
+		IndexedRecordList& operator=(const IndexedRecordList&);
+};
+
 }; //end namespace GFSReader
 
 }; //end namespace GMapping
@@ -0,0 +1,127 @@
+#ifndef GFSWRITER_H
+#define GFSWRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <gmapping/utils/point.h>
+#include <gmapping/gridfastslam/gfsbinary.h>
+#include <gmapping/gridfastslam/gridfastslam_export.h>
+
+namespace GMapping {
+
+/**The data of a record of the gfs output. The filter fills it and the writer
+formats it, in text or in binary, only when the record is written.
+Each type of record uses only some of the fields.*/
+struct GFSOutputRecord{
+	GFSOutputRecord(GFSBinary::RecordType t=GFSBinary::Text):
+		type(t), time(0), frame(0), linearDistance(0), angularDistance(0), neff(0) {}
+	GFSBinary::RecordType type;
+	double time;                         ///< Odometry, OdometryUpdate, Laser, SimulatorPose
+	OrientedPoint pose;                  ///< Odometry, Laser, SimulatorPose
+	std::vector<OrientedPoint> poses;    ///< OdometryUpdate, ScanMatchUpdate
+	std::vector<double> weights;         ///< OdometryUpdate, ScanMatchUpdate
+	std::vector<double> ranges;          ///< Laser
+	std::vector<unsigned int> indexes;   ///< Resample
+	unsigned int frame;                  ///< Frame
+	double linearDistance, angularDistance; ///< Frame
+	double neff;                         ///< Neff
+	std::string text;                    ///< Text
+};
+
+/**Writes the records of the gfs output, either directly or from a background thread.
+In the asynchronous mode write() only moves the record in a bounded queue, and the
+thread formats the records and writes them in their stream. When the queue is full the
+odometry records (Odometry, OdometryUpdate and SimulatorPose) are dropped, the other
+records wait for some space, since the readers of the gfs files need them.
+
+Each type of record can also be sampled: with a period n only one record of that
+type every n is written, with 0 none is. The check is done by accept(), before
+the record is built. Sampling the Laser, ScanMatchUpdate or Resample records
+prevents the readers from rebuilding the trajectories of the particles.
+
+The streams are accessed by the thread until flush() returns, and must not
+be written or closed in the meantime.*/
+class GRIDFASTSLAM_EXPORT GFSWriter{
+	public:
+		struct Statistics{
+			Statistics(): written(0), sampled(0), dropped(0), queueDepth(0), maxQueueDepth(0) {}
+			unsigned long written;      ///< the records written
+			unsigned long sampled;      ///< the records skipped by the sampling
+			unsigned long dropped;      ///< the records dropped because the queue was full
+			unsigned int queueDepth;    ///< the records waiting in the queue
+			unsigned int maxQueueDepth; ///< the largest number of records that waited in the queue
+		};
+
+		GFSWriter();
+		/**writes the records still in the queue*/
+		~GFSWriter();
+
+		/**starts or stops writing from the background thread. Stopping writes the records in the queue*/
+		void setAsynchronous(bool asynchronous);
+		inline bool isAsynchronous() const {return m_asynchronous;}
+		/**the maximum number of records waiting in the queue*/
+		void setQueueSize(unsigned int size);
+		inline unsigned int getQueueSize() const {return m_queueSize;}
+		/**writes one record of the given type every period, none if period is 0*/
+		void setPeriod(GFSBinary::RecordType type, unsigned int period);
+		unsigned int getPeriod(GFSBinary::RecordType type) const;
+
+		/**@returns true if the next record of the given type is to be written, counting it for the sampling*/
+		bool accept(GFSBinary::RecordType type);
+		/**writes the record in os, or queues it. The content of the record is moved away*/
+		void write(std::ostream& os, bool binary, GFSOutputRecord& record);
+		/**waits for the queue to be written and flushes the stream*/
+		void flush();
+		/**starts a new output, to be called when the stream is (re)opened: the records in the
+		   queue are written first, the next binary record is preceded by the header of the file.
+		   With append the records continue a binary file that already has its header*/
+		void reset(bool append=false);
+
+		unsigned int queueDepth() const;
+		Statistics getStatistics() const;
+
+		/**formats a record in os*/
+		static void encode(std::ostream& os, bool binary, const GFSOutputRecord& record, GFSBinary::RecordWriter& writer);
+
+	protected:
+		struct Entry{
+			std::ostream* stream;
+			bool binary;
+			GFSOutputRecord record;
+		};
+
+		void run();
+		void stop();
+		static bool droppable(GFSBinary::RecordType type);
+
+		bool m_asynchronous;
+		unsigned int m_queueSize;
+		unsigned int m_period[GFSBinary::SimulatorPose+1];
+		unsigned long m_count[GFSBinary::SimulatorPose+1];
+
+		//the formatting buffer of the binary records, used by a single thread at a time
+		GFSBinary::RecordWriter m_recordWriter;
+		std::ostream* m_lastStream;
+
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_notEmpty, m_notFull;
+		std::deque<Entry> m_queue;
+		bool m_writing, m_stop;
+		unsigned int m_maxQueueDepth;
+		std::atomic<unsigned long> m_written, m_sampled, m_dropped;
+
+	private:
+		GFSWriter(const GFSWriter&);
+		GFSWriter& operator=(const GFSWriter&);
+};
+
+};
+
+#endif
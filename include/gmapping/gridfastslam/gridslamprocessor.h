@@ -6,14 +6,20 @@
 #include <fstream>
 #include <vector>
 #include <deque>
+#include <utility>
+#include <atomic>
+#include <mutex>
 #include <gmapping/particlefilter/particlefilter.h>
 #include <gmapping/utils/point.h>
 #include <gmapping/utils/macro_params.h>
+#include <gmapping/utils/logging.h>
 #include <gmapping/log/sensorlog.h>
 #include <gmapping/sensor/sensor_range/rangesensor.h>
 #include <gmapping/sensor/sensor_range/rangereading.h>
 #include <gmapping/scanmatcher/scanmatcher.h>
 #include "gmapping/gridfastslam/motionmodel.h"
+#include <gmapping/gridfastslam/scanprofile.h>
+#include <gmapping/gridfastslam/gfswriter.h>
 #include <gmapping/gridfastslam/gridfastslam_export.h>
 
 
@@ -85,6 +91,23 @@ namespace GMapping {
     typedef std::vector<GridSlamProcessor::TNode*> TNodeVector;
     typedef std::deque<GridSlamProcessor::TNode*> TNodeDeque;
     
+    /**Scans waiting to be registered in the map of a particle (lazy registration).
+       The particles generated by the same parent during the resampling share
+       the same object, the first one which needs its map registers the scans
+       and the others take over the resulting map.*/
+    struct PendingScans{
+      struct Scan{
+	OrientedPoint pose;
+	std::vector<double> reading;
+      };
+      PendingScans(): map(0){}
+      ~PendingScans(){ delete map; }
+      std::vector<Scan> scans;
+      /**the map with the scans registered, 0 until the first particle needs it*/
+      ScanMatcherMap* map;
+      std::mutex mutex;
+    };
+
     /**This class defines a particle of the filter. Each particle has a map, a pose, a weight and retains the current node in the trajectory tree*/
     struct Particle{
       /**constructs a particle, given a map
@@ -121,6 +144,9 @@ namespace GMapping {
 
       /** Entry to the trajectory tree */
       TNode* node; 
+
+      /** The scans not yet registered in the map, when using lazy registration */
+      autoptr<PendingScans> pending;
     };
 	
     
@@ -167,17 +193,30 @@ namespace GMapping {
     ScanMatcher m_matcher;
     /**the stream used for writing the output of the algorithm*/
     std::ofstream& outputStream();
+    /**writes a line of text (e.g. a PARAM line) in the output stream, as a text record in the binary format*/
+    void writeOutputLine(const std::string& line);
+    /**the writer of the output stream, for its sampling periods and its counters.
+       With the asynchronous output call outputWriter().flush() before using the output stream*/
+    inline GFSWriter& outputWriter() {return m_outputWriter;}
     /**the stream used for writing the info/debug messages*/
     std::ostream& infoStream();
     /**@returns the particles*/
     inline const ParticleVector& getParticles() const {return m_particles; }
     
     inline const std::vector<unsigned int>& getIndexes() const{return m_indexes; }
+    /**registers the pending scans in the maps of all the particles, needed only with lazy registration*/
+    void registerPendingScans();
+    /**@returns the scan matching counters accumulated since the construction of the filter*/
+    inline const ScanMatcher::MatchStatistics& getMatchStatistics() const {return m_matchStatistics; }
+    /**@returns the profile of the last processed scan, empty unless compiled with GMAPPING_PROFILE*/
+    inline const ScanProfile& getScanProfile() const {return m_lastScanProfile; }
     int getBestParticleIndex() const;
     //callbacks
     virtual void onOdometryUpdate();
     virtual void onResampleUpdate();
     virtual void onScanmatchUpdate();
+    /**called at the end of each processed scan with its profile, only when compiled with GMAPPING_PROFILE*/
+    virtual void onProfileUpdate(const ScanProfile& profile);
 	
     //accessor methods
     /**the maxrange of the laser to consider */
@@ -222,6 +261,18 @@ namespace GMapping {
     /**generate an accupancy grid map [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, bool, generateMap, protected, public, public);
 
+    /**score the beams with the likelihood field instead of the kernel search, set before init [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, bool, useLikelihoodField, protected, public, public);
+
+    /**search the coarse levels of the map pyramid before the hill climbing, set before init [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, bool, multiResolution, protected, public, public);
+
+    /**translational half window of the coarse search [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, double, coarseLinearRange, protected, public, public);
+
+    /**angular half window of the coarse search [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, double, coarseAngularRange, protected, public, public);
+
     /**enlarge the map when the robot goes out of the boundaries [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, bool, enlargeStep, protected, public, public);
 
@@ -299,12 +350,46 @@ namespace GMapping {
     
     //smoothing factor for the likelihood
     PARAM_SET_GET(double, obsSigmaGain, protected, public, public);
+
+    //number of threads used to scan match the particles, 1 keeps the serial loop
+    PARAM_SET_GET(unsigned int, matchingThreads, protected, public, public);
+
+    //defer the registration of the scans in the particle maps until the maps are used for matching.
+    //the maps returned by getParticles() may then miss the last scan, see registerPendingScans()
+    PARAM_SET_GET(bool, lazyRegistration, protected, public, public);
+
+    //measure the matching time of each particle in the scan profile (only with GMAPPING_PROFILE)
+    PARAM_SET_GET(bool, profileParticles, protected, public, public);
+
+    //write the gfs output in the binary format of gfsbinary.h instead of text.
+    //the output stream should then be opened with std::ios::binary
+    PARAM_SET_GET(bool, binaryOutput, protected, public, public);
+
+    //write the gfs output from a background thread, through a queue of outputQueueSize records.
+    //applied by init(), see GFSWriter
+    PARAM_SET_GET(bool, asyncOutput, protected, public, public);
+    PARAM_SET_GET(unsigned int, outputQueueSize, protected, public, public);
+
+    //write the ODOM and ODO_UPDATE records only every odometryOutputPeriod readings (0 never), applied by init()
+    PARAM_SET_GET(unsigned int, odometryOutputPeriod, protected, public, public);
 	
     //stream in which to write the gfs file
     std::ofstream m_outputStream;
 
     // stream in which to write the messages
     std::ostream& m_infoStream;
+
+    // per thread copies of m_matcher, each one owning its own scratch buffers
+    std::vector<ScanMatcher> m_threadMatchers;
+
+    // scan matching counters of all the matchers
+    ScanMatcher::MatchStatistics m_matchStatistics;
+
+    // the profile of the scan being processed, and the one of the last processed scan
+    ScanProfile m_scanProfile, m_lastScanProfile;
+
+    // formats and writes the records of m_outputStream, declared after it so that it is destroyed first
+    GFSWriter m_outputWriter;
     
     
     // the functions below performs side effect on the internal structure,
@@ -313,8 +398,26 @@ namespace GMapping {
     
     /**scanmatches all the particles*/
     inline void scanMatch(const double *plainReading);
+    /**registers the pending scans of a particle, using the given matcher*/
+    inline void registerPendingScans(ScanMatcher& matcher, Particle& particle) const;
+    /**creates the pending scans of a particle, made of its current pending scans and of the reading at its current pose*/
+    inline autoptr<PendingScans> deferScan(const Particle& particle, const double* plainReading) const;
+    /**scanmatches a single particle with the given matcher, returns the score and stores the likelihood in l*/
+    inline double scanMatchParticle(ScanMatcher& matcher, Particle& particle, const double* plainReading, double& l) const;
+    /**scanmatches all the particles distributing them among m_matchingThreads threads*/
+    void scanMatchParallel(const double* plainReading, std::vector<double>& scores, std::vector<double>& likelihoods);
+    /**body of a matching thread, processes the particles not yet taken by the other threads*/
+    void scanMatchWorker(unsigned int thread, const double* plainReading, std::vector<double>* scores, std::vector<double>* likelihoods, std::atomic<unsigned int>* nextParticle);
     /**normalizes the particle weights*/
     inline void normalize();
+
+    //the records of the gfs output, in text or binary format
+    void writeOdometryRecords(const RangeReading& reading);
+    void writeFrameRecord();
+    void writeScanMatchRecords(const RangeReading& reading);
+    void writeNeffRecord();
+    void writeResampleRecord();
+    void particlesRecord(GFSOutputRecord& record) const;
     
     // return if a resampling occured or not
     inline bool resample(const double* plainReading, int adaptParticles, 
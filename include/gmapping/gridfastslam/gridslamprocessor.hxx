@@ -4,39 +4,110 @@
 #define isnan(x) (x==FP_NAN)
 #endif
 
+/**Registers the pending scans of a particle.
+The siblings sharing the same pending scans get the map registered by the first of them.
+The map is kept only if a sibling still needs it, and the last sibling takes it over.*/
+inline void GridSlamProcessor::registerPendingScans(ScanMatcher& matcher, Particle& particle) const{
+  if (!particle.pending)
+    return;
+  PendingScans& pending=*particle.pending;
+  {
+    std::lock_guard<std::mutex> lock(pending.mutex);
+    if (!pending.map){
+      for (unsigned int i=0; i<pending.scans.size(); i++){
+	matcher.invalidateActiveArea();
+	matcher.registerScan(particle.map, pending.scans[i].pose, &(pending.scans[i].reading[0]));
+      }
+      if (!particle.pending.unique())
+	pending.map=new ScanMatcherMap(particle.map);
+    } else if (particle.pending.unique()){
+      particle.map=std::move(*pending.map);
+    } else {
+      particle.map=*pending.map;
+    }
+  }
+  particle.pending=autoptr<PendingScans>();
+}
+
+inline autoptr<GridSlamProcessor::PendingScans> GridSlamProcessor::deferScan(const Particle& particle, const double* plainReading) const{
+  PendingScans* pending=new PendingScans;
+  if (particle.pending)
+    pending->scans=(*particle.pending).scans;
+  pending->scans.push_back(PendingScans::Scan());
+  pending->scans.back().pose=particle.pose;
+  pending->scans.back().reading.assign(plainReading, plainReading+m_beams);
+  return autoptr<PendingScans>(pending);
+}
+
+/**Scan matches a single particle and sets up the active area of its map.
+The matcher is passed explicitly so that each matching thread can use its own copy.*/
+inline double GridSlamProcessor::scanMatchParticle(ScanMatcher& matcher, Particle& particle, const double* plainReading, double& l) const{
+  registerPendingScans(matcher, particle);
+
+  OrientedPoint corrected;
+  double score, s;
+  score=matcher.optimize(corrected, particle.map, particle.pose, plainReading);
+  if (score>m_minimumScore){
+    particle.pose=corrected;
+  }
+  matcher.likelihoodAndScore(s, l, particle.map, particle.pose, plainReading);
+
+  //set up the selective copy of the active area
+  //by detaching the areas that will be updated
+  matcher.invalidateActiveArea();
+  matcher.computeActiveArea(particle.map, particle.pose, plainReading);
+  return score;
+}
+
 /**Just scan match every single particle.
-If the scan matching fails, the particle gets a default likelihood.*/
+If the scan matching fails, the particle gets a default likelihood.
+With more than one matching thread the particles are matched concurrently;
+the weights are updated afterwards in particle order, so the result does
+not depend on the number of threads.*/
 inline void GridSlamProcessor::scanMatch(const double* plainReading){
   // sample a new pose from each scan in the reference
   
-  double sumScore=0;
-  for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
-    OrientedPoint corrected;
-    double score, l, s;
-    score=m_matcher.optimize(corrected, it->map, it->pose, plainReading);
-    //    it->pose=corrected;
-    if (score>m_minimumScore){
-      it->pose=corrected;
-    } else {
-	if (m_infoStream){
-	  m_infoStream << "Scan Matching Failed, using odometry. Likelihood=" << l <<std::endl;
-	  m_infoStream << "lp:" << m_lastPartPose.x << " "  << m_lastPartPose.y << " "<< m_lastPartPose.theta <<std::endl;
-	  m_infoStream << "op:" << m_odoPose.x << " " << m_odoPose.y << " "<< m_odoPose.theta <<std::endl;
-	}
+  unsigned int n=m_particles.size();
+  std::vector<double> scores(n), likelihoods(n);
+  GSP_PROFILE(if (m_profileParticles) m_scanProfile.particleMatch.assign(n, 0.));
+  if (m_matchingThreads>1 && n>1){
+    scanMatchParallel(plainReading, scores, likelihoods);
+  } else {
+    for (unsigned int i=0; i<n; i++){
+      GSP_PROFILE_TIC(particleStart);
+      scores[i]=scanMatchParticle(m_matcher, m_particles[i], plainReading, likelihoods[i]);
+      GSP_PROFILE(if (m_profileParticles) m_scanProfile.particleMatch[i]=GSP_PROFILE_ELAPSED(particleStart));
     }
+  }
 
-    m_matcher.likelihoodAndScore(s, l, it->map, it->pose, plainReading);
-    sumScore+=score;
-    it->weight+=l;
-    it->weightSum+=l;
-
-    //set up the selective copy of the active area
-    //by detaching the areas that will be updated
-    m_matcher.invalidateActiveArea();
-    m_matcher.computeActiveArea(it->map, it->pose, plainReading);
+  double sumScore=0;
+  for (unsigned int i=0; i<n; i++){
+    Particle& particle=m_particles[i];
+    if (scores[i]<=m_minimumScore && m_infoStream){
+      GMAPPING_LOG_TO(Log::Warning, m_infoStream, "Scan Matching Failed, using odometry. Likelihood=" << likelihoods[i] <<std::endl
+		      << "lp:" << m_lastPartPose.x << " "  << m_lastPartPose.y << " "<< m_lastPartPose.theta <<std::endl
+		      << "op:" << m_odoPose.x << " " << m_odoPose.y << " "<< m_odoPose.theta <<std::endl);
+    }
+    sumScore+=scores[i];
+    particle.weight+=likelihoods[i];
+    particle.weightSum+=likelihoods[i];
   }
   if (m_infoStream)
-    m_infoStream << "Average Scan Matching Score=" << sumScore/m_particles.size() << std::endl;	
+    GMAPPING_LOG_TO(Log::Info, m_infoStream, "Average Scan Matching Score=" << sumScore/m_particles.size() << std::endl);
+
+  //collect the counters of the matchers used for this scan
+  ScanMatcher::MatchStatistics stats=m_matcher.getMatchStatistics();
+  m_matcher.resetMatchStatistics();
+  for (unsigned int t=0; t<m_threadMatchers.size(); t++){
+    stats.add(m_threadMatchers[t].getMatchStatistics());
+    m_threadMatchers[t].resetMatchStatistics();
+  }
+  m_matchStatistics.add(stats);
+  GSP_PROFILE(m_scanProfile.matching.add(stats));
+  if (m_infoStream && stats.matches)
+    GMAPPING_LOG_TO(Log::Info, m_infoStream, "Scan Matching: " << (double)stats.iterations/stats.matches << " iterations/match, "
+		 << (double)stats.searchNodes/stats.matches << " search nodes/match, "
+		 << 1000.*stats.time << " ms" << std::endl);
 }
 
 inline void GridSlamProcessor::normalize(){
@@ -70,6 +141,7 @@ inline void GridSlamProcessor::normalize(){
 inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSize, const RangeReading* reading){
   
   bool hasResampled = false;
+  GSP_PROFILE_TIC(resampleStart);
   
   TNodeVector oldGeneration;
   for (unsigned int i=0; i<m_particles.size(); i++){
@@ -79,22 +151,21 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
   if (m_neff<m_resampleThreshold*m_particles.size()){		
     
     if (m_infoStream)
-      m_infoStream  << "*************RESAMPLE***************" << std::endl;
+      GMAPPING_LOG_TO(Log::Info, m_infoStream, "*************RESAMPLE***************" << std::endl);
     
     uniform_resampler<double, double> resampler;
     m_indexes=resampler.resampleIndexes(m_weights, adaptSize);
     
-    if (m_outputStream.is_open()){
-      m_outputStream << "RESAMPLE "<< m_indexes.size() << " ";
-      for (std::vector<unsigned int>::const_iterator it=m_indexes.begin(); it!=m_indexes.end(); it++){
-	m_outputStream << *it <<  " ";
-      }
-      m_outputStream << std::endl;
-    }
+    if (m_outputStream.is_open())
+      writeResampleRecord();
     
     onResampleUpdate();
     //BEGIN: BUILDING TREE
+    //the indexes are sorted, the last copy of each selected particle takes it over by moving,
+    //only the particles selected more than once are copied
     ParticleVector temp;
+    temp.reserve(m_indexes.size());
+    unsigned int copies=0;
     unsigned int j=0;
     std::vector<unsigned int> deletedParticles;  		//this is for deleteing the particles which have been resampled away.
     
@@ -116,7 +187,12 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
       node->reading=reading;
       //			cerr << "A("<<node->parent->childs <<") " <<endl;
       
-      temp.push_back(p);
+      if (i+1<m_indexes.size() && m_indexes[i+1]==m_indexes[i]){
+	temp.push_back(p);
+	copies++;
+      } else {
+	temp.push_back(std::move(p));
+      }
       temp.back().node=node;
       temp.back().previousIndex=m_indexes[i];
     }
@@ -125,30 +201,48 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
       j++;
     }
     //		cerr << endl;
-    std::cerr <<  "Deleting Nodes:";
+    bool debug=GMAPPING_LOG_ENABLED(Log::Debug);
+    GMAPPING_DEBUG("Deleting Nodes:");
     for (unsigned int i=0; i<deletedParticles.size(); i++){
-      std::cerr <<" " << deletedParticles[i];
+      if (debug)
+	Log::stream() <<" " << deletedParticles[i];
       delete m_particles[deletedParticles[i]].node;
       m_particles[deletedParticles[i]].node=0;
     }
-    std::cerr  << " Done" <<std::endl;
+    GMAPPING_DEBUG(" Done" <<std::endl);
     
     //END: BUILDING TREE
-    std::cerr << "Deleting old particles..." ;
-    m_particles.clear();
-    std::cerr << "Done" << std::endl;
-    std::cerr << "Copying Particles and  Registering  scans...";
-    for (ParticleVector::iterator it=temp.begin(); it!=temp.end(); it++){
+    GMAPPING_DEBUG("Deleting old particles...");
+    m_particles.swap(temp);
+    temp.clear();
+    GMAPPING_DEBUG("Done" << std::endl);
+    if (m_infoStream)
+      GMAPPING_LOG_TO(Log::Info, m_infoStream, "Resampling: copied " << copies << " particles, moved " << m_particles.size()-copies << std::endl);
+    GSP_PROFILE_TOC(resampleStart, m_scanProfile.resample);
+    GSP_PROFILE_TIC(registrationStart);
+    GMAPPING_DEBUG("Registering  scans...");
+    autoptr<PendingScans> pending;
+    for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       it->setWeight(0);
-      m_matcher.invalidateActiveArea();
-      m_matcher.registerScan(it->map, it->pose, plainReading);
-      m_particles.push_back(*it);
+      if (m_lazyRegistration){
+	//the copies of the same particle share the pending scans
+	if (it==m_particles.begin() || it->previousIndex!=(it-1)->previousIndex)
+	  pending=deferScan(*it, plainReading);
+	it->pending=pending;
+      } else {
+	m_matcher.invalidateActiveArea();
+	m_matcher.registerScan(it->map, it->pose, plainReading);
+      }
     }
-    std::cerr  << " Done" <<std::endl;
+    GMAPPING_DEBUG(" Done" <<std::endl);
+    GSP_PROFILE_TOC(registrationStart, m_scanProfile.registration);
     hasResampled = true;
   } else {
+    //the nodes of the tree are built while registering, their time goes to the registration
+    GSP_PROFILE_TOC(resampleStart, m_scanProfile.resample);
+    GSP_PROFILE_TIC(registrationStart);
     int index=0;
-    std::cerr << "Registering Scans:";
+    GMAPPING_DEBUG("Registering Scans:");
     TNodeVector::iterator node_it=oldGeneration.begin();
     for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       //create a new node in the particle tree and add it to the old tree
@@ -161,17 +255,23 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
       it->node=node;
 
       //END: BUILDING TREE
-      m_matcher.invalidateActiveArea();
-      m_matcher.registerScan(it->map, it->pose, plainReading);
+      if (m_lazyRegistration){
+	it->pending=deferScan(*it, plainReading);
+      } else {
+	m_matcher.invalidateActiveArea();
+	m_matcher.registerScan(it->map, it->pose, plainReading);
+      }
       it->previousIndex=index;
       index++;
       node_it++;
       
     }
-    std::cerr  << "Done" <<std::endl;
+    GMAPPING_DEBUG("Done" <<std::endl);
+    GSP_PROFILE_TOC(registrationStart, m_scanProfile.registration);
     
   }
   //END: BUILDING TREE
+  GSP_PROFILE(m_scanProfile.resampled=hasResampled);
   
   return hasResampled;
 }
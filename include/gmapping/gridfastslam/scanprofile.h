@@ -0,0 +1,59 @@
+#ifndef SCANPROFILE_H
+#define SCANPROFILE_H
+
+#include <vector>
+#include <gmapping/scanmatcher/scanmatcher.h>
+
+#ifdef GMAPPING_PROFILE
+#include <chrono>
+/**starts the timer t*/
+#define GSP_PROFILE_TIC(t) std::chrono::steady_clock::time_point t=std::chrono::steady_clock::now()
+/**@returns the seconds elapsed since the timer t was started*/
+#define GSP_PROFILE_ELAPSED(t) std::chrono::duration<double>(std::chrono::steady_clock::now()-(t)).count()
+/**adds the seconds elapsed since the timer t was started to value*/
+#define GSP_PROFILE_TOC(t, value) (value)+=GSP_PROFILE_ELAPSED(t)
+/**the statement is compiled only with the profiling enabled*/
+#define GSP_PROFILE(statement) statement
+#else
+#define GSP_PROFILE_TIC(t)
+#define GSP_PROFILE_ELAPSED(t) 0.
+#define GSP_PROFILE_TOC(t, value)
+#define GSP_PROFILE(statement)
+#endif
+
+namespace GMapping {
+
+/**Where the time of the update of the filter for a scan goes. The times are in seconds
+and include the readings skipped since the previous processed scan.
+The profile is filled only when the library is compiled with GMAPPING_PROFILE defined,
+otherwise the timers compile to nothing and the profile stays empty.*/
+struct ScanProfile{
+	ScanProfile() {clear();}
+	void clear(){
+		scan=readings=particles=0;
+		resampled=false;
+		neff=0;
+		motion=scanMatch=weights=resample=registration=output=total=0;
+		matching=ScanMatcher::MatchStatistics();
+		particleMatch.clear();
+	}
+	unsigned int scan;       ///< the number of the processed scan
+	unsigned int readings;   ///< the readings given to processScan since the previous processed scan, this one included
+	unsigned int particles;
+	bool resampled;
+	double neff;
+	double motion;           ///< drawing the poses from the motion model
+	double scanMatch;        ///< matching the particles and computing their likelihood
+	double weights;          ///< normalizing the weights and propagating them in the trajectory tree
+	double resample;         ///< resampling the particles and building the trajectory tree
+	double registration;     ///< registering (or deferring) the scan in the maps of the particles
+	double output;           ///< writing the gfs output stream
+	double total;            ///< all the time spent in processScan
+	ScanMatcher::MatchStatistics matching; ///< the counters of the scan matching for this scan
+	/**the matching time of each particle, filled only if the particle profiling is enabled*/
+	std::vector<double> particleMatch;
+};
+
+};
+
+#endif
@@ -33,6 +33,7 @@
 #include <gmapping/log/carmenconfiguration.h>
 #include <gmapping/log/sensorstream.h>
 #include <gmapping/gridfastslam/gridslamprocessor.h>
+#include <gmapping/gridfastslam/gfsparameters.h>
 
 using namespace std;
 using namespace GMapping;
@@ -41,7 +42,7 @@ using namespace GMapping;
 #define MAX_STRING_LENGTH 1024
 
 
-struct GridSlamProcessorThread : public GridSlamProcessor {
+struct GridSlamProcessorThread : public GridSlamProcessor, public GFSParameters {
 		struct Event{
 			virtual ~Event();
 		};
@@ -104,7 +105,6 @@ struct GridSlamProcessorThread : public GridSlamProcessor {
 		EventDeque eventBuffer;
 		
 		unsigned int eventBufferLength;
-		unsigned int mapUpdateTime;
 		unsigned int mapTimer;
 		
 		//thread interaction stuff
@@ -115,60 +115,11 @@ struct GridSlamProcessorThread : public GridSlamProcessor {
 		pthread_t gfs_thread;
 		bool running;
 		
-		//This are the processor parameters
-		std::string filename;
-		std::string outfilename;
-
-		double xmin;
-		double ymin;
-		double xmax;
-		double ymax;
-		bool autosize;
-		double delta;
-		double resampleThreshold;
-		
-		//scan matching parameters
-		double sigma;
-		double maxrange;
-		double maxUrange;
-		double regscore;
-		double lstep;
-		double astep;
-		int kernelSize;
-		int iterations;
-		double critscore;
-		double maxMove;
-		unsigned int lskip;
-
-		//likelihood
-		double lsigma;
-		double ogain;
-		double llsamplerange, lasamplerange;
-		double llsamplestep, lasamplestep;
-		double linearOdometryReliability;
-		double angularOdometryReliability;
-		
-	
-		//motion model parameters
-		double srr, srt, str, stt;
-		//particle parameters
-		int particles;
-		bool skipMatching;
-		
-		//gfs parameters
-		double angularUpdate;
-		double linearUpdate;
-	
 		//robot config
 		SensorMap sensorMap;
 		//input stream
-		InputSensorStream* input;
+		SensorStream* input;
 		std::ifstream plainStream;
-		bool readFromStdin;
-		bool onLine;
-		bool generateMap;
-		bool considerOdometryCovariance;
-		unsigned int randseed;
 		
 		//dirty carmen interface
 		const char* const * m_argv;
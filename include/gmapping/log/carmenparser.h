@@ -0,0 +1,53 @@
+#ifndef CARMENPARSER_H
+#define CARMENPARSER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include "gmapping/log/configuration.h"
+#include <gmapping/sensor/sensor_odometry/odometrysensor.h>
+#include <gmapping/sensor/sensor_range/rangesensor.h>
+#include <gmapping/sensor/sensor_odometry/odometryreading.h>
+#include <gmapping/sensor/sensor_range/rangereading.h>
+#include <gmapping/log/log_export.h>
+
+namespace GMapping {
+
+/**Parses the lines of a Carmen log into the readings of the sensors of a SensorMap.
+The type of each sensor is looked up once, when the parser is built, and the lines are
+tokenized in place, without streams. The lines can be of any length: they are read in
+a buffer that is kept from one line to the next. The numbers are read in the "C" locale,
+whatever the locale of the program is.*/
+class LOG_EXPORT CarmenParser{
+	public:
+		CarmenParser(const SensorMap& sensorMap);
+		/**reads a line of is and parses it, @returns 0 if it is not a reading of a sensor of the map*/
+		SensorReading* read(std::istream& is);
+		/**parses the line [begin, end). The reading belongs to the caller*/
+		SensorReading* parse(const char* begin, const char* end);
+
+	protected:
+		struct SensorType{
+			std::string name;
+			const OdometrySensor* odometry;
+			const RangeSensor* range;
+		};
+
+		OdometryReading* parseOdometry(const OdometrySensor* osen);
+		RangeReading* parseRange(const RangeSensor* rs);
+
+		//the tokenizer, over the line being parsed
+		bool nextToken(const char*& token, const char*& tokenEnd);
+		void skipTokens(unsigned int n);
+		double nextDouble();
+		unsigned int nextUInt();
+
+		std::vector<SensorType> m_sensorTypes;
+		std::string m_line;
+		const char* m_cursor;
+		const char* m_end;
+};
+
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef SENSORBINARY_H
+#define SENSORBINARY_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+#include "gmapping/log/carmenconfiguration.h"
+#include <gmapping/sensor/sensor_odometry/odometrysensor.h>
+#include <gmapping/sensor/sensor_range/rangesensor.h>
+#include <gmapping/sensor/sensor_odometry/odometryreading.h>
+#include <gmapping/sensor/sensor_range/rangereading.h>
+#include <gmapping/log/log_export.h>
+
+namespace GMapping {
+
+/**The binary encoding of the sensor logs, written by carmen2bin. A file has
+<pre>
+header   "GSLB", version (uint32)
+config   n (uint32), n times key (string), m (uint32), m times value (string)
+sensors  n (uint32), n times name (string)
+records  the readings, each starting at a multiple of 8 bytes
+index    the offsets of the n records (uint64)
+trailer  the offset of the index (uint64), n (uint32), "GSLI"
+</pre>
+A string is its length (uint32) and its bytes, the configuration is the one of the
+CarmenConfiguration of the text log. A record is a header of 8 bytes, the size of the
+payload (uint32), the type (uint8), the sensor (uint8, an index in the sensor table) and
+the encoding of the ranges (uint16), followed by the payload:
+<pre>
+Odometry  time x y theta tv rv acceleration (double)
+Range     time x y theta (double), n (uint32), 0 (uint32), n ranges (float or uint16
+          millimetres), padded to a multiple of 8 bytes
+</pre>
+All the numbers are little endian. Without the trailer, e.g. for a truncated file,
+the readers index the records by scanning them.*/
+namespace SensorBinary {
+
+enum RecordType {Odometry=1, Range};
+enum RangeEncoding {Float=0, Millimeters=1};
+
+const uint32_t Version=1;
+
+/**@returns true if the stream starts with the header of a binary sensor log, nothing is consumed*/
+LOG_EXPORT bool isBinary(std::istream& is);
+/**reads the configuration stored in the header of a binary sensor log.
+   @returns false if the stream is not a binary sensor log (nothing is consumed then)*/
+LOG_EXPORT bool readConfiguration(std::istream& is, CarmenConfiguration& conf);
+
+/**Writes a binary sensor log. The offsets of the records are counted as they are written,
+so that the stream does not need to be seekable*/
+class LOG_EXPORT Writer{
+	public:
+		/**writes the header, the readings of the sensors of smap can be written*/
+		Writer(std::ostream& os, const CarmenConfiguration& conf, const SensorMap& smap, RangeEncoding encoding=Float);
+		/**writes the index if close() was not called*/
+		~Writer();
+		/**@returns false if the sensor of the reading is not in the map*/
+		bool write(const SensorReading& reading);
+		/**writes the index and the trailer*/
+		void close();
+		inline size_t size() const {return m_offsets.size();}
+		/**the range records written as floats because the millimetres could not hold their ranges*/
+		inline size_t floatFallbacks() const {return m_floatFallbacks;}
+	protected:
+		void put(const void* data, size_t size);
+		void putUInt32(uint32_t v);
+		void putUInt64(uint64_t v);
+		void putDouble(double d);
+		void putString(const std::string& s);
+		void pad();
+		std::ostream& m_os;
+		RangeEncoding m_encoding;
+		std::vector<const Sensor*> m_sensors;
+		std::vector<uint64_t> m_offsets;
+		std::vector<char> m_buffer;
+		uint64_t m_position;
+		size_t m_floatFallbacks;
+		bool m_closed;
+};
+
+/**A binary sensor log mapped in memory. The records are indexed when the file is
+opened and decoded only when they are read, so any reading can be reached directly.*/
+class LOG_EXPORT File{
+	public:
+		File();
+		~File();
+		/**maps the file, @returns false if it can not be read or is not a binary sensor log*/
+		bool open(const char* filename);
+		void close();
+		inline bool isOpen() const {return m_data!=0;}
+		inline const CarmenConfiguration& configuration() const {return m_configuration;}
+		/**the sensors the readings are bound to, looked up by name*/
+		void setSensorMap(const SensorMap& smap);
+
+		inline size_t size() const {return m_offsets.size();}
+		RecordType type(size_t i) const;
+		double time(size_t i) const;
+		/**@returns the first record whose time is not before time, the records being in time order*/
+		size_t seek(double time) const;
+		/**decodes the record i, the reading belongs to the caller.
+		   @returns 0 if the sensor of the record is not in the map*/
+		SensorReading* reading(size_t i) const;
+
+	protected:
+		struct SensorType{
+			std::string name;
+			const OdometrySensor* odometry;
+			const RangeSensor* range;
+		};
+		bool index();
+		const char* m_data;
+		size_t m_length;
+		bool m_mapped;
+		std::vector<char> m_buffer;
+		CarmenConfiguration m_configuration;
+		std::vector<SensorType> m_sensorTypes;
+		std::vector<uint64_t> m_offsets;
+	private:
+		File(const File&);
+		File& operator=(const File&);
+};
+
+}; //end namespace SensorBinary
+
+}; //end namespace GMapping
+
+#endif
@@ -18,11 +18,12 @@ class LOG_EXPORT SensorLog : public std::list<SensorReading*>{
 		SensorLog(const SensorMap&);
 		~SensorLog();
 		std::istream& load(std::istream& is);
+		/**loads a text log, or a binary one (see SensorBinary) mapping it in memory.
+		   @returns false if the file can not be read*/
+		bool load(const char* filename);
 		OrientedPoint boundingBox(double& xmin, double& ymin, double& xmax, double& ymax) const;
 	protected:
 		const SensorMap& m_sensorMap;
-		OdometryReading* parseOdometry(std::istream& is, const OdometrySensor* ) const;
-		RangeReading* parseRange(std::istream& is, const RangeSensor* ) const;
 };
 
 };
@@ -3,6 +3,8 @@
 
 #include <istream>
 #include "gmapping/log/sensorlog.h"
+#include "gmapping/log/carmenparser.h"
+#include "gmapping/log/sensorbinary.h"
 #include <gmapping/log/log_export.h>
 
 namespace GMapping {
@@ -16,9 +18,6 @@ class LOG_EXPORT SensorStream{
 		inline const SensorMap& getSensorMap() const {return m_sensorMap; }
 	protected:
 		const SensorMap& m_sensorMap;
-		static SensorReading* parseReading(std::istream& is, const SensorMap& smap);
-		static OdometryReading* parseOdometry(std::istream& is, const OdometrySensor* );
-		static RangeReading* parseRange(std::istream& is, const RangeSensor* );
 };
 
 class LOG_EXPORT InputSensorStream: public SensorStream{
@@ -31,6 +30,7 @@ class LOG_EXPORT InputSensorStream: public SensorStream{
 		//virtual SensorStream& operator >>(SensorLog*& log);
 	protected:
 		std::istream& m_inputStream;
+		CarmenParser m_parser;
 };
 
 class LOG_EXPORT LogSensorStream: public SensorStream{
@@ -44,5 +44,24 @@ class LOG_EXPORT LogSensorStream: public SensorStream{
 		SensorLog::const_iterator m_cursor;
 };
 
+/**Streams the readings of a binary log (see SensorBinary) mapped in memory.
+Unlike the text streams it can be rewound and moved to any reading.*/
+class LOG_EXPORT BinarySensorStream: public SensorStream{
+	public:
+		BinarySensorStream(const SensorMap& sensorMap, const char* filename);
+		inline bool isOpen() const {return m_file.isOpen();}
+		virtual operator bool() const;
+		virtual bool rewind();
+		virtual SensorStream& operator >>(const SensorReading*&);
+		/**moves to the first reading whose time is not before time*/
+		void seek(double time);
+		inline size_t position() const {return m_cursor;}
+		inline void setPosition(size_t position) {m_cursor=position;}
+		inline size_t size() const {return m_file.size();}
+	protected:
+		SensorBinary::File m_file;
+		size_t m_cursor;
+};
+
 };
 #endif
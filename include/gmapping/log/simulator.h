@@ -0,0 +1,100 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <gmapping/utils/point.h>
+#include <gmapping/sensor/sensor_odometry/odometrysensor.h>
+#include <gmapping/sensor/sensor_range/rangesensor.h>
+#include <gmapping/sensor/sensor_odometry/odometryreading.h>
+#include <gmapping/sensor/sensor_range/rangereading.h>
+#include <gmapping/log/log_export.h>
+
+namespace GMapping {
+
+/**A 2D floor plan made of wall segments, with a closed path that the simulated
+robot follows*/
+struct LOG_EXPORT SimulatedWorld{
+	struct Segment{
+		Point a, b;
+	};
+	void addWall(const Point& a, const Point& b);
+	void addBox(const Point& min, const Point& max);
+	/**@returns the distance from p, along the direction theta, to the closest wall, maxRange if none is closer*/
+	double cast(const Point& p, double theta, double maxRange) const;
+	void boundingBox(double& xmin, double& ymin, double& xmax, double& ymax) const;
+
+	/**a 20x12m room with a few boxes and pillars*/
+	static SimulatedWorld room();
+	/**a single 2.5m wide corridor closing a 30x20m loop*/
+	static SimulatedWorld loop();
+	/**two corridor loops sharing a corridor, travelled as a figure eight*/
+	static SimulatedWorld corridors();
+	/**a 30x30m hall with sparse pillars*/
+	static SimulatedWorld hall();
+	/**@returns false if there is no world called name*/
+	static bool byName(SimulatedWorld& world, const std::string& name);
+
+	std::vector<Segment> walls;
+	std::vector<Point> path;
+};
+
+/**Deterministic simulator of a robot with odometry and a laser range finder
+moving along the path of a SimulatedWorld. Equal parameters and seeds give
+equal readings. The laser beams are laid out as CarmenConfiguration does for
+a front laser, so that the logs written by writeCarmen are read back by SensorLog
+with the same geometry, as long as the resolution is the one CarmenConfiguration
+assumes for that number of beams (1 degree for 181, 0.5 for 361).*/
+class LOG_EXPORT Simulator{
+	public:
+		struct Parameters{
+			Parameters();
+			unsigned int beams;
+			double resolution;   ///< angle between two beams
+			double maxRange;
+			double rangeSigma;   ///< standard deviation of the range noise
+			double linearStep;   ///< distance travelled between two readings
+			double angularStep;  ///< maximum rotation between two readings
+			double linearDrift;  ///< standard deviation of the odometry translation error, per meter
+			double angularDrift; ///< standard deviation of the odometry rotation error, per meter or radian travelled
+			double angularBias;  ///< systematic rotation error of the odometry, per meter
+			unsigned int seed;
+		};
+		Simulator(const SimulatedWorld& world, const Parameters& p=Parameters());
+		~Simulator();
+		/**the laser (FLASER), the odometry (ODOM) and the ground truth (TRUEPOS)*/
+		inline const SensorMap& getSensorMap() const {return m_sensorMap;}
+		inline const RangeSensor* getLaser() const {return m_laser;}
+		inline const OrientedPoint& getTruePose() const {return m_truePose;}
+		inline const OrientedPoint& getOdometryPose() const {return m_odometryPose;}
+		inline double getTime() const {return m_time;}
+		/**moves the robot by one step and returns the reading taken at the new pose.
+		   The reading belongs to the caller, its pose is the odometry pose.*/
+		RangeReading* next();
+		/**writes scans steps as a Carmen log, one ODOM, TRUEPOS and FLASER line for each step*/
+		void writeCarmen(std::ostream& os, unsigned int scans);
+	protected:
+		double uniform();
+		double gaussian(double sigma);
+		SimulatedWorld m_world;
+		Parameters m_parameters;
+		SensorMap m_sensorMap;
+		RangeSensor* m_laser;
+		OdometrySensor* m_odometry;
+		OdometrySensor* m_truePosition;
+		OrientedPoint m_truePose;
+		OrientedPoint m_odometryPose;
+		unsigned int m_target;
+		double m_time;
+		unsigned long long m_random;
+		bool m_hasSpare;
+		double m_spare;
+	private:
+		Simulator(const Simulator&);
+		Simulator& operator=(const Simulator&);
+};
+
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include<utility>
 #include<cmath>
 #include<gmapping/utils/gvalues.h>
+#include<gmapping/utils/stat.h>
 
 
 /**
@@ -65,7 +66,7 @@ void resample(std::vector<int>& indexes, const WeightVector& weights, unsigned i
 	double interval=cweight/n;
 
 	//compute the initial target weight
-	double target=interval*::drand48();
+	double target=interval*GMapping::sampleUniform();
 	//compute the resampled indexes
 
 	cweight=0;
@@ -170,7 +171,7 @@ std::vector<unsigned int> uniform_resampler<Particle, Numeric>:: resampleIndexes
 	Numeric interval=cweight/n;
 
 	//compute the initial target weight
-	Numeric target=interval*::drand48();
+	Numeric target=interval*GMapping::sampleUniform();
 	//compute the resampled indexes
 
 	cweight=0;
@@ -209,7 +210,7 @@ std::vector<Particle> uniform_resampler<Particle,Numeric>::resample
 	Numeric interval=cweight/n;
 
 	//compute the initial target weight
-	Numeric target=interval*::drand48();
+	Numeric target=interval*GMapping::sampleUniform();
 	//compute the resampled indexes
 
 	cweight=0;
@@ -62,7 +62,7 @@ void resample(std::vector<int>& indexes, const WeightVector& weights, unsigned i
 	double interval=cweight/n;
 
 	//compute the initial target weight
-	double target=interval*::drand48();
+	double target=interval*GMapping::sampleUniform();
 	//compute the resampled indexes
 
 	cweight=0;
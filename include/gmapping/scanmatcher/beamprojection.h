@@ -0,0 +1,140 @@
+#ifndef BEAMPROJECTION_H
+#define BEAMPROJECTION_H
+
+#include <vector>
+#include <gmapping/utils/point.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace GMapping {
+
+/**The beams of a reading used to evaluate a pose, in the laser frame.
+For each beam it stores the endpoint and the offset from the endpoint to the
+cell which is expected to be free, so that placing the beams at a pose is just
+a rotation and a translation, without trigonometric functions.*/
+struct BeamSet{
+	inline void clear(){ hitX.clear(); hitY.clear(); freeX.clear(); freeY.clear(); }
+	inline unsigned int size() const { return hitX.size(); }
+	inline void push_back(double hx, double hy, double fx, double fy){
+		hitX.push_back(hx); hitY.push_back(hy); freeX.push_back(fx); freeY.push_back(fy);
+	}
+	std::vector<double> hitX, hitY, freeX, freeY;
+};
+
+/**The beams of a BeamSet placed at a pose. The endpoints are in world
+coordinates, the cells and the free cell offsets in map coordinates, computed
+as Map::world2map does.*/
+struct BeamProjection{
+	inline void resize(unsigned int n){
+		size=n;
+		if (hitX.size()<n){
+			hitX.resize(n); hitY.resize(n);
+			cellX.resize(n); cellY.resize(n);
+			freeX.resize(n); freeY.resize(n);
+		}
+	}
+	unsigned int size;
+	std::vector<double> hitX, hitY;
+	std::vector<int> cellX, cellY;
+	std::vector<int> freeX, freeY;
+};
+
+/**Places the beams at the laser pose lp.
+center, delta and origin describe the map: origin is the cell of the center.
+The beams are processed four (AVX) or two (SSE2) at a time when the compiler
+targets those instruction sets, the remaining ones by the scalar loop.*/
+inline void projectBeams(BeamProjection& out, const BeamSet& beams, const OrientedPoint& lp, const Point& center, double delta, const IntPoint& origin){
+	unsigned int n=beams.size();
+	out.resize(n);
+	const double c=cos(lp.theta), s=sin(lp.theta);
+	const double* bhx=n?&beams.hitX[0]:0;
+	const double* bhy=n?&beams.hitY[0]:0;
+	const double* bfx=n?&beams.freeX[0]:0;
+	const double* bfy=n?&beams.freeY[0]:0;
+	double* hx=n?&out.hitX[0]:0;
+	double* hy=n?&out.hitY[0]:0;
+	int* cx=n?&out.cellX[0]:0;
+	int* cy=n?&out.cellY[0]:0;
+	int* fx=n?&out.freeX[0]:0;
+	int* fy=n?&out.freeY[0]:0;
+	unsigned int i=0;
+#if defined(__AVX__)
+	{
+		const __m256d vc=_mm256_set1_pd(c), vs=_mm256_set1_pd(s);
+		const __m256d vx=_mm256_set1_pd(lp.x), vy=_mm256_set1_pd(lp.y);
+		const __m256d vcx=_mm256_set1_pd(center.x), vcy=_mm256_set1_pd(center.y);
+		const __m256d vd=_mm256_set1_pd(delta), half=_mm256_set1_pd(0.5), sign=_mm256_set1_pd(-0.0);
+		const __m128i ox=_mm_set1_epi32(origin.x), oy=_mm_set1_epi32(origin.y);
+		for (; i+4<=n; i+=4){
+			__m256d lx=_mm256_loadu_pd(bhx+i), ly=_mm256_loadu_pd(bhy+i);
+			__m256d wx=_mm256_add_pd(vx, _mm256_sub_pd(_mm256_mul_pd(vc, lx), _mm256_mul_pd(vs, ly)));
+			__m256d wy=_mm256_add_pd(vy, _mm256_add_pd(_mm256_mul_pd(vs, lx), _mm256_mul_pd(vc, ly)));
+			_mm256_storeu_pd(hx+i, wx);
+			_mm256_storeu_pd(hy+i, wy);
+			__m256d mx=_mm256_div_pd(_mm256_sub_pd(wx, vcx), vd), my=_mm256_div_pd(_mm256_sub_pd(wy, vcy), vd);
+			mx=_mm256_add_pd(mx, _mm256_or_pd(half, _mm256_and_pd(mx, sign)));
+			my=_mm256_add_pd(my, _mm256_or_pd(half, _mm256_and_pd(my, sign)));
+			_mm_storeu_si128((__m128i*)(cx+i), _mm_add_epi32(_mm256_cvttpd_epi32(mx), ox));
+			_mm_storeu_si128((__m128i*)(cy+i), _mm_add_epi32(_mm256_cvttpd_epi32(my), oy));
+			lx=_mm256_loadu_pd(bfx+i), ly=_mm256_loadu_pd(bfy+i);
+			wx=_mm256_sub_pd(_mm256_mul_pd(vc, lx), _mm256_mul_pd(vs, ly));
+			wy=_mm256_add_pd(_mm256_mul_pd(vs, lx), _mm256_mul_pd(vc, ly));
+			mx=_mm256_div_pd(_mm256_sub_pd(wx, vcx), vd), my=_mm256_div_pd(_mm256_sub_pd(wy, vcy), vd);
+			mx=_mm256_add_pd(mx, _mm256_or_pd(half, _mm256_and_pd(mx, sign)));
+			my=_mm256_add_pd(my, _mm256_or_pd(half, _mm256_and_pd(my, sign)));
+			_mm_storeu_si128((__m128i*)(fx+i), _mm_add_epi32(_mm256_cvttpd_epi32(mx), ox));
+			_mm_storeu_si128((__m128i*)(fy+i), _mm_add_epi32(_mm256_cvttpd_epi32(my), oy));
+		}
+	}
+#elif defined(__SSE2__)
+	{
+		const __m128d vc=_mm_set1_pd(c), vs=_mm_set1_pd(s);
+		const __m128d vx=_mm_set1_pd(lp.x), vy=_mm_set1_pd(lp.y);
+		const __m128d vcx=_mm_set1_pd(center.x), vcy=_mm_set1_pd(center.y);
+		const __m128d vd=_mm_set1_pd(delta), half=_mm_set1_pd(0.5), sign=_mm_set1_pd(-0.0);
+		for (; i+2<=n; i+=2){
+			__m128d lx=_mm_loadu_pd(bhx+i), ly=_mm_loadu_pd(bhy+i);
+			__m128d wx=_mm_add_pd(vx, _mm_sub_pd(_mm_mul_pd(vc, lx), _mm_mul_pd(vs, ly)));
+			__m128d wy=_mm_add_pd(vy, _mm_add_pd(_mm_mul_pd(vs, lx), _mm_mul_pd(vc, ly)));
+			_mm_storeu_pd(hx+i, wx);
+			_mm_storeu_pd(hy+i, wy);
+			__m128d mx=_mm_div_pd(_mm_sub_pd(wx, vcx), vd), my=_mm_div_pd(_mm_sub_pd(wy, vcy), vd);
+			mx=_mm_add_pd(mx, _mm_or_pd(half, _mm_and_pd(mx, sign)));
+			my=_mm_add_pd(my, _mm_or_pd(half, _mm_and_pd(my, sign)));
+			__m128i ix=_mm_cvttpd_epi32(mx), iy=_mm_cvttpd_epi32(my);
+			cx[i]=_mm_cvtsi128_si32(ix)+origin.x; cx[i+1]=_mm_cvtsi128_si32(_mm_srli_si128(ix, 4))+origin.x;
+			cy[i]=_mm_cvtsi128_si32(iy)+origin.y; cy[i+1]=_mm_cvtsi128_si32(_mm_srli_si128(iy, 4))+origin.y;
+			lx=_mm_loadu_pd(bfx+i), ly=_mm_loadu_pd(bfy+i);
+			wx=_mm_sub_pd(_mm_mul_pd(vc, lx), _mm_mul_pd(vs, ly));
+			wy=_mm_add_pd(_mm_mul_pd(vs, lx), _mm_mul_pd(vc, ly));
+			mx=_mm_div_pd(_mm_sub_pd(wx, vcx), vd), my=_mm_div_pd(_mm_sub_pd(wy, vcy), vd);
+			mx=_mm_add_pd(mx, _mm_or_pd(half, _mm_and_pd(mx, sign)));
+			my=_mm_add_pd(my, _mm_or_pd(half, _mm_and_pd(my, sign)));
+			ix=_mm_cvttpd_epi32(mx), iy=_mm_cvttpd_epi32(my);
+			fx[i]=_mm_cvtsi128_si32(ix)+origin.x; fx[i+1]=_mm_cvtsi128_si32(_mm_srli_si128(ix, 4))+origin.x;
+			fy[i]=_mm_cvtsi128_si32(iy)+origin.y; fy[i+1]=_mm_cvtsi128_si32(_mm_srli_si128(iy, 4))+origin.y;
+		}
+	}
+#endif
+	for (; i<n; i++){
+		double wx=lp.x+(c*bhx[i]-s*bhy[i]);
+		double wy=lp.y+(s*bhx[i]+c*bhy[i]);
+		hx[i]=wx;
+		hy[i]=wy;
+		double mx=(wx-center.x)/delta, my=(wy-center.y)/delta;
+		cx[i]=(int)(mx+(mx<0?-0.5:0.5))+origin.x;
+		cy[i]=(int)(my+(my<0?-0.5:0.5))+origin.y;
+		wx=c*bfx[i]-s*bfy[i];
+		wy=s*bfx[i]+c*bfy[i];
+		mx=(wx-center.x)/delta, my=(wy-center.y)/delta;
+		fx[i]=(int)(mx+(mx<0?-0.5:0.5))+origin.x;
+		fy[i]=(int)(my+(my<0?-0.5:0.5))+origin.y;
+	}
+}
+
+};
+
+#endif
@@ -5,18 +5,39 @@
 #include "gmapping/scanmatcher/smmap.h"
 #include <gmapping/utils/macro_params.h>
 #include <gmapping/utils/stat.h>
+#include <gmapping/utils/logging.h>
 #include <iostream>
+#include <vector>
 #include <gmapping/utils/gvalues.h>
 #include <gmapping/scanmatcher/scanmatcher_export.h>
+#include "gmapping/scanmatcher/beamprojection.h"
 #define LASER_MAXBEAMS 2048
 
 namespace GMapping {
 
+/**A matcher keeps scratch buffers for the beams being evaluated, so the same
+instance must not be used by different threads at the same time: every thread
+needs its own copy.*/
 class SCANMATCHER_EXPORT ScanMatcher{
 	public:
 		typedef Covariance3 CovarianceMatrix;
+		/**counters of the scan matching, accumulated by optimize*/
+		struct MatchStatistics{
+			MatchStatistics(): matches(0), iterations(0), evaluations(0), searchNodes(0), time(0.){}
+			inline void add(const MatchStatistics& s){
+				matches+=s.matches; iterations+=s.iterations; evaluations+=s.evaluations; searchNodes+=s.searchNodes; time+=s.time;
+			}
+			unsigned long matches;     ///< calls to optimize
+			unsigned long iterations;  ///< poses scored by the hill climbing at full resolution
+			unsigned long evaluations; ///< scans evaluated in full by the hill climbing, the poses it revisits are not evaluated again
+			unsigned long searchNodes; ///< poses and sets of poses evaluated by the coarse search
+			double time;               ///< time spent in optimize, in seconds
+		};
 		
 		ScanMatcher();
+		/**copies the parameters of the matcher, the scratch buffers are not shared*/
+		ScanMatcher(const ScanMatcher& sm);
+		ScanMatcher& operator=(const ScanMatcher& sm);
 		~ScanMatcher();
 		double icpOptimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 		double optimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
@@ -33,10 +54,26 @@ class SCANMATCHER_EXPORT ScanMatcher{
 		inline double icpStep(OrientedPoint & pret, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 		inline double score(const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 		inline unsigned int likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
+		/**selects the beams of a reading used by score (skipZero=true, freeDistance=delta*delta*freeCellRatio)
+		   or by likelihoodAndScore (skipZero=false, freeDistance=delta*freeCellRatio), so that they can be
+		   evaluated at many poses without recomputing them*/
+		inline void prepareBeams(BeamSet& beams, const double* readings, double freeDistance, bool skipZero) const;
+		inline double score(const ScanMatcherMap& map, const OrientedPoint& p, const BeamSet& beams) const;
+		inline unsigned int likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const BeamSet& beams) const;
+		/**scores the n poses as score does, into out. The beams are evaluated one at a time at all
+		   the poses, so that the poses landing on the same cells share the search of the kernel*/
+		void scoreBatch(const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const double* readings, double* out) const;
+		void scoreBatch(const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams, double* out) const;
+		/**evaluates the n poses as likelihoodAndScore does, into s and l, in the same way as scoreBatch*/
+		void likelihoodAndScoreBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const double* readings) const;
+		void likelihoodAndScoreBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams) const;
+		inline bool likelihoodFieldLookup(Point& mu, const ScanMatcherMap& map, const Point& phit, const IntPoint& iphit) const;
 		double likelihood(double& lmax, OrientedPoint& mean, CovarianceMatrix& cov, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings);
 		double likelihood(double& _lmax, OrientedPoint& _mean, CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& p, Gaussian3& odometry, const double* readings, double gain=180.);
 		inline const double* laserAngles() const { return m_laserAngles; }
 		inline unsigned int laserBeams() const { return m_laserBeams; }
+		inline const MatchStatistics& getMatchStatistics() const { return m_matchStatistics; }
+		inline void resetMatchStatistics() { m_matchStatistics=MatchStatistics(); }
 		
 		static const double nullLikelihood;
 	protected:
@@ -46,6 +83,9 @@ class SCANMATCHER_EXPORT ScanMatcher{
 		/**laser parameters*/
 		unsigned int m_laserBeams;
 		double       m_laserAngles[LASER_MAXBEAMS];
+		/**unit vectors of the beams in the laser frame*/
+		double       m_laserCos[LASER_MAXBEAMS];
+		double       m_laserSin[LASER_MAXBEAMS];
 		//OrientedPoint m_laserPose;
 		PARAM_SET_GET(OrientedPoint, laserPose, protected, public, public)
 		PARAM_SET_GET(double, laserMaxRange, protected, public, public)
@@ -62,42 +102,130 @@ class SCANMATCHER_EXPORT ScanMatcher{
 		PARAM_SET_GET(double, llsamplestep, protected, public, public)
 		PARAM_SET_GET(double, lasamplerange, protected, public, public)
 		PARAM_SET_GET(double, lasamplestep, protected, public, public)
+		/**threads evaluating the samples of likelihood, each one on its own copy of the matcher.
+		   The samples are only split when every thread gets at least 64 of them*/
+		PARAM_SET_GET(unsigned int, likelihoodThreads, protected, public, public)
 		PARAM_SET_GET(bool, generateMap, protected, public, public)
 		PARAM_SET_GET(double, enlargeStep, protected, public, public)
+		/**the occupancy above which a cell is an obstacle. registerScan records it in the occupancy
+		   plane of the map, so it has to be set before registering the first scan*/
 		PARAM_SET_GET(double, fullnessThreshold, protected, public, public)
 		PARAM_SET_GET(double, angularOdometryReliability, protected, public, public)
 		PARAM_SET_GET(double, linearOdometryReliability, protected, public, public)
 		PARAM_SET_GET(double, freeCellRatio, protected, public, public)
 		PARAM_SET_GET(unsigned int, initialBeamsSkip, protected, public, public)
+		/**score the beams with a lookup in the likelihood field of the map instead of searching the kernel.
+		   The field is maintained by registerScan, so it has to be set before registering the first scan*/
+		PARAM_SET_GET(bool, useLikelihoodField, protected, public, public)
+		/**search the best pose on the coarse levels of the map pyramid, branch and bound, before the
+		   hill climbing at full resolution. The pyramid is maintained by registerScan, so it has to be
+		   set before registering the first scan*/
+		PARAM_SET_GET(bool, multiResolution, protected, public, public)
+		/**half size of the translational window of the coarse search*/
+		PARAM_SET_GET(double, coarseLinearRange, protected, public, public)
+		/**half size of the rotational window of the coarse search*/
+		PARAM_SET_GET(double, coarseAngularRange, protected, public, public)
+
+		void updateLikelihoodField(ScanMatcherMap& map);
+		void updatePyramid(ScanMatcherMap& map);
+		OrientedPoint coarseSearch(double& bestScore, const ScanMatcherMap& map, const OrientedPoint& init) const;
+		unsigned int coarseBound(const ScanMatcherMap& map, const int* cx, const int* cy, unsigned int beams, int level, int dx, int dy) const;
+		inline double odometryGain(const OrientedPoint& init, const OrientedPoint& pose) const;
 
 		// allocate this large array only once
 		IntPoint* m_linePoints;
+		// cells whose occupancy changed in the last registration
+		std::vector<IntPoint> m_changedCells;
+		// the field cells around them, each once
+		std::vector<IntPoint> m_fieldCells;
+		// scratch buffers of the scoring functions
+		mutable BeamSet m_scoreBeams;
+		mutable BeamSet m_likelihoodBeams;
+		mutable BeamProjection m_projection;
+		/**the occupied cells of the kernel around the endpoint of a beam, which have a free cell before them*/
+		struct KernelNeighbourhood{
+			IntPoint cell, free;
+			std::vector<Point> means;
+		};
+		// scratch buffers of the batch evaluation
+		mutable std::vector<BeamProjection> m_batchProjections;
+		mutable std::vector<KernelNeighbourhood> m_neighbourhoods;
+		// the poses of the sampling grid of likelihood and their evaluations
+		std::vector<OrientedPoint> m_samples;
+		std::vector<double> m_sampleScores, m_sampleLikelihoods;
+		// cells of the beams at the rotations of the coarse search
+		mutable std::vector<int> m_searchX, m_searchY;
+		mutable MatchStatistics m_matchStatistics;
+
+		double sampleLikelihood(double& lmax, OrientedPoint& mean, CovarianceMatrix& cov, const ScanMatcherMap& map, const OrientedPoint& p, Gaussian3* odometry, const double* readings, double gain);
+		void evaluateBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams) const;
+		inline OrientedPoint laserPoseAt(const OrientedPoint& p) const;
+		/**direction of the beam i for a laser heading with cosine c and sine s*/
+		inline Point beamDirection(double c, double s, unsigned int i) const{
+			return Point(c*m_laserCos[i]-s*m_laserSin[i], s*m_laserCos[i]+c*m_laserSin[i]);
+		}
+		/**the flags of the occupancy plane for a cell*/
+		inline unsigned char occupancyFlags(const ScanMatcherCell& cell) const{
+			double occupancy=(double)cell;
+			return (occupancy>m_fullnessThreshold?ScanMatcherStorage::Occupied:0)|(occupancy>=m_fullnessThreshold?ScanMatcherStorage::NotFree:0);
+		}
 };
 
-inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const{
-	const double * angle=m_laserAngles+m_initialBeamsSkip;
+inline bool ScanMatcher::likelihoodFieldLookup(Point& mu, const ScanMatcherMap& map, const Point& phit, const IntPoint& iphit) const{
+	const LikelihoodFieldCell* fcell=map.storage().likelihoodFieldCell(iphit);
+	if (!fcell || !fcell->valid)
+		return false;
+	mu=phit-Point(fcell->mean.x, fcell->mean.y);
+	return true;
+}
+
+inline OrientedPoint ScanMatcher::laserPoseAt(const OrientedPoint& p) const{
 	OrientedPoint lp=p;
 	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
+	return lp;
+}
+
+/**the penalty of the optimizers for moving away from the initial guess*/
+inline double ScanMatcher::odometryGain(const OrientedPoint& init, const OrientedPoint& pose) const{
+	double odo_gain=1;
+	if (m_angularOdometryReliability>0.){
+		double dth=init.theta-pose.theta; 	dth=atan2(sin(dth), cos(dth)); 	dth*=dth;
+		odo_gain*=exp(-m_angularOdometryReliability*dth);
+	}
+	if (m_linearOdometryReliability>0.){
+		double dx=init.x-pose.x;
+		double dy=init.y-pose.y;
+		double drho=dx*dx+dy*dy;
+		odo_gain*=exp(-m_linearOdometryReliability*drho);
+	}
+	return odo_gain;
+}
+
+inline void ScanMatcher::prepareBeams(BeamSet& beams, const double* readings, double freeDistance, bool skipZero) const{
+	beams.clear();
 	unsigned int skip=0;
-	double freeDelta=map.getDelta()*m_freeCellRatio;
-	std::list<PointPair> pairs;
-	
-	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++){
+	for (unsigned int i=m_initialBeamsSkip; i<m_laserBeams; i++){
+		double r=readings[i];
 		skip++;
 		skip=skip>m_likelihoodSkip?0:skip;
-		if (*r>m_usableRange||*r==0.0) continue;
-		if (skip) continue;
-		Point phit=lp;
-		phit.x+=*r*cos(lp.theta+*angle);
-		phit.y+=*r*sin(lp.theta+*angle);
-		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
- 		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
+		if (skip||r>m_usableRange||(skipZero && r==0.0)) continue;
+		beams.push_back(r*m_laserCos[i], r*m_laserSin[i], -freeDistance*m_laserCos[i], -freeDistance*m_laserSin[i]);
+	}
+}
+
+inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const{
+	prepareBeams(m_scoreBeams, readings, map.getDelta()*map.getDelta()*m_freeCellRatio, true);
+	projectBeams(m_projection, m_scoreBeams, laserPoseAt(p), map.getCenter(), map.getDelta(), map.world2map(map.getCenter()));
+	const BeamProjection& proj=m_projection;
+	const ScanMatcherStorage& storage=map.storage();
+	std::list<PointPair> pairs;
+
+	for (unsigned int i=0; i<proj.size; i++){
+		Point phit(proj.hitX[i], proj.hitY[i]);
+		IntPoint iphit(proj.cellX[i], proj.cellY[i]);
+		IntPoint ipfree(proj.freeX[i], proj.freeY[i]);
 		bool found=false;
 		Point bestMu(0.,0.);
 		Point bestCell(0.,0.);
@@ -107,20 +235,19 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
 			IntPoint pf=pr+ipfree;
 			//AccessibilityState s=map.storage().cellState(pr);
 			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
+				if ((storage.occupancy(pr)&ScanMatcherStorage::Occupied) && !(storage.occupancy(pf)&ScanMatcherStorage::NotFree)){
+					Point mean=map.cell(pr).mean(map.map2world(pr));
+					Point mu=phit-mean;
 					if (!found){
 						bestMu=mu;
-						bestCell=cell.mean();
+						bestCell=mean;
 						found=true;
 					}else
 						if((mu*mu)<(bestMu*bestMu)){
 							bestMu=mu;
-							bestCell=cell.mean();
-						} 
-						
+							bestCell=mean;
+						}
+
 				}
 			//}
 		}
@@ -130,58 +257,50 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
 		}
 		//std::cerr << std::endl;
 	}
-	
+
 	OrientedPoint result(0,0,0);
 	//double icpError=icpNonlinearStep(result,pairs);
-	std::cerr << "result(" << pairs.size() << ")=" << result.x << " " << result.y << " " << result.theta << std::endl;
+	GMAPPING_DEBUG("result(" << pairs.size() << ")=" << result.x << " " << result.y << " " << result.theta << std::endl);
 	pret.x=p.x+result.x;
 	pret.y=p.y+result.y;
 	pret.theta=p.theta+result.theta;
 	pret.theta=atan2(sin(pret.theta), cos(pret.theta));
-	return score(map, p, readings);
+	return score(map, p, m_scoreBeams);
 }
 
 inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const{
+	prepareBeams(m_scoreBeams, readings, map.getDelta()*map.getDelta()*m_freeCellRatio, true);
+	return score(map, p, m_scoreBeams);
+}
+
+inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint& p, const BeamSet& beams) const{
 	double s=0;
-	const double * angle=m_laserAngles+m_initialBeamsSkip;
-	OrientedPoint lp=p;
-	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
-	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
-	lp.theta+=m_laserPose.theta;
-	unsigned int skip=0;
-	double freeDelta=map.getDelta()*m_freeCellRatio;
-	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++){
-		skip++;
-		skip=skip>m_likelihoodSkip?0:skip;
-		if (skip||*r>m_usableRange||*r==0.0) continue;
-		Point phit=lp;
-		phit.x+=*r*cos(lp.theta+*angle);
-		phit.y+=*r*sin(lp.theta+*angle);
-		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-map.getDelta()*freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-map.getDelta()*freeDelta)*sin(lp.theta+*angle);
- 		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
+	projectBeams(m_projection, beams, laserPoseAt(p), map.getCenter(), map.getDelta(), map.world2map(map.getCenter()));
+	const BeamProjection& proj=m_projection;
+	const ScanMatcherStorage& storage=map.storage();
+	for (unsigned int i=0; i<proj.size; i++){
+		Point phit(proj.hitX[i], proj.hitY[i]);
+		IntPoint iphit(proj.cellX[i], proj.cellY[i]);
 		bool found=false;
 		Point bestMu(0.,0.);
-		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
-		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
-			IntPoint pr=iphit+IntPoint(xx,yy);
-			IntPoint pf=pr+ipfree;
-			//AccessibilityState s=map.storage().cellState(pr);
-			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
+		if (m_useLikelihoodField){
+			found=likelihoodFieldLookup(bestMu, map, phit, iphit);
+		} else {
+			IntPoint ipfree(proj.freeX[i], proj.freeY[i]);
+			for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+			for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+				IntPoint pr=iphit+IntPoint(xx,yy);
+				IntPoint pf=pr+ipfree;
+				//the occupancy bytes select the candidates, only their cells are read
+				if ((storage.occupancy(pr)&ScanMatcherStorage::Occupied) && !(storage.occupancy(pf)&ScanMatcherStorage::NotFree)){
+					Point mu=phit-map.cell(pr).mean(map.map2world(pr));
 					if (!found){
 						bestMu=mu;
 						found=true;
 					}else
 						bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
 				}
-			//}
+			}
 		}
 		if (found)
 			s+=exp(-1./m_gaussianSigma*bestMu*bestMu);
@@ -190,60 +309,48 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
 }
 
 inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const{
+	prepareBeams(m_likelihoodBeams, readings, map.getDelta()*m_freeCellRatio, false);
+	return likelihoodAndScore(s, l, map, p, m_likelihoodBeams);
+}
+
+inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const BeamSet& beams) const{
 	using namespace std;
 	l=0;
 	s=0;
-	const double * angle=m_laserAngles+m_initialBeamsSkip;
-	OrientedPoint lp=p;
-	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
-	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
-	lp.theta+=m_laserPose.theta;
 	double noHit=nullLikelihood/(m_likelihoodSigma);
-	unsigned int skip=0;
 	unsigned int c=0;
-	double freeDelta=map.getDelta()*m_freeCellRatio;
-	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++){
-		skip++;
-		skip=skip>m_likelihoodSkip?0:skip;
-		if (*r>m_usableRange) continue;
-		if (skip) continue;
-		Point phit=lp;
-		phit.x+=*r*cos(lp.theta+*angle);
-		phit.y+=*r*sin(lp.theta+*angle);
-		IntPoint iphit=map.world2map(phit);
-		Point pfree=lp;
-		pfree.x+=(*r-freeDelta)*cos(lp.theta+*angle);
-		pfree.y+=(*r-freeDelta)*sin(lp.theta+*angle);
-		pfree=pfree-phit;
-		IntPoint ipfree=map.world2map(pfree);
+	projectBeams(m_projection, beams, laserPoseAt(p), map.getCenter(), map.getDelta(), map.world2map(map.getCenter()));
+	const BeamProjection& proj=m_projection;
+	const ScanMatcherStorage& storage=map.storage();
+	for (unsigned int i=0; i<proj.size; i++){
+		Point phit(proj.hitX[i], proj.hitY[i]);
+		IntPoint iphit(proj.cellX[i], proj.cellY[i]);
 		bool found=false;
 		Point bestMu(0.,0.);
-		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
-		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
-			IntPoint pr=iphit+IntPoint(xx,yy);
-			IntPoint pf=pr+ipfree;
-			//AccessibilityState s=map.storage().cellState(pr);
-			//if (s&Inside && s&Allocated){
-				const PointAccumulator& cell=map.cell(pr);
-				const PointAccumulator& fcell=map.cell(pf);
-				if (((double)cell )>m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold){
-					Point mu=phit-cell.mean();
+		if (m_useLikelihoodField){
+			found=likelihoodFieldLookup(bestMu, map, phit, iphit);
+		} else {
+			IntPoint ipfree(proj.freeX[i], proj.freeY[i]);
+			for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+			for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+				IntPoint pr=iphit+IntPoint(xx,yy);
+				IntPoint pf=pr+ipfree;
+				if ((storage.occupancy(pr)&ScanMatcherStorage::Occupied) && !(storage.occupancy(pf)&ScanMatcherStorage::NotFree)){
+					Point mu=phit-map.cell(pr).mean(map.map2world(pr));
 					if (!found){
 						bestMu=mu;
 						found=true;
 					}else
 						bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
 				}
-			//}	
+			}
 		}
 		if (found){
 			s+=exp(-1./m_gaussianSigma*bestMu*bestMu);
 			c++;
 		}
-		if (!skip){
-			double f=(-1./m_likelihoodSigma)*(bestMu*bestMu);
-			l+=(found)?f:noHit;
-		}
+		double f=(-1./m_likelihoodSigma)*(bestMu*bestMu);
+		l+=(found)?f:noHit;
 	}
 	return c;
 }
@@ -3,6 +3,10 @@
 #include <gmapping/grid/map.h>
 #include <gmapping/grid/harray2d.h>
 #include <gmapping/utils/point.h>
+#include <vector>
+#include <cmath>
+#include <assert.h>
+#include <stdint.h>
 #define SIGHT_INC 1
 
 namespace GMapping {
@@ -17,7 +21,10 @@ struct PointAccumulator{
 	PointAccumulator(int i): acc(0,0), n(0), visits(0){assert(i==-1);}
 	/*after end*/
         inline void update(bool value, const Point& p=Point(0,0));
+	/**the centre of the cell is not needed, the accumulator holds the world coordinates*/
+	inline void update(bool value, const Point& p, const Point& /*centre*/) {update(value, p);}
 	inline Point mean() const {return 1./n*Point(acc.x, acc.y);}
+	inline Point mean(const Point& /*centre*/) const {return mean();}
 	inline operator double() const { return visits?(double)n*SIGHT_INC/(double)visits:-1; }
 	inline void add(const PointAccumulator& p) {acc=acc+p.acc; n+=p.n; visits+=p.visits; }
 	static const PointAccumulator& Unknown();
@@ -47,7 +54,175 @@ double PointAccumulator::entropy() const{
 }
 
 
-typedef Map<PointAccumulator,HierarchicalArray2D<PointAccumulator> > ScanMatcherMap;
+/**A cell of 8 bytes instead of the 16 of PointAccumulator. It holds the mean of the
+hits as an offset from the centre of the cell, in steps of MeanResolution, and 16 bit
+counters. When the visits would overflow both counters are halved, which keeps their
+ratio. Since the offset is relative to the centre, the centre has to be given to
+update() and mean() with the hits; the map is used in the same way with both cells.
+The running mean is rounded at every hit, so the steps are small enough for the updates
+of a well visited cell not to be lost in the rounding; they bound the offsets to 0.65m,
+which holds cells up to 1.3m.*/
+struct CompactPointAccumulator{
+	static constexpr double MeanResolution=2e-5;
+	CompactPointAccumulator(): mx(0), my(0), n(0), visits(0){}
+	CompactPointAccumulator(int i): mx(0), my(0), n(0), visits(0){assert(i==-1); (void)i;}
+	inline void update(bool value, const Point& p=Point(0,0), const Point& centre=Point(0,0));
+	inline Point mean(const Point& centre) const {return centre+MeanResolution*Point(mx, my);}
+	inline operator double() const { return visits?(double)n*SIGHT_INC/(double)visits:-1; }
+	inline void add(const CompactPointAccumulator& p);
+	static const CompactPointAccumulator& Unknown();
+	static CompactPointAccumulator* unknown_ptr;
+	int16_t mx, my;
+	uint16_t n, visits;
+	inline double entropy() const;
+	protected:
+		static inline int16_t quantize(double offset);
+		inline void halve();
+};
+
+int16_t CompactPointAccumulator::quantize(double offset){
+	double q=round(offset/MeanResolution);
+	return (int16_t)(q<-32767?-32767:(q>32767?32767:q));
+}
+
+void CompactPointAccumulator::halve(){
+	n=(n+1)>>1;
+	visits=(visits+1)>>1;
+}
+
+void CompactPointAccumulator::update(bool value, const Point& p, const Point& centre){
+	if (visits>0xFFFF-SIGHT_INC)
+		halve();
+	if (value) {
+		//the running mean of the offsets from the centre
+		n++;
+		Point offset=p-centre;
+		mx=quantize(mx*MeanResolution+(offset.x-mx*MeanResolution)/n);
+		my=quantize(my*MeanResolution+(offset.y-my*MeanResolution)/n);
+		visits+=SIGHT_INC;
+	} else
+		visits++;
+}
+
+void CompactPointAccumulator::add(const CompactPointAccumulator& p){
+	unsigned int hits=n+p.n;
+	if (hits){
+		mx=quantize(MeanResolution*((double)mx*n+(double)p.mx*p.n)/hits);
+		my=quantize(MeanResolution*((double)my*n+(double)p.my*p.n)/hits);
+	}
+	unsigned int sum=visits+p.visits;
+	while (sum>0xFFFF){
+		hits=(hits+1)>>1;
+		sum=(sum+1)>>1;
+	}
+	n=hits;
+	visits=sum;
+}
+
+double CompactPointAccumulator::entropy() const{
+	if (!visits)
+		return -log(.5);
+	if (n==visits || n==0)
+		return 0;
+	double x=(double)n*SIGHT_INC/(double)visits;
+	return -( x*log(x)+ (1-x)*log(1-x) );
+}
+
+/**The cell of the scan matcher map. Building with GMAPPING_COMPACT_MAP selects the
+cell of 8 bytes, which halves the memory of the maps and the cost of copying a patch*/
+#ifdef GMAPPING_COMPACT_MAP
+typedef CompactPointAccumulator ScanMatcherCell;
+#else
+typedef PointAccumulator ScanMatcherCell;
+#endif
+
+/**A cell of the likelihood field. It caches the mean of the closest occupied
+cell found in the matching kernel around the cell, so that the scan matcher
+can score a beam with a single lookup instead of a kernel search.*/
+struct LikelihoodFieldCell{
+	typedef point<float> FloatPoint;
+	LikelihoodFieldCell(): mean(0,0), valid(false){}
+	FloatPoint mean;
+	bool valid;
+};
+
+/**The storage of the scan matcher map. In addition to the ScanMatcherCell patches
+it holds the occupancy plane, the likelihood field and the map pyramid, that are shared
+and copied on write exactly as the cells.
+The occupancy plane has a byte for each cell of the map, with the flags Occupied (the
+occupancy of the cell is above the fullness threshold of the matcher) and NotFree (it is
+not below): the scan matcher tests these flags instead of computing the occupancy of the
+cells, and reads a cell only when it is a candidate. The plane is maintained by
+ScanMatcher::registerScan.
+The field is maintained by ScanMatcher::registerScan when the likelihood field scoring is enabled,
+the pyramid when the multi resolution matching is enabled.
+A cell of the level k of the pyramid covers 2^k x 2^k cells of the map and it is set if any
+of them is occupied (max pooling). The patches of the plane and of a level cover the same area
+as the patches of the map, so that they are resized together with the map.*/
+class ScanMatcherStorage: public HierarchicalArray2D<ScanMatcherCell>{
+	public:
+		typedef HierarchicalArray2D<LikelihoodFieldCell> LikelihoodField;
+		typedef HierarchicalArray2D<unsigned char> OccupancyPlane;
+		typedef HierarchicalArray2D<unsigned char> PyramidLevel;
+		enum {MaxPyramidLevels=3};
+		enum {Occupied=1, NotFree=2};
+		ScanMatcherStorage(int xsize, int ysize, int patchMagnitude=5):
+			HierarchicalArray2D<ScanMatcherCell>(xsize, ysize, patchMagnitude),
+			m_occupancy(xsize, ysize, patchMagnitude),
+			m_likelihoodField(xsize, ysize, patchMagnitude){
+			for (int k=1; k<=MaxPyramidLevels && k<=patchMagnitude; k++)
+				m_pyramid.push_back(PyramidLevel(xsize>>k, ysize>>k, patchMagnitude-k));
+		}
+		inline void resize(int xmin, int ymin, int xmax, int ymax){
+			HierarchicalArray2D<ScanMatcherCell>::resize(xmin, ymin, xmax, ymax);
+			m_occupancy.resize(xmin, ymin, xmax, ymax);
+			m_likelihoodField.resize(xmin, ymin, xmax, ymax);
+			for (unsigned int k=0; k<m_pyramid.size(); k++)
+				m_pyramid[k].resize(xmin, ymin, xmax, ymax);
+		}
+		inline OccupancyPlane& occupancyPlane() {return m_occupancy;}
+		inline const OccupancyPlane& occupancyPlane() const {return m_occupancy;}
+		/**@returns the occupancy flags of the cell p, 0 outside the map and where nothing was registered.
+		   The patch is looked up once, this is the test of the inner loops of the matcher.*/
+		inline unsigned char occupancy(const IntPoint& p) const{
+			if (p.x<0 || p.y<0)
+				return 0;
+			int px=p.x>>m_patchMagnitude, py=p.y>>m_patchMagnitude;
+			if (px>=m_occupancy.getXSize() || py>=m_occupancy.getYSize())
+				return 0;
+			const autoptr< Array2D<unsigned char> >& patch=m_occupancy.m_cells[px*m_occupancy.getYSize()+py];
+			if (!patch)
+				return 0;
+			int mask=m_patchSize-1;
+			return (*patch).m_cells[((p.x&mask)<<m_patchMagnitude)+(p.y&mask)];
+		}
+		inline LikelihoodField& likelihoodField() {return m_likelihoodField;}
+		inline const LikelihoodField& likelihoodField() const {return m_likelihoodField;}
+		/**@returns the field cell at p, or 0 if the field was never computed there*/
+		inline const LikelihoodFieldCell* likelihoodFieldCell(const IntPoint& p) const{
+			if (m_likelihoodField.cellState(p)&Allocated)
+				return &m_likelihoodField.cell(p);
+			return 0;
+		}
+		/**@returns the number of coarse levels, the map itself is the level 0*/
+		inline int pyramidLevels() const {return m_pyramid.size();}
+		/**@returns the level k>=1 of the pyramid*/
+		inline PyramidLevel& pyramidLevel(int k) {return m_pyramid[k-1];}
+		inline const PyramidLevel& pyramidLevel(int k) const {return m_pyramid[k-1];}
+		/**@returns the value of the cell p (in the coordinates of the level k>=1), 0 where the level was never computed*/
+		inline unsigned char pyramidCell(int k, const IntPoint& p) const{
+			const PyramidLevel& level=m_pyramid[k-1];
+			if (level.cellState(p)&Allocated)
+				return level.cell(p);
+			return 0;
+		}
+	protected:
+		OccupancyPlane m_occupancy;
+		LikelihoodField m_likelihoodField;
+		std::vector<PyramidLevel> m_pyramid;
+};
+
+typedef Map<ScanMatcherCell,ScanMatcherStorage > ScanMatcherMap;
 
 };
 
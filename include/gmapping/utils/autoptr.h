@@ -1,28 +1,49 @@
 #ifndef AUTOPTR_H
 #define AUTOPTR_H
 #include <assert.h>
+#include <cstddef>
+#include <new>
+#include <atomic>
 
 namespace GMapping{
 
+/**allocates the shared blocks of the autoptr to X. It can be specialized to take
+them from a pool, as HierarchicalArray2D does for its patches*/
+template <class X>
+struct autoptrAllocator{
+	static inline void* allocate(std::size_t size) {return ::operator new(size);}
+	static inline void release(void* p) {::operator delete(p);}
+};
+
 template <class X>
 class autoptr{
 	protected:
 	
 	public:
+	/**the shared block, the counter is atomic so that handles to the same
+	data can be copied and destroyed concurrently from different threads*/
 	struct reference{
 		X* data;
-		unsigned int shares;
+		std::atomic<unsigned int> shares;
+		static inline void* operator new(std::size_t size) {return autoptrAllocator<X>::allocate(size);}
+		static inline void operator delete(void* p) {autoptrAllocator<X>::release(p);}
 	};
 		inline autoptr(X* p=(X*)(0));
 		inline autoptr(const autoptr<X>& ap);
+		/**moves take over the reference without touching the counter*/
+		inline autoptr(autoptr<X>&& ap);
 		inline autoptr& operator=(const autoptr<X>& ap);
+		inline autoptr& operator=(autoptr<X>&& ap);
 		inline ~autoptr();
 		inline operator int() const;
+		/**@returns true if this is the only handle to the data*/
+		inline bool unique() const;
 		inline X& operator*();
 		inline const X& operator*() const;
 		//p	
 		reference * m_reference;
 	protected:
+		inline void release();
 };
 
 template <class X>
@@ -41,8 +62,23 @@ autoptr<X>::autoptr(const autoptr<X>& ap){
 	reference* ref=ap.m_reference;
 	if (ap.m_reference){
 		m_reference=ref;
-		m_reference->shares++;
+		m_reference->shares.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+template <class X>
+autoptr<X>::autoptr(autoptr<X>&& ap){
+	m_reference=ap.m_reference;
+	ap.m_reference=0;
+}
+
+template <class X>
+void autoptr<X>::release(){
+	if (m_reference && m_reference->shares.fetch_sub(1, std::memory_order_acq_rel)==1){
+		delete m_reference->data;
+		delete m_reference;
 	}
+	m_reference=0;
 }
 
 template <class X>
@@ -51,29 +87,28 @@ autoptr<X>& autoptr<X>::operator=(const autoptr<X>& ap){
 	if (m_reference==ref){
 		return *this;
 	}
-	if (m_reference && !(--m_reference->shares)){
-		delete m_reference->data;
-		delete m_reference;
-		m_reference=0;
-	}	
+	release();
 	if (ref){
 		m_reference=ref;
-		m_reference->shares++;
-	} 
-//20050802 nasty changes begin
-	else
-		m_reference=0;
-//20050802 nasty changes end
+		m_reference->shares.fetch_add(1, std::memory_order_relaxed);
+	}
+	return *this;
+}
+
+template <class X>
+autoptr<X>& autoptr<X>::operator=(autoptr<X>&& ap){
+	if (this==&ap){
+		return *this;
+	}
+	release();
+	m_reference=ap.m_reference;
+	ap.m_reference=0;
 	return *this;
 }
 
 template <class X>
 autoptr<X>::~autoptr(){
-	if (m_reference && !(--m_reference->shares)){
-		delete m_reference->data;
-		delete m_reference;
-		m_reference=0;
-	}	
+	release();
 }
 
 template <class X>
@@ -81,6 +116,11 @@ autoptr<X>::operator int() const{
 	return m_reference && m_reference->shares && m_reference->data;
 }
 
+template <class X>
+bool autoptr<X>::unique() const{
+	return m_reference && m_reference->shares.load(std::memory_order_acquire)==1;
+}
+
 template <class X>
 X& autoptr<X>::operator*(){
 	assert(m_reference && m_reference->shares && m_reference->data);
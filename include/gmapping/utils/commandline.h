@@ -76,6 +76,7 @@ if (!strcmp(argv[c],name) && c<argc-1){\
 		bool recognized=false;
 	
 #define CMD_PARSE_END_SILENT\
+		(void)recognized;\
 		c++;\
 	}\
 }
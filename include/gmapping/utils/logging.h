@@ -0,0 +1,53 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <ostream>
+#include <atomic>
+#include <gmapping/utils/utils_export.h>
+
+/**The most verbose level compiled in. The messages above it are removed by the compiler,
+e.g. -DGMAPPING_LOG_MAX_LEVEL=2 keeps only the errors and the warnings.*/
+#ifndef GMAPPING_LOG_MAX_LEVEL
+#define GMAPPING_LOG_MAX_LEVEL 4
+#endif
+
+namespace GMapping {
+
+/**Levels of the diagnostic messages of the library. A message is written only if its
+level is compiled in and does not exceed the level set at run time, otherwise its
+arguments are not even evaluated. The run time level starts from the GMAPPING_LOG_LEVEL
+environment variable (a name or a number), Info if it is not set.*/
+namespace Log {
+
+enum Level {Quiet=0, Error=1, Warning=2, Info=3, Debug=4};
+
+extern UTILS_EXPORT std::atomic<int> currentLevel;
+
+inline int level() {return currentLevel.load(std::memory_order_relaxed);}
+UTILS_EXPORT void setLevel(int level);
+/**@returns the level named by s ("quiet", "error", "warning", "info", "debug" or a number), def if s is not a level*/
+UTILS_EXPORT int parseLevel(const char* s, int def);
+
+/**the stream of the messages without a stream of their own, std::cerr by default*/
+UTILS_EXPORT std::ostream& stream();
+UTILS_EXPORT void setStream(std::ostream& os);
+
+};
+
+};
+
+/**true if the messages of the given level are written*/
+#define GMAPPING_LOG_ENABLED(lvl) \
+	((lvl)<=GMAPPING_LOG_MAX_LEVEL && (lvl)<=GMapping::Log::level())
+
+/**writes message, a sequence of << operands, in os if the level is enabled*/
+#define GMAPPING_LOG_TO(lvl, os, message) \
+	do { if (GMAPPING_LOG_ENABLED(lvl)) { (os) << message; } } while (0)
+
+#define GMAPPING_LOG(lvl, message) GMAPPING_LOG_TO(lvl, GMapping::Log::stream(), message)
+#define GMAPPING_ERROR(message) GMAPPING_LOG(GMapping::Log::Error, message)
+#define GMAPPING_WARN(message) GMAPPING_LOG(GMapping::Log::Warning, message)
+#define GMAPPING_INFO(message) GMAPPING_LOG(GMapping::Log::Info, message)
+#define GMAPPING_DEBUG(message) GMAPPING_LOG(GMapping::Log::Debug, message)
+
+#endif
@@ -8,8 +8,17 @@
 namespace GMapping {
 
 /**stupid utility function for drawing particles form a zero mean, sigma variance normal distribution
-probably it should not go there*/
+probably it should not go there. A non zero S seeds the generator of the calling thread only,
+see seedSampling*/
 double UTILS_EXPORT sampleGaussian(double sigma,unsigned long int S=0);
+/**a uniform sample in [0,1), the sequence of drand48. Each thread has a generator of its own,
+so that filters running in different threads draw the same numbers as when run alone*/
+double UTILS_EXPORT sampleUniform();
+/**seeds the generator of the calling thread, as srand48(S) does for drand48. The other threads
+are not affected: the seed has to be set in the thread that calls GridSlamProcessor::processScan*/
+void UTILS_EXPORT seedSampling(unsigned long int S);
+/**puts the generator of the calling thread back in the state of a drand48 never seeded*/
+void UTILS_EXPORT resetSampling();
 
 double UTILS_EXPORT evalGaussian(double sigmaSquare, double delta);
 double UTILS_EXPORT evalLogGaussian(double sigmaSquare, double delta);
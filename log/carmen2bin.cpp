@@ -0,0 +1,55 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <gmapping/log/carmenconfiguration.h>
+#include <gmapping/log/carmenparser.h>
+#include <gmapping/log/sensorbinary.h>
+
+using namespace std;
+using namespace GMapping;
+
+int main(int argc, char ** argv){
+	SensorBinary::RangeEncoding encoding=SensorBinary::Float;
+	int c=1;
+	if (argc>1 && !strcmp(argv[1], "-mm")){
+		encoding=SensorBinary::Millimeters;
+		c++;
+	}
+	if (argc-c<2){
+		cerr << "usage "<<argv[0]<<" [-mm] <carmen log> <binary log>" << endl;
+		cerr << " -mm stores the ranges as 16 bit millimetres instead of floats" << endl;
+		exit (-1);
+	}
+	ifstream is(argv[c]);
+	if (! is){
+		cerr << "no file " << argv[c] << " found" << endl;
+		exit (-1);
+	}
+	CarmenConfiguration conf;
+	conf.load(is);
+	is.close();
+	SensorMap m=conf.computeSensorMap();
+
+	ofstream os(argv[c+1], ios::binary);
+	if (! os){
+		cerr << "can not write " << argv[c+1] << endl;
+		exit (-1);
+	}
+	SensorBinary::Writer writer(os, conf, m, encoding);
+	//the readings are converted one at a time, the log is not kept in memory
+	ifstream ls(argv[c]);
+	CarmenParser parser(m);
+	while (ls){
+		SensorReading* reading=parser.read(ls);
+		if (reading){
+			writer.write(*reading);
+			delete reading;
+		}
+	}
+	writer.close();
+	cerr << "readings " << writer.size() << endl;
+	if (writer.floatFallbacks())
+		cerr << writer.floatFallbacks() << " scans with ranges out of the millimetre range written as floats" << endl;
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include "gmapping/log/carmenconfiguration.h"
+#include "gmapping/log/sensorbinary.h"
 #include <iostream>
 #include <sstream>
 #include <assert.h>
@@ -16,6 +17,9 @@ using namespace std;
 
 istream& CarmenConfiguration::load(istream& is){
 	clear();
+	//the binary logs store the configuration of the text log they come from
+	if (SensorBinary::readConfiguration(is, *this))
+		return is;
 	char buf[LINEBUFFER_SIZE];
 	bool laseron=false;
 	bool rlaseron=false;
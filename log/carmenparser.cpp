@@ -0,0 +1,207 @@
+#include <cstring>
+#include <sstream>
+#include <locale>
+#include <assert.h>
+#include <stdint.h>
+#include "gmapping/log/carmenparser.h"
+
+namespace GMapping {
+
+using namespace std;
+
+static inline bool isSpace(char c){
+	return c==' ' || c=='\t' || c=='\r' || c=='\n' || c=='\v' || c=='\f';
+}
+
+static inline bool isDigit(char c){
+	return c>='0' && c<='9';
+}
+
+//the powers of ten that are exact doubles
+static const double exactPowers[]={
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*Reads a decimal number of the form [sign]digits[.digits][e[sign]digits], that is the
+whole token. Only the numbers whose digits fit in the mantissa of a double and whose
+exponent is small enough that the power of ten is exact are accepted: for them a single
+multiplication or division gives the correctly rounded value, the same strtod gives.
+These are all the numbers written in the logs in practice.*/
+static bool parseDecimal(const char* p, const char* end, double& value){
+	bool negative=false;
+	if (p<end && (*p=='-' || *p=='+')){
+		negative=*p=='-';
+		p++;
+	}
+	uint64_t mantissa=0;
+	int exponent=0;
+	bool digits=false;
+	for (; p<end && isDigit(*p); p++){
+		if (mantissa>=(1ULL<<53))
+			return false;
+		mantissa=mantissa*10+(*p-'0');
+		digits=true;
+	}
+	if (p<end && *p=='.'){
+		for (p++; p<end && isDigit(*p); p++){
+			if (mantissa>=(1ULL<<53))
+				return false;
+			mantissa=mantissa*10+(*p-'0');
+			exponent--;
+			digits=true;
+		}
+	}
+	if (!digits)
+		return false;
+	if (p<end && (*p=='e' || *p=='E')){
+		p++;
+		bool negativeExponent=false;
+		if (p<end && (*p=='-' || *p=='+')){
+			negativeExponent=*p=='-';
+			p++;
+		}
+		if (p==end || !isDigit(*p))
+			return false;
+		int e=0;
+		for (; p<end && isDigit(*p); p++){
+			if (e>1000)
+				return false;
+			e=e*10+(*p-'0');
+		}
+		exponent+=negativeExponent?-e:e;
+	}
+	if (p!=end || mantissa>(1ULL<<53) || exponent< -22 || exponent>22)
+		return false;
+	double v=(double)mantissa;
+	v=exponent<0?v/exactPowers[-exponent]:v*exactPowers[exponent];
+	value=negative?-v:v;
+	return true;
+}
+
+CarmenParser::CarmenParser(const SensorMap& sensorMap): m_cursor(0), m_end(0){
+	for (SensorMap::const_iterator it=sensorMap.begin(); it!=sensorMap.end(); it++){
+		SensorType type;
+		type.name=it->first;
+		type.odometry=dynamic_cast<const OdometrySensor*>(it->second);
+		type.range=dynamic_cast<const RangeSensor*>(it->second);
+		if (type.odometry || type.range)
+			m_sensorTypes.push_back(type);
+	}
+}
+
+SensorReading* CarmenParser::read(std::istream& is){
+	if (!getline(is, m_line))
+		return 0;
+	return parse(m_line.data(), m_line.data()+m_line.size());
+}
+
+SensorReading* CarmenParser::parse(const char* begin, const char* end){
+	m_cursor=begin;
+	m_end=end;
+	const char* name;
+	const char* nameEnd;
+	if (!nextToken(name, nameEnd))
+		return 0;
+	size_t length=nameEnd-name;
+	for (std::vector<SensorType>::const_iterator it=m_sensorTypes.begin(); it!=m_sensorTypes.end(); it++){
+		if (it->name.size()!=length || memcmp(it->name.data(), name, length))
+			continue;
+		if (it->odometry)
+			return parseOdometry(it->odometry);
+		return parseRange(it->range);
+	}
+	return 0;
+}
+
+bool CarmenParser::nextToken(const char*& token, const char*& tokenEnd){
+	while (m_cursor<m_end && isSpace(*m_cursor))
+		m_cursor++;
+	if (m_cursor==m_end)
+		return false;
+	token=m_cursor;
+	while (m_cursor<m_end && !isSpace(*m_cursor))
+		m_cursor++;
+	tokenEnd=m_cursor;
+	return true;
+}
+
+void CarmenParser::skipTokens(unsigned int n){
+	const char* token;
+	const char* tokenEnd;
+	for (unsigned int i=0; i<n && nextToken(token, tokenEnd); i++);
+}
+
+double CarmenParser::nextDouble(){
+	const char* token;
+	const char* tokenEnd;
+	if (!nextToken(token, tokenEnd))
+		return 0.;
+	double value=0.;
+	if (!parseDecimal(token, tokenEnd, value)){
+		//the rare forms left to the library, in the "C" locale
+		istringstream is(string(token, tokenEnd));
+		is.imbue(locale::classic());
+		is >> value;
+	}
+	return value;
+}
+
+unsigned int CarmenParser::nextUInt(){
+	const char* token;
+	const char* tokenEnd;
+	if (!nextToken(token, tokenEnd))
+		return 0;
+	unsigned int value=0;
+	for (const char* p=token; p<tokenEnd && isDigit(*p); p++)
+		value=value*10+(*p-'0');
+	return value;
+}
+
+OdometryReading* CarmenParser::parseOdometry(const OdometrySensor* osen){
+	OdometryReading* reading=new OdometryReading(osen);
+	OrientedPoint pose;
+	OrientedPoint speed;
+	OrientedPoint accel;
+	pose.x=nextDouble();
+	pose.y=nextDouble();
+	pose.theta=nextDouble();
+	speed.x=nextDouble();
+	speed.theta=nextDouble();
+	speed.y=0;
+	accel.x=nextDouble();
+	accel.y=accel.theta=0;
+	reading->setPose(pose); reading->setSpeed(speed); reading->setAcceleration(accel);
+	//timestamp, hostname, logger timestamp
+	reading->setTime(nextDouble());
+	return reading;
+}
+
+RangeReading* CarmenParser::parseRange(const RangeSensor* rs){
+	//laser_type, start_angle, field_of_view, angular_resolution, maximum_range, accuracy, remission_mode
+	if (rs->newFormat)
+		skipTokens(7);
+	unsigned int size=nextUInt();
+	assert(size==rs->beams().size());
+	RangeReading* reading=new RangeReading(rs);
+	reading->resize(size);
+	for (unsigned int i=0; i<size; i++)
+		(*reading)[i]=nextDouble();
+	if (rs->newFormat)
+		skipTokens(nextUInt());
+	//the laser pose
+	skipTokens(3);
+	OrientedPoint pose;
+	pose.x=nextDouble();
+	pose.y=nextDouble();
+	pose.theta=nextDouble();
+	reading->setPose(pose);
+	//laser_tv, laser_rv, forward_safety_dist, side_safty_dist, turn_axis
+	if (rs->newFormat)
+		skipTokens(5);
+	//timestamp, hostname, logger timestamp
+	reading->setTime(nextDouble());
+	return reading;
+}
+
+};
@@ -0,0 +1,434 @@
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include "gmapping/log/sensorbinary.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace GMapping {
+
+namespace SensorBinary {
+
+using namespace std;
+
+static const size_t RecordHeaderSize=8;
+static const size_t TrailerSize=16;
+//larger strings and tables are taken as a corrupted file
+static const uint32_t MaxHeaderItems=1<<20;
+
+static inline uint32_t getUInt32(const char* data){
+	const unsigned char* b=(const unsigned char*)data;
+	return b[0]|(b[1]<<8)|(b[2]<<16)|((uint32_t)b[3]<<24);
+}
+
+static inline uint64_t getUInt64(const char* data){
+	return getUInt32(data)|((uint64_t)getUInt32(data+4)<<32);
+}
+
+static inline double getDouble(const char* data){
+	uint64_t v=getUInt64(data);
+	double d;
+	memcpy(&d, &v, 8);
+	return d;
+}
+
+static inline float getFloat(const char* data){
+	uint32_t v=getUInt32(data);
+	float f;
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+static inline size_t padded(size_t size){
+	return (size+7)&~(size_t)7;
+}
+
+//the fields of the header of a mapped file, checked against its end
+static bool getUInt32(const char* data, size_t length, size_t& position, uint32_t& v){
+	if (position+4>length)
+		return false;
+	v=getUInt32(data+position);
+	position+=4;
+	return true;
+}
+
+static bool getString(const char* data, size_t length, size_t& position, std::string& s){
+	uint32_t size;
+	if (!getUInt32(data, length, position, size) || size>length-position)
+		return false;
+	s.assign(data+position, size);
+	position+=size;
+	return true;
+}
+
+bool isBinary(std::istream& is){
+	char magic[4];
+	std::streampos start=is.tellg();
+	bool binary=is.read(magic, 4) && !memcmp(magic, "GSLB", 4);
+	is.clear();
+	is.seekg(start);
+	return binary;
+}
+
+static bool readUInt32(std::istream& is, uint32_t& v){
+	char b[4];
+	if (!is.read(b, 4))
+		return false;
+	v=getUInt32(b);
+	return true;
+}
+
+static bool readString(std::istream& is, std::string& s){
+	uint32_t size;
+	if (!readUInt32(is, size) || size>MaxHeaderItems)
+		return false;
+	s.resize(size);
+	return !size || is.read(&s[0], size);
+}
+
+bool readConfiguration(std::istream& is, CarmenConfiguration& conf){
+	if (!isBinary(is))
+		return false;
+	char header[8];
+	is.read(header, 8);
+	uint32_t entries;
+	if (getUInt32(header+4)!=Version || !readUInt32(is, entries) || entries>MaxHeaderItems)
+		return false;
+	for (uint32_t e=0; e<entries; e++){
+		std::string key;
+		uint32_t values;
+		if (!readString(is, key) || !readUInt32(is, values) || values>MaxHeaderItems)
+			return false;
+		std::vector<std::string> v(values);
+		for (uint32_t i=0; i<values; i++)
+			if (!readString(is, v[i]))
+				return false;
+		conf.insert(make_pair(key, v));
+	}
+	return true;
+}
+
+//Writer
+Writer::Writer(std::ostream& os, const CarmenConfiguration& conf, const SensorMap& smap, RangeEncoding encoding):
+	m_os(os), m_encoding(encoding), m_position(0), m_floatFallbacks(0), m_closed(false){
+	put("GSLB", 4);
+	putUInt32(Version);
+	putUInt32(conf.size());
+	for (CarmenConfiguration::const_iterator it=conf.begin(); it!=conf.end(); it++){
+		putString(it->first);
+		putUInt32(it->second.size());
+		for (std::vector<std::string>::const_iterator v=it->second.begin(); v!=it->second.end(); v++)
+			putString(*v);
+	}
+	putUInt32(smap.size());
+	for (SensorMap::const_iterator it=smap.begin(); it!=smap.end(); it++){
+		putString(it->first);
+		m_sensors.push_back(it->second);
+	}
+	pad();
+	m_os.write(&m_buffer[0], m_buffer.size());
+	m_position+=m_buffer.size();
+}
+
+Writer::~Writer(){
+	close();
+}
+
+void Writer::put(const void* data, size_t size){
+	m_buffer.insert(m_buffer.end(), (const char*)data, (const char*)data+size);
+}
+
+void Writer::putUInt32(uint32_t v){
+	unsigned char b[4]={(unsigned char)v, (unsigned char)(v>>8), (unsigned char)(v>>16), (unsigned char)(v>>24)};
+	put(b, 4);
+}
+
+void Writer::putUInt64(uint64_t v){
+	putUInt32((uint32_t)v);
+	putUInt32((uint32_t)(v>>32));
+}
+
+void Writer::putDouble(double d){
+	uint64_t v;
+	memcpy(&v, &d, 8);
+	putUInt64(v);
+}
+
+void Writer::putString(const std::string& s){
+	putUInt32(s.size());
+	put(s.data(), s.size());
+}
+
+void Writer::pad(){
+	m_buffer.resize(padded(m_buffer.size()), 0);
+}
+
+bool Writer::write(const SensorReading& reading){
+	unsigned int sensor=0;
+	while (sensor<m_sensors.size() && m_sensors[sensor]!=reading.getSensor())
+		sensor++;
+	if (sensor==m_sensors.size() || sensor>255)
+		return false;
+	m_buffer.clear();
+	const OdometryReading* odometry=dynamic_cast<const OdometryReading*>(&reading);
+	const RangeReading* range=dynamic_cast<const RangeReading*>(&reading);
+	if (odometry){
+		putUInt32(7*8);
+		unsigned char type[4]={Odometry, (unsigned char)sensor, 0, 0};
+		put(type, 4);
+		putDouble(odometry->getTime());
+		putDouble(odometry->getPose().x);
+		putDouble(odometry->getPose().y);
+		putDouble(odometry->getPose().theta);
+		putDouble(odometry->getSpeed().x);
+		putDouble(odometry->getSpeed().theta);
+		putDouble(odometry->getAcceleration().x);
+	} else if (range){
+		RangeEncoding encoding=m_encoding;
+		if (encoding==Millimeters)
+			for (RangeReading::const_iterator r=range->begin(); r!=range->end(); r++)
+				if (!(*r>=0 && *r*1000.<65535.)){
+					encoding=Float;
+					m_floatFallbacks++;
+					break;
+				}
+		size_t size=padded(4*8+8+range->size()*(encoding==Float?4:2));
+		putUInt32(size);
+		unsigned char type[4]={Range, (unsigned char)sensor, (unsigned char)encoding, 0};
+		put(type, 4);
+		putDouble(range->getTime());
+		putDouble(range->getPose().x);
+		putDouble(range->getPose().y);
+		putDouble(range->getPose().theta);
+		putUInt32(range->size());
+		putUInt32(0);
+		for (RangeReading::const_iterator r=range->begin(); r!=range->end(); r++){
+			if (encoding==Float){
+				float f=*r;
+				uint32_t v;
+				memcpy(&v, &f, 4);
+				putUInt32(v);
+			} else {
+				uint16_t mm=(uint16_t)floor(*r*1000.+.5);
+				unsigned char b[2]={(unsigned char)mm, (unsigned char)(mm>>8)};
+				put(b, 2);
+			}
+		}
+		pad();
+	} else
+		return false;
+	m_offsets.push_back(m_position);
+	m_os.write(&m_buffer[0], m_buffer.size());
+	m_position+=m_buffer.size();
+	return true;
+}
+
+void Writer::close(){
+	if (m_closed)
+		return;
+	m_closed=true;
+	m_buffer.clear();
+	for (std::vector<uint64_t>::const_iterator it=m_offsets.begin(); it!=m_offsets.end(); it++)
+		putUInt64(*it);
+	putUInt64(m_position);
+	putUInt32(m_offsets.size());
+	put("GSLI", 4);
+	m_os.write(&m_buffer[0], m_buffer.size());
+	m_os.flush();
+}
+
+//File
+File::File(): m_data(0), m_length(0), m_mapped(false){}
+
+File::~File(){
+	close();
+}
+
+void File::close(){
+#ifndef _WIN32
+	if (m_mapped)
+		munmap((void*)m_data, m_length);
+#endif
+	m_data=0;
+	m_length=0;
+	m_mapped=false;
+	m_buffer.clear();
+	m_configuration.clear();
+	m_sensorTypes.clear();
+	m_offsets.clear();
+}
+
+bool File::open(const char* filename){
+	close();
+#ifndef _WIN32
+	int fd=::open(filename, O_RDONLY);
+	if (fd<0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st)<0 || st.st_size<8){
+		::close(fd);
+		return false;
+	}
+	m_length=st.st_size;
+	void* data=mmap(0, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data==MAP_FAILED){
+		m_length=0;
+		return false;
+	}
+	m_data=(const char*)data;
+	m_mapped=true;
+#else
+	ifstream is(filename, ios::binary);
+	if (!is)
+		return false;
+	m_buffer.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+	m_length=m_buffer.size();
+	m_data=m_length?&m_buffer[0]:0;
+#endif
+	if (!index()){
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool File::index(){
+	if (m_length<8 || memcmp(m_data, "GSLB", 4) || getUInt32(m_data+4)!=Version)
+		return false;
+	size_t position=8;
+	uint32_t entries;
+	if (!getUInt32(m_data, m_length, position, entries))
+		return false;
+	for (uint32_t e=0; e<entries; e++){
+		std::string key;
+		uint32_t values;
+		if (!getString(m_data, m_length, position, key) || !getUInt32(m_data, m_length, position, values) || values>MaxHeaderItems)
+			return false;
+		std::vector<std::string> v(values);
+		for (uint32_t i=0; i<values; i++)
+			if (!getString(m_data, m_length, position, v[i]))
+				return false;
+		m_configuration.insert(make_pair(key, v));
+	}
+	uint32_t sensors;
+	if (!getUInt32(m_data, m_length, position, sensors) || sensors>256)
+		return false;
+	m_sensorTypes.resize(sensors);
+	for (uint32_t s=0; s<sensors; s++){
+		if (!getString(m_data, m_length, position, m_sensorTypes[s].name))
+			return false;
+		m_sensorTypes[s].odometry=0;
+		m_sensorTypes[s].range=0;
+	}
+	size_t first=padded(position);
+
+	//the index written at the end, if the file is complete
+	if (m_length>=first+TrailerSize && !memcmp(m_data+m_length-4, "GSLI", 4)){
+		uint64_t indexOffset=getUInt64(m_data+m_length-TrailerSize);
+		uint64_t records=getUInt32(m_data+m_length-8);
+		if (indexOffset>=first && indexOffset+records*8+TrailerSize==m_length){
+			m_offsets.resize(records);
+			bool valid=true;
+			for (uint64_t i=0; i<records && valid; i++){
+				m_offsets[i]=getUInt64(m_data+indexOffset+i*8);
+				valid=m_offsets[i]>=first && m_offsets[i]+RecordHeaderSize<=indexOffset
+					&& getUInt32(m_data+m_offsets[i])<=indexOffset-m_offsets[i]-RecordHeaderSize;
+			}
+			if (valid)
+				return true;
+			m_offsets.clear();
+		}
+	}
+	//otherwise the records are scanned
+	size_t end=m_length;
+	if (m_length>=first+TrailerSize && !memcmp(m_data+m_length-4, "GSLI", 4))
+		end=getUInt64(m_data+m_length-TrailerSize)<m_length?getUInt64(m_data+m_length-TrailerSize):m_length;
+	for (size_t offset=first; offset+RecordHeaderSize<=end; ){
+		size_t size=getUInt32(m_data+offset);
+		if (size>end-offset-RecordHeaderSize)
+			break;
+		m_offsets.push_back(offset);
+		offset+=padded(RecordHeaderSize+size);
+	}
+	return true;
+}
+
+void File::setSensorMap(const SensorMap& smap){
+	for (std::vector<SensorType>::iterator it=m_sensorTypes.begin(); it!=m_sensorTypes.end(); it++){
+		SensorMap::const_iterator s=smap.find(it->name);
+		it->odometry=s==smap.end()?0:dynamic_cast<const OdometrySensor*>(s->second);
+		it->range=s==smap.end()?0:dynamic_cast<const RangeSensor*>(s->second);
+	}
+}
+
+RecordType File::type(size_t i) const{
+	return (RecordType)(unsigned char)m_data[m_offsets[i]+4];
+}
+
+double File::time(size_t i) const{
+	const char* record=m_data+m_offsets[i];
+	if (getUInt32(record)<8)
+		return 0.;
+	return getDouble(record+RecordHeaderSize);
+}
+
+size_t File::seek(double t) const{
+	size_t first=0, count=size();
+	while (count>0){
+		size_t step=count/2;
+		if (time(first+step)<t){
+			first+=step+1;
+			count-=step+1;
+		} else
+			count=step;
+	}
+	return first;
+}
+
+SensorReading* File::reading(size_t i) const{
+	const char* record=m_data+m_offsets[i];
+	uint32_t size=getUInt32(record);
+	unsigned char type=record[4];
+	unsigned char sensor=record[5];
+	unsigned char encoding=record[6];
+	const char* payload=record+RecordHeaderSize;
+	if (sensor>=m_sensorTypes.size())
+		return 0;
+	const SensorType& st=m_sensorTypes[sensor];
+	if (type==Odometry && st.odometry && size>=7*8){
+		OdometryReading* reading=new OdometryReading(st.odometry, getDouble(payload));
+		reading->setPose(OrientedPoint(getDouble(payload+8), getDouble(payload+16), getDouble(payload+24)));
+		reading->setSpeed(OrientedPoint(getDouble(payload+32), 0, getDouble(payload+40)));
+		reading->setAcceleration(OrientedPoint(getDouble(payload+48), 0, 0));
+		return reading;
+	}
+	if (type==Range && st.range && size>=5*8){
+		uint32_t beams=getUInt32(payload+32);
+		size_t width=encoding==Float?4:2;
+		if (beams>(size-5*8)/width)
+			return 0;
+		RangeReading* reading=new RangeReading(st.range, getDouble(payload));
+		reading->setPose(OrientedPoint(getDouble(payload+8), getDouble(payload+16), getDouble(payload+24)));
+		reading->resize(beams);
+		const char* r=payload+5*8;
+		if (encoding==Float)
+			for (uint32_t b=0; b<beams; b++, r+=4)
+				(*reading)[b]=getFloat(r);
+		else
+			for (uint32_t b=0; b<beams; b++, r+=2)
+				(*reading)[b]=((unsigned char)r[0]|((unsigned char)r[1]<<8))/1000.;
+		return reading;
+	}
+	return 0;
+}
+
+}; //end namespace SensorBinary
+
+}; //end namespace GMapping
@@ -1,12 +1,8 @@
 #include "gmapping/log/sensorlog.h"
 
-#include <iostream>
-#include <sstream>
-#include <assert.h>
-#include <gmapping/sensor/sensor_odometry/odometrysensor.h>
-#include <gmapping/sensor/sensor_range/rangesensor.h>
-
-#define LINEBUFFER_SIZE 100000
+#include <fstream>
+#include "gmapping/log/carmenparser.h"
+#include "gmapping/log/sensorbinary.h"
 
 namespace GMapping {
 
@@ -25,35 +21,9 @@ istream& SensorLog::load(istream& is){
 		if (*it) delete (*it);
 	clear();
 	
-	char buf[LINEBUFFER_SIZE];
+	CarmenParser parser(m_sensorMap);
 	while (is){
-		is.getline(buf, LINEBUFFER_SIZE);
-		istringstream lis(buf);
-		
-		string sensorname;
-		
-		if (lis) 
-			lis >>sensorname; 
-		else 
-			continue;
-		
-		
-			
-		SensorMap::const_iterator it=m_sensorMap.find(sensorname);
-		if (it==m_sensorMap.end()){
-			continue;
-		}
-		
-		Sensor* sensor=it->second;
-		
-		SensorReading* reading=0;
-		OdometrySensor* odometry=dynamic_cast<OdometrySensor*>(sensor);
-		if (odometry)
-			reading=parseOdometry(lis, odometry);
-		
-		RangeSensor* range=dynamic_cast<RangeSensor*>(sensor);
-		if (range)
-			reading=parseRange(lis, range);
+		SensorReading* reading=parser.read(is);
 		if (reading)
 			push_back(reading);
 	}
@@ -61,61 +31,25 @@ istream& SensorLog::load(istream& is){
 	
 }
 
-OdometryReading* SensorLog::parseOdometry(istream& is, const OdometrySensor* osen) const{
-	OdometryReading* reading=new OdometryReading(osen);
-	OrientedPoint pose;
-	OrientedPoint speed;
-	OrientedPoint accel;
-	is >> pose.x >> pose.y >> pose.theta;
-	is >> speed.x >>speed.theta;
-	speed.y=0;
-	is >> accel.x;
-	accel.y=accel.theta=0;
-	reading->setPose(pose); reading->setSpeed(speed); reading->setAcceleration(accel);
-	return reading;
-}
-
-RangeReading* SensorLog::parseRange(istream& is, const RangeSensor* rs) const{
-	if(rs->newFormat){
-		string laser_type, start_angle, field_of_view, angular_resolution, maximum_range, accuracy, remission_mode;
-		is >> laser_type>> start_angle>> field_of_view>> angular_resolution>> maximum_range>> accuracy >> remission_mode;
-	}
-	
-	unsigned int size;
-	is >> size;
-	assert(size==rs->beams().size());
-	
-	RangeReading* reading=new RangeReading(rs);
-	//cerr << "#R=" << size << endl;
-	reading->resize(size);
-	for (unsigned int i=0; i<size; i++){
-		is >> (*reading)[i];
-	}
-	if (rs->newFormat){
-		int reflectionBeams;
-		is >> reflectionBeams;
-		double reflection;
-		for (int i=0; i<reflectionBeams; i++)
-			is >> reflection;
-	}
-	//FIXME XXX
-	OrientedPoint laserPose;
-	is >> laserPose.x >> laserPose.y >> laserPose.theta;
-	OrientedPoint pose;
-	is >> pose.x >> pose.y >> pose.theta; 
-	reading->setPose(pose);
-	double a,b,c;
-	if (rs->newFormat){
-		string laser_tv, laser_rv, forward_safety_dist, side_safty_dist, turn_axis;
-		is >> laser_tv >> laser_rv >> forward_safety_dist >> side_safty_dist >> turn_axis;
-	} else {
-		is >> a >> b >> c;
+bool SensorLog::load(const char* filename){
+	SensorBinary::File file;
+	if (file.open(filename)){
+		for (iterator it=begin(); it!=end(); it++)
+			if (*it) delete (*it);
+		clear();
+		file.setSensorMap(m_sensorMap);
+		for (size_t i=0; i<file.size(); i++){
+			SensorReading* reading=file.reading(i);
+			if (reading)
+				push_back(reading);
+		}
+		return true;
 	}
-	string s;
-	is >> a >> s;
-	is >> a;
-	reading->setTime(a);
-	return reading;
+	ifstream is(filename);
+	if (!is)
+		return false;
+	load(is);
+	return true;
 }
 
 OrientedPoint SensorLog::boundingBox(double& xmin, double& ymin, double& xmax, double& ymax) const {
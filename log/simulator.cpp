@@ -0,0 +1,276 @@
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <iomanip>
+#include "gmapping/log/simulator.h"
+
+namespace GMapping {
+
+using namespace std;
+
+void SimulatedWorld::addWall(const Point& a, const Point& b){
+	Segment s={a, b};
+	walls.push_back(s);
+}
+
+void SimulatedWorld::addBox(const Point& min, const Point& max){
+	addWall(min, Point(max.x, min.y));
+	addWall(Point(max.x, min.y), max);
+	addWall(max, Point(min.x, max.y));
+	addWall(Point(min.x, max.y), min);
+}
+
+double SimulatedWorld::cast(const Point& p, double theta, double maxRange) const{
+	Point d(cos(theta), sin(theta));
+	double best=maxRange;
+	for (vector<Segment>::const_iterator it=walls.begin(); it!=walls.end(); it++){
+		Point e=it->b-it->a;
+		double den=d.x*e.y-d.y*e.x;
+		if (fabs(den)<1e-12)
+			continue;
+		Point w=it->a-p;
+		double t=(w.x*e.y-w.y*e.x)/den;
+		double u=(w.x*d.y-w.y*d.x)/den;
+		if (t>0 && t<best && u>=0 && u<=1)
+			best=t;
+	}
+	return best;
+}
+
+void SimulatedWorld::boundingBox(double& xmin, double& ymin, double& xmax, double& ymax) const{
+	xmin=ymin=1e6;
+	xmax=ymax=-1e6;
+	for (vector<Segment>::const_iterator it=walls.begin(); it!=walls.end(); it++){
+		xmin=std::min(xmin, std::min(it->a.x, it->b.x));
+		ymin=std::min(ymin, std::min(it->a.y, it->b.y));
+		xmax=std::max(xmax, std::max(it->a.x, it->b.x));
+		ymax=std::max(ymax, std::max(it->a.y, it->b.y));
+	}
+}
+
+SimulatedWorld SimulatedWorld::room(){
+	SimulatedWorld w;
+	w.addBox(Point(0,0), Point(20,12));
+	w.addBox(Point(4,3), Point(6,5));
+	w.addBox(Point(9,7), Point(12,8));
+	w.addBox(Point(15,2), Point(16,6));
+	for (int i=0; i<4; i++)
+		w.addBox(Point(3+4*i,9.5), Point(3.3+4*i,9.8));
+	//an octagon around the boxes in the middle
+	for (int i=0; i<8; i++){
+		double a=-M_PI/2+M_PI/4*i;
+		w.path.push_back(Point(10+7*cos(a), 6+4*sin(a)));
+	}
+	return w;
+}
+
+SimulatedWorld SimulatedWorld::loop(){
+	SimulatedWorld w;
+	w.addBox(Point(0,0), Point(30,20));
+	w.addBox(Point(2.5,2.5), Point(27.5,17.5));
+	//door frames, so that the corridor is not featureless
+	for (double x=5; x<27; x+=5){
+		w.addBox(Point(x,0), Point(x+0.2,0.3));
+		w.addBox(Point(x,19.7), Point(x+0.2,20));
+	}
+	for (double y=5; y<17; y+=5){
+		w.addBox(Point(0,y), Point(0.3,y+0.2));
+		w.addBox(Point(29.7,y), Point(30,y+0.2));
+	}
+	w.path.push_back(Point(1.25,1.25));
+	w.path.push_back(Point(28.75,1.25));
+	w.path.push_back(Point(28.75,18.75));
+	w.path.push_back(Point(1.25,18.75));
+	return w;
+}
+
+SimulatedWorld SimulatedWorld::corridors(){
+	SimulatedWorld w;
+	w.addBox(Point(0,0), Point(40,24));
+	w.addBox(Point(2.5,2.5), Point(18.75,21.5));
+	w.addBox(Point(21.25,2.5), Point(37.5,21.5));
+	for (double x=4; x<38; x+=6){
+		w.addBox(Point(x,0), Point(x+0.3,0.3));
+		w.addBox(Point(x,23.7), Point(x+0.3,24));
+	}
+	for (double y=5; y<21; y+=6){
+		w.addBox(Point(0,y), Point(0.3,y+0.3));
+		w.addBox(Point(39.7,y), Point(40,y+0.3));
+	}
+	//a figure eight, the middle corridor is travelled twice
+	w.path.push_back(Point(20,1.25));
+	w.path.push_back(Point(38.75,1.25));
+	w.path.push_back(Point(38.75,22.75));
+	w.path.push_back(Point(20,22.75));
+	w.path.push_back(Point(20,1.25));
+	w.path.push_back(Point(1.25,1.25));
+	w.path.push_back(Point(1.25,22.75));
+	w.path.push_back(Point(20,22.75));
+	return w;
+}
+
+SimulatedWorld SimulatedWorld::hall(){
+	SimulatedWorld w;
+	w.addBox(Point(0,0), Point(30,30));
+	for (int i=0; i<5; i++)
+	for (int j=0; j<5; j++)
+		w.addBox(Point(3+6*i,3+6*j), Point(3.5+6*i,3.5+6*j));
+	w.addBox(Point(12,13), Point(14,17));
+	w.path.push_back(Point(6,6));
+	w.path.push_back(Point(24,6));
+	w.path.push_back(Point(24,24));
+	w.path.push_back(Point(6,24));
+	return w;
+}
+
+bool SimulatedWorld::byName(SimulatedWorld& world, const std::string& name){
+	if (name=="room")
+		world=room();
+	else if (name=="loop")
+		world=loop();
+	else if (name=="corridors")
+		world=corridors();
+	else if (name=="hall")
+		world=hall();
+	else
+		return false;
+	return true;
+}
+
+Simulator::Parameters::Parameters(){
+	beams=181;
+	resolution=M_PI/180.;
+	maxRange=30;
+	rangeSigma=0.01;
+	linearStep=0.1;
+	angularStep=0.1;
+	linearDrift=0.05;
+	angularDrift=0.02;
+	angularBias=0.005;
+	seed=1;
+}
+
+Simulator::Simulator(const SimulatedWorld& world, const Parameters& p):
+	m_world(world), m_parameters(p){
+	assert(m_world.path.size()>1);
+	m_laser=new RangeSensor("FLASER", p.beams, p.resolution, OrientedPoint(0,0,0), 0, p.maxRange);
+	//the layout of CarmenConfiguration: symmetric, with a beam at 0 if the number of beams is odd
+	vector<RangeSensor::Beam>& beams=m_laser->beams();
+	unsigned int n=beams.size();
+	for (unsigned int i=0; i<n; i++){
+		if (n%2)
+			beams[i].pose.theta=((int)i-(int)(n/2))*p.resolution;
+		else
+			beams[i].pose.theta=i<n/2?-((int)(n/2)-(int)i)*p.resolution:((int)i-(int)(n/2)+1)*p.resolution;
+	}
+	m_laser->updateBeamsLookup();
+	m_odometry=new OdometrySensor("ODOM");
+	m_truePosition=new OdometrySensor("TRUEPOS", true);
+	m_sensorMap.insert(make_pair(m_laser->getName(), m_laser));
+	m_sensorMap.insert(make_pair(m_odometry->getName(), m_odometry));
+	m_sensorMap.insert(make_pair(m_truePosition->getName(), m_truePosition));
+
+	const Point& start=m_world.path[0];
+	const Point& next=m_world.path[1];
+	m_truePose=OrientedPoint(start.x, start.y, atan2(next.y-start.y, next.x-start.x));
+	m_odometryPose=m_truePose;
+	m_target=1;
+	m_time=0;
+	m_random=p.seed;
+	m_hasSpare=false;
+	m_spare=0;
+}
+
+Simulator::~Simulator(){
+	delete m_laser;
+	delete m_odometry;
+	delete m_truePosition;
+}
+
+/**splitmix64, the same sequence on every platform*/
+double Simulator::uniform(){
+	unsigned long long z=(m_random+=0x9e3779b97f4a7c15ULL);
+	z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+	z=(z^(z>>27))*0x94d049bb133111ebULL;
+	z=z^(z>>31);
+	return ((z>>11)+0.5)*(1.0/9007199254740992.0);
+}
+
+/**Box-Muller*/
+double Simulator::gaussian(double sigma){
+	if (sigma==0)
+		return 0;
+	if (m_hasSpare){
+		m_hasSpare=false;
+		return sigma*m_spare;
+	}
+	double r=sqrt(-2*log(uniform()));
+	double a=2*M_PI*uniform();
+	m_spare=r*sin(a);
+	m_hasSpare=true;
+	return sigma*r*cos(a);
+}
+
+RangeReading* Simulator::next(){
+	const Parameters& p=m_parameters;
+	//turn towards the next point of the path, then move towards it
+	Point target=m_world.path[m_target];
+	double dx=target.x-m_truePose.x, dy=target.y-m_truePose.y;
+	double distance=sqrt(dx*dx+dy*dy);
+	double dtheta=atan2(dy, dx)-m_truePose.theta;
+	dtheta=atan2(sin(dtheta), cos(dtheta));
+	double rotation=dtheta>p.angularStep?p.angularStep:(dtheta<-p.angularStep?-p.angularStep:dtheta);
+	double translation=0;
+	if (fabs(dtheta)<=p.angularStep){
+		translation=distance<p.linearStep?distance:p.linearStep;
+		if (translation==distance)
+			m_target=(m_target+1)%m_world.path.size();
+	}
+	m_truePose.theta=atan2(sin(m_truePose.theta+rotation), cos(m_truePose.theta+rotation));
+	m_truePose.x+=translation*cos(m_truePose.theta);
+	m_truePose.y+=translation*sin(m_truePose.theta);
+
+	double odometryRotation=rotation+gaussian(p.angularDrift*(translation+fabs(rotation)))+p.angularBias*translation;
+	double odometryTranslation=translation+gaussian(p.linearDrift*translation);
+	m_odometryPose.theta=atan2(sin(m_odometryPose.theta+odometryRotation), cos(m_odometryPose.theta+odometryRotation));
+	m_odometryPose.x+=odometryTranslation*cos(m_odometryPose.theta);
+	m_odometryPose.y+=odometryTranslation*sin(m_odometryPose.theta);
+	m_time+=0.1;
+
+	RangeReading* reading=new RangeReading(m_laser, m_time);
+	const vector<RangeSensor::Beam>& beams=m_laser->beams();
+	reading->resize(beams.size());
+	for (unsigned int i=0; i<beams.size(); i++){
+		double r=m_world.cast(m_truePose, m_truePose.theta+beams[i].pose.theta, p.maxRange);
+		if (r<p.maxRange){
+			r+=gaussian(p.rangeSigma);
+			r=r<0?0:r;
+		}
+		(*reading)[i]=r;
+	}
+	reading->setPose(m_odometryPose);
+	return reading;
+}
+
+void Simulator::writeCarmen(std::ostream& os, unsigned int scans){
+	os << "# simulated log, " << m_world.walls.size() << " walls" << endl;
+	os << "PARAM robot_frontlaser_offset 0" << endl;
+	os << "PARAM laser_front_laser_resolution " << m_parameters.resolution*180./M_PI << endl;
+	os << setprecision(6) << fixed;
+	for (unsigned int s=0; s<scans; s++){
+		RangeReading* reading=next();
+		const OrientedPoint& o=m_odometryPose;
+		const OrientedPoint& t=m_truePose;
+		os << "ODOM " << o.x << " " << o.y << " " << o.theta << " 0 0 0 " << m_time << " simulator " << m_time << endl;
+		os << "TRUEPOS " << t.x << " " << t.y << " " << t.theta << " " << o.x << " " << o.y << " " << o.theta
+			<< " " << m_time << " simulator " << m_time << endl;
+		os << "FLASER " << reading->size();
+		for (unsigned int i=0; i<reading->size(); i++)
+			os << " " << (*reading)[i];
+		os << " " << o.x << " " << o.y << " " << o.theta << " " << o.x << " " << o.y << " " << o.theta
+			<< " " << m_time << " simulator " << m_time << endl;
+		delete reading;
+	}
+}
+
+};
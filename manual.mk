@@ -1,4 +1,7 @@
 #CPPFLAGS+= -DNDEBUG 
+#CPPFLAGS+= -DGMAPPING_PROFILE
+#CPPFLAGS+= -DGMAPPING_COMPACT_MAP
+#CPPFLAGS+= -DGMAPPING_LOG_MAX_LEVEL=2
 CXXFLAGS+= -O3 -Wall -ffast-math
 #CXXFLAGS+= -g -O0 -Wall 
 PROFILE= false
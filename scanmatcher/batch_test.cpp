@@ -0,0 +1,104 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <gmapping/utils/commandline.h>
+#include <gmapping/log/simulator.h>
+#include <gmapping/scanmatcher/scanmatcher.h>
+
+/*Checks that scoreBatch and likelihoodAndScoreBatch give the same values as score
+and likelihoodAndScore called at each pose, on a map built from the scans of a
+simulated world, with and without the likelihood field. @returns 0 if they agree.*/
+
+using namespace std;
+using namespace GMapping;
+
+/**@returns the number of poses where the batch and the single pose evaluations differ*/
+int check(const SimulatedWorld& world, int scans, int poses, bool useLikelihoodField){
+	Simulator simulator(world);
+	const RangeSensor* laser=simulator.getLaser();
+	unsigned int beams=laser->beams().size();
+	std::vector<double> angles(beams);
+	for (unsigned int i=0; i<beams; i++)
+		angles[i]=laser->beams()[i].pose.theta;
+
+	ScanMatcher matcher;
+	matcher.setLaserParameters(beams, &angles[0], laser->getPose());
+	matcher.setMatchingParameters(25, laser->beams()[0].maxRange, 0.05, 1, 0.05, 0.05, 5, 0.075, 0);
+	matcher.setgenerateMap(true);
+	matcher.setuseLikelihoodField(useLikelihoodField);
+
+	//the map is registered at the true poses, the readings are kept to be evaluated again
+	double xmin, ymin, xmax, ymax;
+	world.boundingBox(xmin, ymin, xmax, ymax);
+	ScanMatcherMap map(Point((xmin+xmax)/2, (ymin+ymax)/2), xmin-2, ymin-2, xmax+2, ymax+2, 0.05);
+	std::vector<OrientedPoint> truePoses;
+	std::vector< std::vector<double> > readings;
+	for (int i=0; i<scans; i++){
+		RangeReading* reading=simulator.next();
+		truePoses.push_back(simulator.getTruePose());
+		readings.push_back(std::vector<double>(reading->begin(), reading->end()));
+		delete reading;
+		matcher.invalidateActiveArea();
+		matcher.computeActiveArea(map, truePoses.back(), &readings.back()[0]);
+		matcher.registerScan(map, truePoses.back(), &readings.back()[0]);
+	}
+
+	int errors=0;
+	std::vector<OrientedPoint> guesses(poses);
+	std::vector<double> s(poses), l(poses), batchScore(poses), batchLikelihood(poses);
+	for (int i=0; i<scans; i++){
+		//the poses around the true one, as the optimizer and the likelihood sampling visit them
+		for (int k=0; k<poses; k++){
+			guesses[k]=truePoses[i];
+			guesses[k].x+=0.1*sin(1.7*k+i);
+			guesses[k].y+=0.1*cos(2.3*k+i);
+			guesses[k].theta+=0.05*sin(0.7*k+i);
+		}
+		const double* r=&readings[i][0];
+		matcher.scoreBatch(map, &guesses[0], poses, r, &batchScore[0]);
+		for (int k=0; k<poses; k++){
+			double single=matcher.score(map, guesses[k], r);
+			if (single!=batchScore[k]){
+				cerr << "scan " << i << " pose " << k << ": scoreBatch " << batchScore[k] << " instead of " << single << endl;
+				errors++;
+			}
+		}
+		matcher.likelihoodAndScoreBatch(&batchScore[0], &batchLikelihood[0], map, &guesses[0], poses, r);
+		for (int k=0; k<poses; k++){
+			matcher.likelihoodAndScore(s[k], l[k], map, guesses[k], r);
+			if (s[k]!=batchScore[k] || l[k]!=batchLikelihood[k]){
+				cerr << "scan " << i << " pose " << k << ": likelihoodAndScoreBatch " << batchScore[k] << " " << batchLikelihood[k]
+					<< " instead of " << s[k] << " " << l[k] << endl;
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+int main(int argc, const char * const * argv){
+	string worldName="room";
+	int scans=100;
+	int poses=40;
+
+	CMD_PARSE_BEGIN(1,argc);
+		parseString("-world", worldName);
+		parseInt("-scans", scans);
+		parseInt("-poses", poses);
+	CMD_PARSE_END;
+	SimulatedWorld world;
+	if (!SimulatedWorld::byName(world, worldName) || scans<1 || poses<1){
+		cerr << "usage: batch_test [-world room|loop|corridors|hall] [-scans n] [-poses n]" << endl;
+		return -1;
+	}
+
+	int errors=0;
+	for (int field=0; field<2; field++){
+		int e=check(world, scans, poses, field);
+		cerr << (field?"with":"without") << " the likelihood field: " << e << " differences" << endl;
+		errors+=e;
+	}
+	cerr << (errors?"FAILED":"OK") << endl;
+	return errors?1:0;
+}
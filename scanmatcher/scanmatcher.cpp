@@ -1,7 +1,11 @@
 #include <cstring>
+#include <cmath>
 #include <limits>
 #include <list>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "gmapping/scanmatcher/scanmatcher.h"
 #include "gmapping/scanmatcher/gridlinetraversal.h"
@@ -24,12 +28,18 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0){
 	m_llsamplestep=0.01;
 	m_lasamplerange=0.005;
 	m_lasamplestep=0.005;
+	m_likelihoodThreads=1;
 	m_enlargeStep=10.;
 	m_fullnessThreshold=0.1;
 	m_angularOdometryReliability=0.;
 	m_linearOdometryReliability=0.;
 	m_freeCellRatio=sqrt(2.);
 	m_initialBeamsSkip=0;
+	m_useLikelihoodField=false;
+	m_multiResolution=false;
+	m_coarseLinearRange=0.2;
+	m_coarseAngularRange=0.1;
+	m_generateMap=false;
 	
 /*	
 	// This  are the dafault settings for a grid map of 10 cm
@@ -50,6 +60,48 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0){
    m_linePoints = new IntPoint[20000];
 }
 
+ScanMatcher::ScanMatcher(const ScanMatcher& sm){
+	m_linePoints = new IntPoint[20000];
+	*this=sm;
+}
+
+ScanMatcher& ScanMatcher::operator=(const ScanMatcher& sm){
+	if (this==&sm)
+		return *this;
+	m_activeAreaComputed=sm.m_activeAreaComputed;
+	m_laserBeams=sm.m_laserBeams;
+	memcpy(m_laserAngles, sm.m_laserAngles, sizeof(double)*m_laserBeams);
+	memcpy(m_laserCos, sm.m_laserCos, sizeof(double)*m_laserBeams);
+	memcpy(m_laserSin, sm.m_laserSin, sizeof(double)*m_laserBeams);
+	m_laserPose=sm.m_laserPose;
+	m_laserMaxRange=sm.m_laserMaxRange;
+	m_usableRange=sm.m_usableRange;
+	m_gaussianSigma=sm.m_gaussianSigma;
+	m_likelihoodSigma=sm.m_likelihoodSigma;
+	m_kernelSize=sm.m_kernelSize;
+	m_optAngularDelta=sm.m_optAngularDelta;
+	m_optLinearDelta=sm.m_optLinearDelta;
+	m_optRecursiveIterations=sm.m_optRecursiveIterations;
+	m_likelihoodSkip=sm.m_likelihoodSkip;
+	m_llsamplerange=sm.m_llsamplerange;
+	m_llsamplestep=sm.m_llsamplestep;
+	m_lasamplerange=sm.m_lasamplerange;
+	m_lasamplestep=sm.m_lasamplestep;
+	m_likelihoodThreads=sm.m_likelihoodThreads;
+	m_generateMap=sm.m_generateMap;
+	m_enlargeStep=sm.m_enlargeStep;
+	m_fullnessThreshold=sm.m_fullnessThreshold;
+	m_angularOdometryReliability=sm.m_angularOdometryReliability;
+	m_linearOdometryReliability=sm.m_linearOdometryReliability;
+	m_freeCellRatio=sm.m_freeCellRatio;
+	m_initialBeamsSkip=sm.m_initialBeamsSkip;
+	m_useLikelihoodField=sm.m_useLikelihoodField;
+	m_multiResolution=sm.m_multiResolution;
+	m_coarseLinearRange=sm.m_coarseLinearRange;
+	m_coarseAngularRange=sm.m_coarseAngularRange;
+	return *this;
+}
+
 ScanMatcher::~ScanMatcher(){
 	delete [] m_linePoints;
 }
@@ -62,7 +114,7 @@ void ScanMatcher::invalidateActiveArea(){
 void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p, const double* readings){
 	if (m_activeAreaComputed)
 		return;
-	HierarchicalArray2D<PointAccumulator>::PointSet activeArea;
+	HierarchicalArray2D<ScanMatcherCell>::PointSet activeArea;
 	OrientedPoint lp=p;
 	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
@@ -121,6 +173,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
 	IntPoint p0=map.world2map(lp);
+	double c=cos(lp.theta), s=sin(lp.theta);
 	
 	Point min(map.map2world(0,0));
 	Point max(map.map2world(map.getMapSizeX()-1,map.getMapSizeY()-1));
@@ -135,9 +188,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++){
 		if (*r>m_laserMaxRange||*r==0.0||isnan(*r)) continue;
 		double d=*r>m_usableRange?m_usableRange:*r;
-		Point phit=lp;
-		phit.x+=d*cos(lp.theta+*angle);
-		phit.y+=d*sin(lp.theta+*angle);
+		Point phit=lp+beamDirection(c, s, angle-m_laserAngles)*d;
 		if (phit.x<min.x) min.x=phit.x;
 		if (phit.y<min.y) min.y=phit.y;
 		if (phit.x>max.x) max.x=phit.x;
@@ -159,7 +210,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 		//cerr << "RESIZE " << min.x << " " << min.y << " " << max.x << " " << max.y << endl;
 	}
 	
-	HierarchicalArray2D<PointAccumulator>::PointSet activeArea;
+	HierarchicalArray2D<ScanMatcherCell>::PointSet activeArea;
 	/*allocate the active area*/
 	angle=m_laserAngles+m_initialBeamsSkip;
 	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++)
@@ -169,7 +220,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 				continue;
 			if (d>m_usableRange)
 				d=m_usableRange;
-			Point phit=lp+Point(d*cos(lp.theta+*angle),d*sin(lp.theta+*angle));
+			Point phit=lp+beamDirection(c, s, angle-m_laserAngles)*d;
 			IntPoint p0=map.world2map(lp);
 			IntPoint p1=map.world2map(phit);
 			
@@ -189,9 +240,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 			}
 		} else {
 			if (*r>m_laserMaxRange||*r>m_usableRange||*r==0.0||isnan(*r)) continue;
-			Point phit=lp;
-			phit.x+=*r*cos(lp.theta+*angle);
-			phit.y+=*r*sin(lp.theta+*angle);
+			Point phit=lp+beamDirection(c, s, angle-m_laserAngles)*(*r);
 			IntPoint p1=map.world2map(phit);
 			assert(p1.x>=0 && p1.y>=0);
 			IntPoint cp=map.storage().patchIndexes(p1);
@@ -203,7 +252,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 	//cout << "activeArea::size() " << activeArea.size() << endl;
 /*	
 	cerr << "ActiveArea=";
-	for (HierarchicalArray2D<PointAccumulator>::PointSet::const_iterator it=activeArea.begin(); it!= activeArea.end(); it++){
+	for (HierarchicalArray2D<ScanMatcherCell>::PointSet::const_iterator it=activeArea.begin(); it!= activeArea.end(); it++){
 		cerr << "(" << it->x <<"," << it->y << ") ";
 	}
 	cerr << endl;
@@ -218,16 +267,24 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 		
 	//this operation replicates the cells that will be changed in the registration operation
 	map.storage().allocActiveArea();
+	//and the bytes of their occupancy
+	ScanMatcherStorage::OccupancyPlane& occupancy=map.storage().occupancyPlane();
+	occupancy.setActiveArea(map.storage().getActiveArea(), true);
+	occupancy.allocActiveArea();
 	
 	OrientedPoint lp=p;
 	lp.x+=cos(p.theta)*m_laserPose.x-sin(p.theta)*m_laserPose.y;
 	lp.y+=sin(p.theta)*m_laserPose.x+cos(p.theta)*m_laserPose.y;
 	lp.theta+=m_laserPose.theta;
 	IntPoint p0=map.world2map(lp);
+	double c=cos(lp.theta), s=sin(lp.theta);
 	
 	
 	const double * angle=m_laserAngles+m_initialBeamsSkip;
 	double esum=0;
+	//the cells whose occupancy changed are needed to update the likelihood field and the pyramid
+	bool trackChanges=m_useLikelihoodField||m_multiResolution;
+	m_changedCells.clear();
 	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++)
 		if (m_generateMap){
 			double d=*r;
@@ -235,38 +292,147 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 				continue;
 			if (d>m_usableRange)
 				d=m_usableRange;
-			Point phit=lp+Point(d*cos(lp.theta+*angle),d*sin(lp.theta+*angle));
+			Point phit=lp+beamDirection(c, s, angle-m_laserAngles)*d;
 			IntPoint p1=map.world2map(phit);
 			//IntPoint linePoints[20000] ;
 			GridLineTraversalLine line;
 			line.points=m_linePoints;
 			GridLineTraversal::gridLine(p0, p1, &line);
 			for (int i=0; i<line.num_points-1; i++){
-				PointAccumulator& cell=map.cell(line.points[i]);
+				ScanMatcherCell& cell=map.cell(line.points[i]);
 				double e=-cell.entropy();
+				unsigned char& flags=occupancy.cell(line.points[i]);
+				//a free observation changes the field only if the cell stops being occupied
+				bool occupied=flags&ScanMatcherStorage::Occupied;
 				cell.update(false, Point(0,0));
 				e+=cell.entropy();
 				esum+=e;
+				flags=occupancyFlags(cell);
+				if (trackChanges && occupied && !(flags&ScanMatcherStorage::Occupied))
+					m_changedCells.push_back(line.points[i]);
 			}
 			if (d<m_usableRange){
-				double e=-map.cell(p1).entropy();
-				map.cell(p1).update(true, phit);
-				e+=map.cell(p1).entropy();
+				ScanMatcherCell& cell=map.cell(p1);
+				double e=-cell.entropy();
+				cell.update(true, phit, map.map2world(p1));
+				e+=cell.entropy();
 				esum+=e;
+				unsigned char flags=occupancyFlags(cell);
+				occupancy.cell(p1)=flags;
+				if (trackChanges && (flags&ScanMatcherStorage::Occupied))
+					m_changedCells.push_back(p1);
 			}
 		} else {
 			if (*r>m_laserMaxRange||*r>m_usableRange||*r==0.0||isnan(*r)) continue;
-			Point phit=lp;
-			phit.x+=*r*cos(lp.theta+*angle);
-			phit.y+=*r*sin(lp.theta+*angle);
+			Point phit=lp+beamDirection(c, s, angle-m_laserAngles)*(*r);
 			IntPoint p1=map.world2map(phit);
 			assert(p1.x>=0 && p1.y>=0);
-			map.cell(p1).update(true,phit);
+			ScanMatcherCell& cell=map.cell(p1);
+			cell.update(true, phit, map.map2world(p1));
+			unsigned char flags=occupancyFlags(cell);
+			occupancy.cell(p1)=flags;
+			if (trackChanges && (flags&ScanMatcherStorage::Occupied))
+				m_changedCells.push_back(p1);
 		}
+	if (m_useLikelihoodField)
+		updateLikelihoodField(map);
+	if (m_multiResolution)
+		updatePyramid(map);
 	//cout  << "informationGain=" << -esum << endl;
 	return esum;
 }
 
+/**Recomputes the likelihood field around the cells changed by the last registration.
+Only the field cells within the kernel of a changed cell are affected, and only their
+patches are detached from the other particles. The field cells are collected first,
+so that a cell near several changed cells is evaluated once.*/
+void ScanMatcher::updateLikelihoodField(ScanMatcherMap& map){
+	if (m_changedCells.empty())
+		return;
+	ScanMatcherStorage::LikelihoodField& field=map.storage().likelihoodField();
+	m_fieldCells.clear();
+	for (std::vector<IntPoint>::const_iterator it=m_changedCells.begin(); it!=m_changedCells.end(); it++)
+		for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+		for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+			IntPoint pr=*it+IntPoint(xx,yy);
+			if (map.isInside(pr))
+				m_fieldCells.push_back(pr);
+		}
+	std::sort(m_fieldCells.begin(), m_fieldCells.end(), pointcomparator<int>());
+	//drops the repeated cells and collects their patches
+	HierarchicalArray2D<LikelihoodFieldCell>::PointSet fieldArea;
+	IntPoint lastPatch(-1,-1);
+	size_t unique=0;
+	for (size_t i=0; i<m_fieldCells.size(); i++){
+		const IntPoint& pc=m_fieldCells[i];
+		if (unique && pc.x==m_fieldCells[unique-1].x && pc.y==m_fieldCells[unique-1].y)
+			continue;
+		m_fieldCells[unique++]=pc;
+		IntPoint patch=field.patchIndexes(pc);
+		if (patch.x!=lastPatch.x || patch.y!=lastPatch.y)
+			fieldArea.insert(patch);
+		lastPatch=patch;
+	}
+	m_fieldCells.resize(unique);
+	field.setActiveArea(fieldArea, true);
+	field.allocActiveArea();
+	
+	const ScanMatcherMap& cmap=map;
+	for (std::vector<IntPoint>::const_iterator it=m_fieldCells.begin(); it!=m_fieldCells.end(); it++){
+		const IntPoint& pc=*it;
+		Point center=map.map2world(pc);
+		LikelihoodFieldCell fcell;
+		double bestDistance=0;
+		for (int kx=-m_kernelSize; kx<=m_kernelSize; kx++)
+		for (int ky=-m_kernelSize; ky<=m_kernelSize; ky++){
+			IntPoint pk=pc+IntPoint(kx,ky);
+			if (cmap.storage().occupancy(pk)&ScanMatcherStorage::Occupied){
+				Point mean=cmap.cell(pk).mean(map.map2world(pk));
+				Point delta=mean-center;
+				double distance=delta*delta;
+				if (!fcell.valid || distance<bestDistance){
+					fcell.mean=LikelihoodFieldCell::FloatPoint(mean.x, mean.y);
+					fcell.valid=true;
+					bestDistance=distance;
+				}
+			}
+		}
+		field.cell(pc)=fcell;
+	}
+}
+
+/**Recomputes the cells of the pyramid covering the cells changed by the last registration,
+level by level: a cell of the level k is the maximum of the four cells of the level k-1 it covers.*/
+void ScanMatcher::updatePyramid(ScanMatcherMap& map){
+	if (m_changedCells.empty())
+		return;
+	ScanMatcherStorage& storage=map.storage();
+	ScanMatcherStorage::PyramidLevel::PointSet cells;
+	for (std::vector<IntPoint>::const_iterator it=m_changedCells.begin(); it!=m_changedCells.end(); it++)
+		cells.insert(*it);
+	for (int k=1; k<=storage.pyramidLevels(); k++){
+		ScanMatcherStorage::PyramidLevel& level=storage.pyramidLevel(k);
+		ScanMatcherStorage::PyramidLevel::PointSet coarseCells;
+		for (ScanMatcherStorage::PyramidLevel::PointSet::const_iterator it=cells.begin(); it!=cells.end(); it++)
+			coarseCells.insert(IntPoint(it->x>>1, it->y>>1));
+		level.setActiveArea(coarseCells);
+		level.allocActiveArea();
+		for (ScanMatcherStorage::PyramidLevel::PointSet::const_iterator it=coarseCells.begin(); it!=coarseCells.end(); it++){
+			unsigned char value=0;
+			for (int xx=0; xx<2 && !value; xx++)
+			for (int yy=0; yy<2 && !value; yy++){
+				IntPoint pc(2*it->x+xx, 2*it->y+yy);
+				if (k==1)
+					value=storage.occupancy(pc)&ScanMatcherStorage::Occupied;
+				else
+					value=storage.pyramidCell(k-1, pc);
+			}
+			level.cell(*it)=value;
+		}
+		cells.swap(coarseCells);
+	}
+}
+
 /*
 void ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, const double* readings){
 	if (!m_activeAreaComputed)
@@ -330,14 +496,341 @@ double ScanMatcher::icpOptimize(OrientedPoint& pnew, const ScanMatcherMap& map,
 		start=pnew;
 		iterations++;
 	} while (sc>currentScore);
-	cerr << "i="<< iterations << endl;
+	GMAPPING_DEBUG("i="<< iterations << endl);
 	return currentScore;
 }
 
+/**Upper bound of the score of the beams with cells (cx,cy) translated by any offset in
+[dx,dx+2^level)x[dy,dy+2^level): a beam can score at most one, and only if an occupied
+cell lies within the kernel of its endpoint. At level 0 it is checked on the map,
+above on the corresponding level of the pyramid.*/
+unsigned int ScanMatcher::coarseBound(const ScanMatcherMap& map, const int* cx, const int* cy, unsigned int beams, int level, int dx, int dy) const{
+	const ScanMatcherStorage& storage=map.storage();
+	int size=1<<level;
+	unsigned int bound=0;
+	for (unsigned int i=0; i<beams; i++){
+		int xmin=cx[i]+dx-m_kernelSize, xmax=cx[i]+dx+size-1+m_kernelSize;
+		int ymin=cy[i]+dy-m_kernelSize, ymax=cy[i]+dy+size-1+m_kernelSize;
+		if (xmax<0 || ymax<0)
+			continue;
+		xmin=xmin<0?0:xmin;
+		ymin=ymin<0?0:ymin;
+		bool occupied=false;
+		for (int x=xmin>>level; x<=xmax>>level && !occupied; x++)
+		for (int y=ymin>>level; y<=ymax>>level && !occupied; y++){
+			if (level)
+				occupied=storage.pyramidCell(level, IntPoint(x,y));
+			else
+				occupied=storage.occupancy(IntPoint(x,y))&ScanMatcherStorage::Occupied;
+		}
+		bound+=occupied;
+	}
+	return bound;
+}
+
+/**A set of poses of the coarse search: the rotation and the translations
+[dx,dx+2^level)x[dy,dy+2^level), in cells*/
+struct SearchNode{
+	int rotation;
+	int dx, dy;
+	int level;
+	double bound;
+};
+
+inline bool operator<(const SearchNode& a, const SearchNode& b){
+	return a.bound<b.bound;
+}
+
+/**Branch and bound search of the best pose on the grid of the map cells and of the
+rotations within coarseLinearRange and coarseAngularRange around init, using the beams
+prepared for score. The sets of translations are bounded on the levels of the pyramid,
+coarse to fine, and the single poses are scored as in optimize.
+Only the poses scoring better than bestScore are considered.
+@returns the best pose found, init if none scores better than bestScore*/
+OrientedPoint ScanMatcher::coarseSearch(double& bestScore, const ScanMatcherMap& map, const OrientedPoint& init) const{
+	OrientedPoint bestPose=init;
+	unsigned int beams=m_scoreBeams.size();
+	if (!beams)
+		return bestPose;
+	double delta=map.getDelta();
+	//the angular step moves the farthest endpoint by about one cell
+	double rmax=0;
+	for (unsigned int i=0; i<beams; i++){
+		double r=sqrt(m_scoreBeams.hitX[i]*m_scoreBeams.hitX[i]+m_scoreBeams.hitY[i]*m_scoreBeams.hitY[i]);
+		rmax=r>rmax?r:rmax;
+	}
+	double astep=rmax>delta?delta/rmax:m_coarseAngularRange;
+	int rotations=(int)ceil(m_coarseAngularRange/astep);
+	int window=(int)ceil(m_coarseLinearRange/delta);
+	int levels=map.storage().pyramidLevels();
+	
+	m_searchX.resize((2*rotations+1)*beams);
+	m_searchY.resize((2*rotations+1)*beams);
+	IntPoint origin=map.world2map(map.getCenter());
+	for (int r=-rotations; r<=rotations; r++){
+		OrientedPoint pose=init;
+		pose.theta+=r*astep;
+		projectBeams(m_projection, m_scoreBeams, laserPoseAt(pose), map.getCenter(), delta, origin);
+		std::copy(m_projection.cellX.begin(), m_projection.cellX.begin()+beams, m_searchX.begin()+(r+rotations)*beams);
+		std::copy(m_projection.cellY.begin(), m_projection.cellY.begin()+beams, m_searchY.begin()+(r+rotations)*beams);
+	}
+	
+	std::vector<SearchNode> stack;
+	int size=1<<levels;
+	for (int r=0; r<2*rotations+1; r++)
+	for (int dx=-window; dx<=window; dx+=size)
+	for (int dy=-window; dy<=window; dy+=size){
+		SearchNode node={r, dx, dy, levels, 0.};
+		node.bound=coarseBound(map, &m_searchX[r*beams], &m_searchY[r*beams], beams, levels, dx, dy);
+		m_matchStatistics.searchNodes++;
+		if (node.bound>bestScore)
+			stack.push_back(node);
+	}
+	std::sort(stack.begin(), stack.end());
+	
+	//depth first, the most promising node of each level first
+	while (!stack.empty()){
+		SearchNode node=stack.back();
+		stack.pop_back();
+		if (node.bound<=bestScore)
+			continue;
+		OrientedPoint pose=init;
+		pose.x+=node.dx*delta;
+		pose.y+=node.dy*delta;
+		pose.theta+=(node.rotation-rotations)*astep;
+		if (node.level<0){
+			//a single pose, the bound is its score
+			bestScore=node.bound;
+			bestPose=pose;
+			continue;
+		}
+		if (node.level==0){
+			SearchNode leaf=node;
+			leaf.level=-1;
+			leaf.bound=odometryGain(init, pose)*score(map, pose, m_scoreBeams);
+			m_matchStatistics.searchNodes++;
+			if (leaf.bound>bestScore)
+				stack.push_back(leaf);
+			continue;
+		}
+		int half=1<<(node.level-1);
+		std::vector<SearchNode>::size_type first=stack.size();
+		for (int xx=0; xx<2; xx++)
+		for (int yy=0; yy<2; yy++){
+			SearchNode child={node.rotation, node.dx+xx*half, node.dy+yy*half, node.level-1, 0.};
+			if (child.dx>window || child.dy>window)
+				continue;
+			const int* cx=&m_searchX[node.rotation*beams];
+			const int* cy=&m_searchY[node.rotation*beams];
+			child.bound=coarseBound(map, cx, cy, beams, child.level, child.dx, child.dy);
+			m_matchStatistics.searchNodes++;
+			if (child.bound>bestScore)
+				stack.push_back(child);
+		}
+		std::sort(stack.begin()+first, stack.end());
+	}
+	return bestPose;
+}
+
+void ScanMatcher::scoreBatch(const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const double* readings, double* out) const{
+	prepareBeams(m_scoreBeams, readings, map.getDelta()*map.getDelta()*m_freeCellRatio, true);
+	evaluateBatch(out, 0, map, poses, n, m_scoreBeams);
+}
+
+void ScanMatcher::scoreBatch(const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams, double* out) const{
+	evaluateBatch(out, 0, map, poses, n, beams);
+}
+
+void ScanMatcher::likelihoodAndScoreBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const double* readings) const{
+	prepareBeams(m_likelihoodBeams, readings, map.getDelta()*m_freeCellRatio, false);
+	evaluateBatch(s, l, map, poses, n, m_likelihoodBeams);
+}
+
+void ScanMatcher::likelihoodAndScoreBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams) const{
+	evaluateBatch(s, l, map, poses, n, beams);
+}
+
+/**Scores the beams at the n poses, beam by beam. For a beam, the poses which place its
+endpoint and its free cell on the same cells search the same kernel: the occupied cells of
+the last few kernels searched are kept, with their means, and the poses only compare their
+endpoints with them. The candidates are visited in the order of score, so the results are
+the same as those of score and likelihoodAndScore. l is only computed when not null.*/
+void ScanMatcher::evaluateBatch(double* s, double* l, const ScanMatcherMap& map, const OrientedPoint* poses, size_t n, const BeamSet& beams) const{
+	if (m_batchProjections.size()<n)
+		m_batchProjections.resize(n);
+	IntPoint origin=map.world2map(map.getCenter());
+	for (size_t j=0; j<n; j++){
+		projectBeams(m_batchProjections[j], beams, laserPoseAt(poses[j]), map.getCenter(), map.getDelta(), origin);
+		s[j]=0;
+		if (l)
+			l[j]=0;
+	}
+	const unsigned int Kernels=4;
+	if (m_neighbourhoods.size()<Kernels)
+		m_neighbourhoods.resize(Kernels);
+	const ScanMatcherStorage& storage=map.storage();
+	double noHit=nullLikelihood/(m_likelihoodSigma);
+	for (unsigned int i=0; i<beams.size(); i++){
+		unsigned int kernels=0, next=0;
+		for (size_t j=0; j<n; j++){
+			const BeamProjection& proj=m_batchProjections[j];
+			Point phit(proj.hitX[i], proj.hitY[i]);
+			IntPoint iphit(proj.cellX[i], proj.cellY[i]);
+			bool found=false;
+			Point bestMu(0.,0.);
+			if (m_useLikelihoodField){
+				found=likelihoodFieldLookup(bestMu, map, phit, iphit);
+			} else {
+				IntPoint ipfree(proj.freeX[i], proj.freeY[i]);
+				const KernelNeighbourhood* kernel=0;
+				for (unsigned int k=0; k<kernels && !kernel; k++){
+					const KernelNeighbourhood& searched=m_neighbourhoods[k];
+					if (searched.cell.x==iphit.x && searched.cell.y==iphit.y && searched.free.x==ipfree.x && searched.free.y==ipfree.y)
+						kernel=&searched;
+				}
+				if (!kernel){
+					KernelNeighbourhood& searched=m_neighbourhoods[next];
+					next=(next+1)%Kernels;
+					kernels=kernels<Kernels?kernels+1:kernels;
+					searched.cell=iphit;
+					searched.free=ipfree;
+					searched.means.clear();
+					for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+					for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++){
+						IntPoint pr=iphit+IntPoint(xx,yy);
+						IntPoint pf=pr+ipfree;
+						if ((storage.occupancy(pr)&ScanMatcherStorage::Occupied) && !(storage.occupancy(pf)&ScanMatcherStorage::NotFree))
+							searched.means.push_back(map.cell(pr).mean(map.map2world(pr)));
+					}
+					kernel=&searched;
+				}
+				unsigned int candidates=kernel->means.size();
+				if (candidates){
+					const Point* means=&kernel->means[0];
+					bestMu=phit-means[0];
+					for (unsigned int c=1; c<candidates; c++){
+						Point mu=phit-means[c];
+						bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
+					}
+					found=true;
+				}
+			}
+			if (found)
+				s[j]+=exp(-1./m_gaussianSigma*bestMu*bestMu);
+			if (l){
+				double f=(-1./m_likelihoodSigma)*(bestMu*bestMu);
+				l[j]+=(found)?f:noHit;
+			}
+		}
+	}
+}
+
+/**The scores of the poses already evaluated by a call of optimize. The hill climbing moves
+on a lattice whose step only halves, so after a move the previous pose is one of the
+neighbours again. The poses are found by their coordinates quantized well below the finest
+step, so that the rounding of the moves does not matter. It holds a fixed number of poses,
+the ones beyond it are not cached.*/
+class PoseScoreCache{
+	public:
+		PoseScoreCache(): m_size(0){
+			Entry empty={{0,0,0}, 0., 0., false};
+			for (unsigned int i=0; i<Capacity; i++)
+				m_entries[i]=empty;
+		}
+		/**@returns true and the score and likelihood of p if it was already evaluated*/
+		bool find(const OrientedPoint& p, double& score, double& likelihood) const{
+			Key k=key(p);
+			for (unsigned int i=hash(k), n=0; n<Capacity && m_entries[i].used; i=(i+1)&(Capacity-1), n++)
+				if (m_entries[i].key==k){
+					score=m_entries[i].score;
+					likelihood=m_entries[i].likelihood;
+					return true;
+				}
+			return false;
+		}
+		void insert(const OrientedPoint& p, double score, double likelihood=0.){
+			if (2*m_size>=Capacity)
+				return;
+			Key k=key(p);
+			unsigned int i=hash(k);
+			while (m_entries[i].used){
+				if (m_entries[i].key==k)
+					return;
+				i=(i+1)&(Capacity-1);
+			}
+			Entry& e=m_entries[i];
+			e.used=true;
+			e.key=k;
+			e.score=score;
+			e.likelihood=likelihood;
+			m_size++;
+		}
+	protected:
+		enum {Capacity=256};
+		struct Key{
+			long long x, y, theta;
+			inline bool operator==(const Key& k) const { return x==k.x && y==k.y && theta==k.theta; }
+		};
+		struct Entry{
+			Key key;
+			double score, likelihood;
+			bool used;
+		};
+		static Key key(const OrientedPoint& p){
+			//a micrometre and a microradian, far below the steps of the search
+			Key k={llround(p.x*1e6), llround(p.y*1e6), llround(p.theta*1e6)};
+			return k;
+		}
+		static unsigned int hash(const Key& k){
+			unsigned long long h=k.x*0x9E3779B97F4A7C15ULL ^ k.y*0xC2B2AE3D27D4EB4FULL ^ k.theta*0x165667B19E3779F9ULL;
+			return (unsigned int)(h>>32)&(Capacity-1);
+		}
+		Entry m_entries[Capacity];
+		unsigned int m_size;
+};
+
+/**Fills the scores (and the likelihoods with the likelihood beams) of the moves, taking the
+poses already evaluated from the cache and evaluating the others in a single batch.
+The hill climbing has at most six moves.
+@returns the number of poses evaluated*/
+static unsigned int scoreMoves(double* scores, double* likelihoods, PoseScoreCache& cache, const ScanMatcher& matcher,
+	const ScanMatcherMap& map, const OrientedPoint* moves, unsigned int n, const BeamSet& beams, bool likelihood){
+	assert(n<=6);
+	OrientedPoint batch[6];
+	unsigned int index[6];
+	unsigned int batched=0;
+	for (unsigned int m=0; m<n; m++)
+		if (!cache.find(moves[m], scores[m], likelihoods[m])){
+			batch[batched]=moves[m];
+			index[batched++]=m;
+		}
+	if (!batched)
+		return 0;
+	double batchScores[6], batchLikelihoods[6];
+	if (likelihood)
+		matcher.likelihoodAndScoreBatch(batchScores, batchLikelihoods, map, batch, batched, beams);
+	else
+		matcher.scoreBatch(map, batch, batched, beams, batchScores);
+	for (unsigned int b=0; b<batched; b++){
+		unsigned int m=index[b];
+		scores[m]=batchScores[b];
+		likelihoods[m]=likelihood?batchLikelihoods[b]:0.;
+		cache.insert(moves[m], scores[m], likelihoods[m]);
+	}
+	return batched;
+}
+
 double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const{
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 	double bestScore=-1;
 	OrientedPoint currentPose=init;
-	double currentScore=score(map, currentPose, readings);
+	prepareBeams(m_scoreBeams, readings, map.getDelta()*map.getDelta()*m_freeCellRatio, true);
+	double currentScore=score(map, currentPose, m_scoreBeams);
+	PoseScoreCache cache;
+	cache.insert(currentPose, currentScore);
+	unsigned int evaluations=1;
+	if (m_multiResolution)
+		currentPose=coarseSearch(currentScore, map, init);
 	double adelta=m_optAngularDelta, ldelta=m_optLinearDelta;
 	unsigned int refinement=0;
 	enum Move{Front, Back, Left, Right, TurnLeft, TurnRight, Done};
@@ -358,6 +851,8 @@ double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, con
 //		cout <<  "pose=" << currentPose.x  << " " << currentPose.y << " " << currentPose.theta << endl;
 		OrientedPoint bestLocalPose=currentPose;
 		OrientedPoint localPose=currentPose;
+		OrientedPoint moves[Done];
+		unsigned int moveCount=0;
 
 		Move move=Front;
 		do {
@@ -389,32 +884,30 @@ double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, con
 					break;
 				default:;
 			}
-			
-			double odo_gain=1;
-			if (m_angularOdometryReliability>0.){
-				double dth=init.theta-localPose.theta; 	dth=atan2(sin(dth), cos(dth)); 	dth*=dth;
-				odo_gain*=exp(-m_angularOdometryReliability*dth);
-			}
-			if (m_linearOdometryReliability>0.){
-				double dx=init.x-localPose.x;
-				double dy=init.y-localPose.y;
-				double drho=dx*dx+dy*dy;
-				odo_gain*=exp(-m_linearOdometryReliability*drho);
-			}
-			double localScore=odo_gain*score(map, localPose, readings);
-			
+			moves[moveCount++]=localPose;
+		} while(move!=Done);
+
+		//the neighbours not scored yet are evaluated in a single batch
+		double scores[Done], likelihoods[Done];
+		evaluations+=scoreMoves(scores, likelihoods, cache, *this, map, moves, moveCount, m_scoreBeams, false);
+		for (unsigned int m=0; m<moveCount; m++){
+			double localScore=scores[m]*odometryGain(init, moves[m]);
 			if (localScore>currentScore){
 				currentScore=localScore;
-				bestLocalPose=localPose;
+				bestLocalPose=moves[m];
 			}
 			c_iterations++;
-		} while(move!=Done);
+		}
 		currentPose=bestLocalPose;
 //		cout << "currentScore=" << currentScore<< endl;
 		//here we look for the best move;
 	}while (currentScore>bestScore || refinement<m_optRecursiveIterations);
 	//cout << __func__ << "bestScore=" << bestScore<< endl;
 	//cout << __func__ << "iterations=" << c_iterations<< endl;
+	m_matchStatistics.matches++;
+	m_matchStatistics.iterations+=c_iterations;
+	m_matchStatistics.evaluations+=evaluations;
+	m_matchStatistics.time+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
 	pnew=currentPose;
 	return bestScore;
 }
@@ -428,11 +921,16 @@ struct ScoredMove{
 typedef std::list<ScoredMove> ScoredMoveList;
 
 double ScanMatcher::optimize(OrientedPoint& _mean, ScanMatcher::CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const{
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 	ScoredMoveList moveList;
 	double bestScore=-1;
 	OrientedPoint currentPose=init;
 	ScoredMove sm={currentPose,0,0};
-	unsigned int matched=likelihoodAndScore(sm.score, sm.likelihood, map, currentPose, readings);
+	prepareBeams(m_likelihoodBeams, readings, map.getDelta()*m_freeCellRatio, false);
+	likelihoodAndScore(sm.score, sm.likelihood, map, currentPose, m_likelihoodBeams);
+	PoseScoreCache cache;
+	cache.insert(currentPose, sm.score, sm.likelihood);
+	unsigned int evaluations=1;
 	double currentScore=sm.score;
 	moveList.push_back(sm);
 	double adelta=m_optAngularDelta, ldelta=m_optLinearDelta;
@@ -450,6 +948,8 @@ double ScanMatcher::optimize(OrientedPoint& _mean, ScanMatcher::CovarianceMatrix
 //		cout <<  "pose=" << currentPose.x  << " " << currentPose.y << " " << currentPose.theta << endl;
 		OrientedPoint bestLocalPose=currentPose;
 		OrientedPoint localPose=currentPose;
+		OrientedPoint moves[Done];
+		unsigned int moveCount=0;
 
 		Move move=Front;
 		do {
@@ -481,33 +981,24 @@ double ScanMatcher::optimize(OrientedPoint& _mean, ScanMatcher::CovarianceMatrix
 					break;
 				default:;
 			}
-			double localScore, localLikelihood;
-			
-			double odo_gain=1;
-			if (m_angularOdometryReliability>0.){
-				double dth=init.theta-localPose.theta; 	dth=atan2(sin(dth), cos(dth)); 	dth*=dth;
-				odo_gain*=exp(-m_angularOdometryReliability*dth);
-			}
-			if (m_linearOdometryReliability>0.){
-				double dx=init.x-localPose.x;
-				double dy=init.y-localPose.y;
-				double drho=dx*dx+dy*dy;
-				odo_gain*=exp(-m_linearOdometryReliability*drho);
-			}
-			localScore=odo_gain*score(map, localPose, readings);
-			//update the score
+			moves[moveCount++]=localPose;
+		} while(move!=Done);
+
+		//the score and the likelihood of the neighbours not scored yet, in a single batch
+		double scores[Done], likelihoods[Done];
+		evaluations+=scoreMoves(scores, likelihoods, cache, *this, map, moves, moveCount, m_likelihoodBeams, true);
+		for (unsigned int m=0; m<moveCount; m++){
 			count++;
-			matched=likelihoodAndScore(localScore, localLikelihood, map, localPose, readings);
-			if (localScore>currentScore){
-				currentScore=localScore;
-				bestLocalPose=localPose;
+			if (scores[m]>currentScore){
+				currentScore=scores[m];
+				bestLocalPose=moves[m];
 			}
-			sm.score=localScore;
-			sm.likelihood=localLikelihood;//+log(odo_gain);
-			sm.pose=localPose;
+			sm.score=scores[m];
+			sm.likelihood=likelihoods[m];//+log(odo_gain);
+			sm.pose=moves[m];
 			moveList.push_back(sm);
 			//update the move list
-		} while(move!=Done);
+		}
 		currentPose=bestLocalPose;
 		//cout << __func__ << "currentScore=" << currentScore<< endl;
 		//here we look for the best move;
@@ -550,6 +1041,10 @@ double ScanMatcher::optimize(OrientedPoint& _mean, ScanMatcher::CovarianceMatrix
 	}
 	cov.xx/=lacc, cov.xy/=lacc, cov.xt/=lacc, cov.yy/=lacc, cov.yt/=lacc, cov.tt/=lacc;
 	
+	m_matchStatistics.matches++;
+	m_matchStatistics.iterations+=count;
+	m_matchStatistics.evaluations+=evaluations;
+	m_matchStatistics.time+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
 	_mean=currentPose;
 	_cov=cov;
 	return bestScore;
@@ -565,141 +1060,122 @@ void ScanMatcher::setLaserParameters
 	m_laserBeams=beams;
 	//m_laserAngles=new double[beams];
 	memcpy(m_laserAngles, angles, sizeof(double)*m_laserBeams);	
+	for (unsigned int i=0; i<m_laserBeams; i++){
+		m_laserCos[i]=cos(m_laserAngles[i]);
+		m_laserSin[i]=sin(m_laserAngles[i]);
+	}
 }
 	
 
 double ScanMatcher::likelihood
 	(double& _lmax, OrientedPoint& _mean, CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings){
-	ScoredMoveList moveList;
-	
-	for (double xx=-m_llsamplerange; xx<=m_llsamplerange; xx+=m_llsamplestep)
-	for (double yy=-m_llsamplerange; yy<=m_llsamplerange; yy+=m_llsamplestep)
-	for (double tt=-m_lasamplerange; tt<=m_lasamplerange; tt+=m_lasamplestep){
-		
-		OrientedPoint rp=p;
-		rp.x+=xx;
-		rp.y+=yy;
-		rp.theta+=tt;
-		
-		ScoredMove sm;
-		sm.pose=rp;
-		
-		likelihoodAndScore(sm.score, sm.likelihood, map, rp, readings);
-		moveList.push_back(sm);
-	}
-	
-	//OrientedPoint delta=mean-currentPose;
-	//cout << "delta.x=" << delta.x << " delta.y=" << delta.y << " delta.theta=" << delta.theta << endl;
-	//normalize the likelihood
-	double lmax=-1e9;
-	double lcum=0;
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		lmax=it->likelihood>lmax?it->likelihood:lmax;
-	}
-	for (ScoredMoveList::iterator it=moveList.begin(); it!=moveList.end(); it++){
-		//it->likelihood=exp(it->likelihood-lmax);
-		lcum+=exp(it->likelihood-lmax);
-		it->likelihood=exp(it->likelihood-lmax);
-		//cout << "l=" << it->likelihood << endl;
-	}
-	
-	OrientedPoint mean(0,0,0);
-	double s=0,c=0;
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		mean=mean+it->pose*it->likelihood;
-		s+=it->likelihood*sin(it->pose.theta);
-		c+=it->likelihood*cos(it->pose.theta);
-	}
-	mean=mean*(1./lcum);
-	s/=lcum;
-	c/=lcum;
-	mean.theta=atan2(s,c);
-	
-	
-	CovarianceMatrix cov={0.,0.,0.,0.,0.,0.};
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		OrientedPoint delta=it->pose-mean;
-		delta.theta=atan2(sin(delta.theta), cos(delta.theta));
-		cov.xx+=delta.x*delta.x*it->likelihood;
-		cov.yy+=delta.y*delta.y*it->likelihood;
-		cov.tt+=delta.theta*delta.theta*it->likelihood;
-		cov.xy+=delta.x*delta.y*it->likelihood;
-		cov.xt+=delta.x*delta.theta*it->likelihood;
-		cov.yt+=delta.y*delta.theta*it->likelihood;
-	}
-	cov.xx/=lcum, cov.xy/=lcum, cov.xt/=lcum, cov.yy/=lcum, cov.yt/=lcum, cov.tt/=lcum;
-	
-	_mean=mean;
-	_cov=cov;
-	_lmax=lmax;
-	return log(lcum)+lmax;
+	return sampleLikelihood(_lmax, _mean, _cov, map, p, 0, readings, 1.);
 }
 
 double ScanMatcher::likelihood
 	(double& _lmax, OrientedPoint& _mean, CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& p,
 	Gaussian3& odometry, const double* readings, double gain){
-	ScoredMoveList moveList;
-	
-	
-	for (double xx=-m_llsamplerange; xx<=m_llsamplerange; xx+=m_llsamplestep)
-	for (double yy=-m_llsamplerange; yy<=m_llsamplerange; yy+=m_llsamplestep)
-	for (double tt=-m_lasamplerange; tt<=m_lasamplerange; tt+=m_lasamplestep){
-		
-		OrientedPoint rp=p;
-		rp.x+=xx;
-		rp.y+=yy;
-		rp.theta+=tt;
-		
-		ScoredMove sm;
-		sm.pose=rp;
-		
-		likelihoodAndScore(sm.score, sm.likelihood, map, rp, readings);
-		sm.likelihood+=odometry.eval(rp)/gain;
-		assert(!isnan(sm.likelihood));
-		moveList.push_back(sm);
-	}
-	
-	//OrientedPoint delta=mean-currentPose;
-	//cout << "delta.x=" << delta.x << " delta.y=" << delta.y << " delta.theta=" << delta.theta << endl;
-	//normalize the likelihood
-  double lmax=-std::numeric_limits<double>::max();
-	double lcum=0;
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		lmax=it->likelihood>lmax?it->likelihood:lmax;
-	}
-	for (ScoredMoveList::iterator it=moveList.begin(); it!=moveList.end(); it++){
-		//it->likelihood=exp(it->likelihood-lmax);
-		lcum+=exp(it->likelihood-lmax);
-		it->likelihood=exp(it->likelihood-lmax);
-		//cout << "l=" << it->likelihood << endl;
+	return sampleLikelihood(_lmax, _mean, _cov, map, p, &odometry, readings, gain);
+}
+
+/**the number of offsets from -range to range with the given step, one if the grid is empty*/
+static unsigned int samplingSteps(double range, double step){
+	if (range<=0 || step<=0)
+		return 1;
+	return (unsigned int)floor(2*range/step+1e-6)+1;
+}
+
+/**Evaluates the poses of the sampling grid around p and returns the log of the sum of their
+likelihoods, with their weighted mean and covariance. The grid goes from -llsamplerange to
+llsamplerange and from -lasamplerange to lasamplerange, with integer counters, and is
+evaluated in a single batch, split among likelihoodThreads copies of the matcher when it is
+large enough. The moments are then computed in a single pass, with the weights exp(l-lmax)
+taken relative to the running maximum and the sums rescaled when it grows, and the moments
+taken about p, so that no list of the moves is needed.*/
+double ScanMatcher::sampleLikelihood
+	(double& _lmax, OrientedPoint& _mean, CovarianceMatrix& _cov, const ScanMatcherMap& map, const OrientedPoint& p,
+	Gaussian3* odometry, const double* readings, double gain){
+	prepareBeams(m_likelihoodBeams, readings, map.getDelta()*m_freeCellRatio, false);
+
+	unsigned int linearSteps=samplingSteps(m_llsamplerange, m_llsamplestep);
+	unsigned int angularSteps=samplingSteps(m_lasamplerange, m_lasamplestep);
+	double linearStart=linearSteps>1?-m_llsamplerange:0.;
+	double angularStart=angularSteps>1?-m_lasamplerange:0.;
+	unsigned int n=linearSteps*linearSteps*angularSteps;
+	m_samples.resize(n);
+	m_sampleScores.resize(n);
+	m_sampleLikelihoods.resize(n);
+	unsigned int i=0;
+	for (unsigned int xx=0; xx<linearSteps; xx++)
+	for (unsigned int yy=0; yy<linearSteps; yy++)
+	for (unsigned int tt=0; tt<angularSteps; tt++){
+		OrientedPoint& rp=m_samples[i++];
+		rp=p;
+		rp.x+=linearStart+xx*m_llsamplestep;
+		rp.y+=linearStart+yy*m_llsamplestep;
+		rp.theta+=angularStart+tt*m_lasamplestep;
 	}
-	
-	OrientedPoint mean(0,0,0);
-	double s=0,c=0;
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		mean=mean+it->pose*it->likelihood;
-		s+=it->likelihood*sin(it->pose.theta);
-		c+=it->likelihood*cos(it->pose.theta);
+
+	//each thread evaluates a contiguous range of the samples on its own copy of the matcher
+	const unsigned int minimumSamples=64;
+	unsigned int threads=m_likelihoodThreads<n/minimumSamples?m_likelihoodThreads:n/minimumSamples;
+	if (threads<2){
+		likelihoodAndScoreBatch(&m_sampleScores[0], &m_sampleLikelihoods[0], map, &m_samples[0], n, m_likelihoodBeams);
+	} else {
+		unsigned int chunk=(n+threads-1)/threads;
+		std::vector<std::thread> workers;
+		for (unsigned int t=1; t<threads; t++){
+			unsigned int begin=t*chunk, end=begin+chunk<n?begin+chunk:n;
+			if (begin>=end)
+				break;
+			workers.push_back(std::thread([this, &map, begin, end](){
+				ScanMatcher worker(*this);
+				worker.likelihoodAndScoreBatch(&m_sampleScores[begin], &m_sampleLikelihoods[begin], map, &m_samples[begin], end-begin, m_likelihoodBeams);
+			}));
+		}
+		likelihoodAndScoreBatch(&m_sampleScores[0], &m_sampleLikelihoods[0], map, &m_samples[0], chunk, m_likelihoodBeams);
+		for (unsigned int t=0; t<workers.size(); t++)
+			workers[t].join();
 	}
-	mean=mean*(1./lcum);
-	s/=lcum;
-	c/=lcum;
-	mean.theta=atan2(s,c);
-	
-	
-	CovarianceMatrix cov={0.,0.,0.,0.,0.,0.};
-	for (ScoredMoveList::const_iterator it=moveList.begin(); it!=moveList.end(); it++){
-		OrientedPoint delta=it->pose-mean;
-		delta.theta=atan2(sin(delta.theta), cos(delta.theta));
-		cov.xx+=delta.x*delta.x*it->likelihood;
-		cov.yy+=delta.y*delta.y*it->likelihood;
-		cov.tt+=delta.theta*delta.theta*it->likelihood;
-		cov.xy+=delta.x*delta.y*it->likelihood;
-		cov.xt+=delta.x*delta.theta*it->likelihood;
-		cov.yt+=delta.y*delta.theta*it->likelihood;
+
+	double lmax=-std::numeric_limits<double>::max();
+	double lcum=0;
+	double sx=0, sy=0, st=0, ss=0, sc=0;
+	double sxx=0, syy=0, stt=0, sxy=0, sxt=0, syt=0;
+	for (i=0; i<n; i++){
+		const OrientedPoint& rp=m_samples[i];
+		double l=m_sampleLikelihoods[i];
+		if (odometry){
+			l+=odometry->eval(rp)/gain;
+			assert(!isnan(l));
+		}
+		if (l>lmax){
+			double r=exp(lmax-l);
+			lcum*=r, sx*=r, sy*=r, st*=r, ss*=r, sc*=r;
+			sxx*=r, syy*=r, stt*=r, sxy*=r, sxt*=r, syt*=r;
+			lmax=l;
+		}
+		double w=exp(l-lmax);
+		double dx=rp.x-p.x, dy=rp.y-p.y, dt=rp.theta-p.theta;
+		lcum+=w;
+		sx+=w*dx, sy+=w*dy, st+=w*dt;
+		ss+=w*sin(dt), sc+=w*cos(dt);
+		sxx+=w*dx*dx, syy+=w*dy*dy, stt+=w*dt*dt;
+		sxy+=w*dx*dy, sxt+=w*dx*dt, syt+=w*dy*dt;
 	}
-	cov.xx/=lcum, cov.xy/=lcum, cov.xt/=lcum, cov.yy/=lcum, cov.yt/=lcum, cov.tt/=lcum;
-	
+
+	//the mean heading is the circular mean, the deviations are taken from it
+	double mx=sx/lcum, my=sy/lcum, mt=atan2(ss, sc);
+	double et=st/lcum;
+	OrientedPoint mean(p.x+mx, p.y+my, atan2(sin(p.theta+mt), cos(p.theta+mt)));
+	CovarianceMatrix cov;
+	cov.xx=sxx/lcum-mx*mx;
+	cov.yy=syy/lcum-my*my;
+	cov.tt=stt/lcum-2*mt*et+mt*mt;
+	cov.xy=sxy/lcum-mx*my;
+	cov.xt=sxt/lcum-mx*et;
+	cov.yt=syt/lcum-my*et;
+
 	_mean=mean;
 	_cov=cov;
 	_lmax=lmax;
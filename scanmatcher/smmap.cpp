@@ -10,6 +10,16 @@ const PointAccumulator& PointAccumulator::Unknown(){
 
 PointAccumulator* PointAccumulator::unknown_ptr=0;
 
+constexpr double CompactPointAccumulator::MeanResolution;
+
+const CompactPointAccumulator& CompactPointAccumulator::Unknown(){
+	if (! unknown_ptr)
+		unknown_ptr=new CompactPointAccumulator;
+	return *unknown_ptr;
+}
+
+CompactPointAccumulator* CompactPointAccumulator::unknown_ptr=0;
+
 };
 
 
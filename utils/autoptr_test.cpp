@@ -1,4 +1,7 @@
 #include <iostream>
+#include <thread>
+#include <vector>
+#include <utility>
 #include "gmapping/utils/autoptr.h"
 
 using namespace std;
@@ -6,6 +9,14 @@ using namespace GMapping;
 
 typedef autoptr<double> DoubleAutoPtr;
 
+void copyAndDestroy(const DoubleAutoPtr* ptr, int iterations){
+	for (int i=0; i<iterations; i++){
+		DoubleAutoPtr copy(*ptr);
+		DoubleAutoPtr other;
+		other=copy;
+	}
+}
+
 int main(int argc, const char * const * argv){
 	double* d1=new double(10.);
 	double* d2=new double(20.);
@@ -26,4 +37,17 @@ int main(int argc, const char * const * argv){
 	cout << "neg conversion operator " << nullPtr << endl;
 	cout << "conversion operator " << (int)pd1 << endl;
 	cout << "neg conversion operator " << !(pd1) << endl;
+	cout << "move construction" << endl;
+	DoubleAutoPtr pd4(std::move(pd3));
+	cout << *pd4 << " shares=" << pd4.m_reference->shares << " moved from " << (int)pd3 << endl;
+	cout << "move assignment" << endl;
+	pd3=std::move(pd4);
+	cout << *pd3 << " shares=" << pd3.m_reference->shares << " moved from " << (int)pd4 << endl;
+	cout << "concurrent copies" << endl;
+	std::vector<std::thread> threads;
+	for (int t=0; t<4; t++)
+		threads.push_back(std::thread(copyAndDestroy, &pd1, 100000));
+	for (unsigned int t=0; t<threads.size(); t++)
+		threads[t].join();
+	cout << "shares=" << pd1.m_reference->shares << endl;
 }
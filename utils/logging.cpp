@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "gmapping/utils/logging.h"
+
+namespace GMapping {
+
+namespace Log {
+
+static const char* const levelNames[]={"quiet", "error", "warning", "info", "debug"};
+
+int parseLevel(const char* s, int def){
+	if (!s || !*s)
+		return def;
+	for (int i=Quiet; i<=Debug; i++)
+		if (!strcmp(s, levelNames[i]))
+			return i;
+	char* end;
+	long l=strtol(s, &end, 10);
+	if (*end || l<Quiet)
+		return def;
+	return l>Debug?Debug:(int)l;
+}
+
+std::atomic<int> currentLevel(parseLevel(getenv("GMAPPING_LOG_LEVEL"), Info));
+
+static std::ostream* logStream=&std::cerr;
+
+void setLevel(int level){
+	currentLevel.store(level, std::memory_order_relaxed);
+}
+
+std::ostream& stream(){
+	return *logStream;
+}
+
+void setStream(std::ostream& os){
+	logStream=&os;
+}
+
+};
+
+};
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 
 //#include <gsl/gsl_rng.h>
 //#include <gsl/gsl_randist.h>
@@ -24,6 +25,23 @@ double sampleUniformDouble(double min, double max)
 
 #endif
 
+//the 48 bit linear congruential generator of drand48. It starts from 0, as drand48 does
+//in glibc when srand48 is not called
+static thread_local uint64_t samplingState=0;
+
+double sampleUniform(){
+	samplingState=(0x5DEECE66DULL*samplingState+0xB)&0xFFFFFFFFFFFFULL;
+	return samplingState*(1./281474976710656.);
+}
+
+void seedSampling(unsigned long int S){
+	samplingState=((uint64_t)(S&0xFFFFFFFFUL)<<16)|0x330E;
+}
+
+void resetSampling(){
+	samplingState=0;
+}
+
 // Draw randomly from a zero-mean Gaussian distribution, with standard
 // deviation sigma.
 // We use the polar form of the Box-Muller transformation, explained here:
@@ -35,10 +53,10 @@ double pf_ran_gaussian(double sigma)
 
   do
   {
-    do { r = drand48(); } while (r == 0.0);
+    do { r = sampleUniform(); } while (r == 0.0);
     x1 = 2.0 * r - 1.0;
-    do { r = drand48(); } while (r == 0.0);
-    x2 = 2.0 * drand48() - 1.0;
+    do { r = sampleUniform(); } while (r == 0.0);
+    x2 = 2.0 * sampleUniform() - 1.0;
     w = x1*x1 + x2*x2;
   } while(w > 1.0 || w==0.0);
 
@@ -56,7 +74,7 @@ double sampleGaussian(double sigma, unsigned long int S) {
 	if (S!=0)
         {
 		//gsl_rng_set(r, S);
-                srand48(S);
+                seedSampling(S);
         }
 	if (sigma==0)
 		return 0;